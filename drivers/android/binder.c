@@ -63,6 +63,7 @@
 #include <linux/nsproxy.h>
 #include <linux/poll.h>
 #include <linux/debugfs.h>
+#include <linux/hash.h>
 #include <linux/rbtree.h>
 #include <linux/sched/signal.h>
 #include <linux/sched/mm.h>
@@ -71,6 +72,9 @@
 #include <linux/pid_namespace.h>
 #include <linux/security.h>
 #include <linux/spinlock.h>
+#include <linux/jump_label.h>
+#include <linux/percpu.h>
+#include <linux/vmalloc.h>
 
 #include <uapi/linux/android/binder.h>
 #include <uapi/linux/sched/types.h>
@@ -275,6 +279,113 @@ static struct binder_transaction_log_entry *binder_transaction_log_add(
 	return e;
 }
 
+/*
+ * Transaction latency histograms, keyed by (target proc, code).
+ * Each CPU owns its table and updates it with preemption disabled,
+ * so no locks or atomics are needed. Readers merge the tables.
+ * A table is far larger than the percpu allocator allows, so each
+ * CPU only holds a pointer to its vmalloc'ed table.
+ * Bucket 0 is < 1us, bucket n is [2^(n-1), 2^n) us, the last is open.
+ */
+#define BINDER_LAT_HIST_BITS		8
+#define BINDER_LAT_HIST_PROBES		4
+#define BINDER_LAT_HIST_BUCKETS		16
+
+enum binder_lat_type {
+	BINDER_LAT_QUEUE,	/* enqueue to delivery, no idle thread */
+	BINDER_LAT_WAKEUP,	/* enqueue to delivery, idle thread woken */
+	BINDER_LAT_REPLY,	/* delivery to reply */
+	BINDER_LAT_REPLY_FTT,	/* delivery to reply, fast track sender */
+	BINDER_LAT_NR,
+};
+
+static const char * const binder_lat_type_names[BINDER_LAT_NR] = {
+	"queue", "wakeup", "reply", "reply_ftt",
+};
+
+struct binder_lat_hist {
+	int pid;
+	unsigned int code;
+	u32 bucket[BINDER_LAT_NR][BINDER_LAT_HIST_BUCKETS];
+	u64 total_ns[BINDER_LAT_NR];
+};
+
+struct binder_lat_table {
+	struct binder_lat_hist hist[1 << BINDER_LAT_HIST_BITS];
+	u64 dropped;
+};
+
+static DEFINE_STATIC_KEY_FALSE(binder_lat_enabled);
+static DEFINE_PER_CPU(struct binder_lat_table *, binder_lat_tables);
+static bool binder_lat_allocated;
+static DEFINE_MUTEX(binder_lat_lock);
+
+static struct binder_lat_hist *binder_lat_lookup(struct binder_lat_table *table,
+						 int pid, unsigned int code)
+{
+	unsigned int slot = hash_32(pid ^ (code << 16 | code >> 16),
+				    BINDER_LAT_HIST_BITS);
+	struct binder_lat_hist *h;
+	int i;
+
+	for (i = 0; i < BINDER_LAT_HIST_PROBES; i++) {
+		h = &table->hist[(slot + i) & (ARRAY_SIZE(table->hist) - 1)];
+		if (!h->pid) {
+			h->code = code;
+			/* readers check pid before they trust code */
+			smp_wmb();
+			WRITE_ONCE(h->pid, pid);
+		}
+		if (h->pid == pid && h->code == code)
+			return h;
+	}
+	return NULL;
+}
+
+static void binder_lat_record(int pid, unsigned int code,
+			      enum binder_lat_type type, u64 start_ns)
+{
+	struct binder_lat_table *table;
+	struct binder_lat_hist *h;
+	u64 delta_ns = ktime_get_ns() - start_ns;
+	u64 delta_us = div_u64(delta_ns, NSEC_PER_USEC);
+	int bucket;
+
+	bucket = delta_us ? min_t(int, ilog2(delta_us) + 1,
+				  BINDER_LAT_HIST_BUCKETS - 1) : 0;
+
+	table = get_cpu_var(binder_lat_tables);
+	h = binder_lat_lookup(table, pid, code);
+	if (h) {
+		h->bucket[type][bucket]++;
+		h->total_ns[type] += delta_ns;
+	} else {
+		table->dropped++;
+	}
+	put_cpu_var(binder_lat_tables);
+}
+
+static int binder_lat_alloc_tables(void)
+{
+	struct binder_lat_table *table;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		table = vzalloc_node(sizeof(*table), cpu_to_node(cpu));
+		if (!table)
+			goto err_free;
+		per_cpu(binder_lat_tables, cpu) = table;
+	}
+	return 0;
+
+err_free:
+	for_each_possible_cpu(cpu) {
+		vfree(per_cpu(binder_lat_tables, cpu));
+		per_cpu(binder_lat_tables, cpu) = NULL;
+	}
+	return -ENOMEM;
+}
+
 struct binder_context {
 	struct binder_node *binder_context_mgr_node;
 	struct mutex context_mgr_node_lock;
@@ -557,6 +668,9 @@ struct binder_priority {
  * @alloc:                binder allocator bookkeeping
  * @context:              binder_context for this proc
  *                        (invariant after initialized)
+ * @freecess_cache:       decoded interface tokens of oneway transactions
+ *                        to this proc while frozen (set once, then
+ *                        protected by its own lock)
  * @inner_lock:           can nest under outer_lock and/or node lock
  * @outer_lock:           no nesting under innor or node lock
  *                        Lock order: 1) outer, 2) node, 3) inner
@@ -594,6 +708,9 @@ struct binder_proc {
 	struct dentry *debugfs_entry;
 	struct binder_alloc alloc;
 	struct binder_context *context;
+#ifdef CONFIG_SAMSUNG_FREECESS
+	struct freecess_token_cache *freecess_cache;
+#endif
 	spinlock_t inner_lock;
 	spinlock_t outer_lock;
 };
@@ -682,6 +799,11 @@ struct binder_transaction {
 	bool    set_priority_called;
 	kuid_t	sender_euid;
 	binder_uintptr_t security_ctx;
+	/* timestamps for latency histograms, 0 when not measured */
+	u64	lat_enqueue_ns;
+	u64	lat_deliver_ns;
+	bool	lat_wakeup;
+	bool	lat_ftt;
 	/**
 	 * @lock:  protects @from, @to_proc, and @to_thread
 	 *
@@ -3178,6 +3300,14 @@ static bool binder_proc_transaction(struct binder_transaction *t,
 	if (!thread && !pending_async)
 		thread = binder_select_thread_ilocked(proc);
 
+	if (static_branch_unlikely(&binder_lat_enabled)) {
+		t->lat_enqueue_ns = ktime_get_ns();
+		t->lat_wakeup = thread != NULL;
+#ifdef CONFIG_FAST_TRACK
+		t->lat_ftt = !oneway && is_ftt(&current->se);
+#endif
+	}
+
 	if (thread) {
 		binder_transaction_priority(thread->task, t, node_prio,
 					    node->inherit_rt);
@@ -3250,21 +3380,95 @@ static struct binder_node *binder_get_node_refs_for_txn(
 }
 
 #ifdef CONFIG_SAMSUNG_FREECESS
+#define FREECESS_TOKEN_CACHE_BITS	3
+#define FREECESS_REPORT_INTERVAL	(HZ / 10)
+
+/**
+ * struct freecess_token_entry - decoded interface token for (node, code)
+ * @node_debug_id:  debug_id of the target node, 0 if the entry is unused
+ * @code:           transaction code
+ * @last_report:    jiffies of the last binder_report() for this entry
+ * @name:           decoded interface token
+ */
+struct freecess_token_entry {
+	int node_debug_id;
+	u32 code;
+	unsigned long last_report;
+	char name[INTERFACETOKEN_BUFF_SIZE];
+};
+
+/**
+ * struct freecess_token_cache - per target proc cache of interface tokens
+ * @lock:           protects @entries
+ * @entries:        direct mapped by hash of (node, code)
+ *
+ * Allocated on the first oneway transaction to the proc while it is frozen.
+ */
+struct freecess_token_cache {
+	spinlock_t lock;
+	struct freecess_token_entry entries[1 << FREECESS_TOKEN_CACHE_BITS];
+};
+
+static struct freecess_token_cache *
+freecess_token_cache_get(struct binder_proc *proc)
+{
+	struct freecess_token_cache *cache, *old;
+
+	cache = READ_ONCE(proc->freecess_cache);
+	if (cache)
+		return cache;
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return NULL;
+	spin_lock_init(&cache->lock);
+
+	old = cmpxchg(&proc->freecess_cache, NULL, cache);
+	if (old) {
+		kfree(cache);
+		cache = old;
+	}
+	return cache;
+}
+
 // 1) Skip first 8 bytes (useless data)
 // 2) Make sure that the invalid address issue is not occuring (j=9, j+=2)
 // 3) Java layer uses 2 bytes char. And only the first byte has the data. (p+=2)
 // 4) Parcel::writeInterfaceToken() in frameworks/native/libs/binder/Parcel.cpp
+// The data is already copied to the target buffer, so read it from there.
+static void freecess_decode_token(struct binder_proc *target_proc,
+				  struct binder_transaction *t,
+				  int skip_bytes, char *buf)
+{
+	char buf_raw[INTERFACETOKEN_BUFF_SIZE] = {0};
+	char *p = NULL;
+	int i = 0;
+	int j = 0;
+
+	binder_alloc_copy_from_buffer(&target_proc->alloc, buf_raw, t->buffer,
+		0, min_t(size_t, t->buffer->data_size,
+			 INTERFACETOKEN_BUFF_SIZE - 1));
+	p = &buf_raw[skip_bytes];
+	j = skip_bytes + 1;
+	while (i < INTERFACETOKEN_BUFF_SIZE && j < t->buffer->data_size && *p != '\0') {
+		buf[i++] = *p;
+		j+=2;
+		p+=2;
+	}
+	if (i == INTERFACETOKEN_BUFF_SIZE) buf[i-1] = '\0';
+}
+
 static void freecess_async_binder_report(struct binder_proc *proc,
 						struct binder_proc *target_proc,
 						struct binder_transaction_data *tr,
 						struct binder_transaction *t)
 {
-	char buf_user[INTERFACETOKEN_BUFF_SIZE] = {0};
 	char buf[INTERFACETOKEN_BUFF_SIZE] = {0};
-	char *p = NULL;
-	int i = 0;
-	int j = 0;
+	struct freecess_token_cache *cache;
+	struct freecess_token_entry *e = NULL;
+	int node_debug_id;
 	int skip_bytes = 8;
+	bool hit = false;
 
 	if (!proc || !target_proc || !tr || !t)
 		return;
@@ -3275,28 +3479,50 @@ static void freecess_async_binder_report(struct binder_proc *proc,
 	else if (freecess_fw_version == 1)
 		skip_bytes = 12;
 
-	if ((tr->flags & TF_ONE_WAY) && target_proc
+	if (!((tr->flags & TF_ONE_WAY) && target_proc
 		&& target_proc->tsk && target_proc->tsk->cred
 		&& (target_proc->tsk->cred->euid.val > 10000)
-		&& (proc->pid != target_proc->pid)) {
-		if (thread_group_is_frozen(target_proc->tsk)) {
-			if (t->buffer->data_size > skip_bytes) {
-				if (0 == copy_from_user(buf_user, (const void __user *)(uintptr_t)tr->data.ptr.buffer,
-					min_t(binder_size_t, tr->data_size, INTERFACETOKEN_BUFF_SIZE - 1))) {
-					p = &buf_user[skip_bytes];
-					i = 0;
-					j = skip_bytes + 1;
-					while (i < INTERFACETOKEN_BUFF_SIZE && j < t->buffer->data_size && *p != '\0') {
-						buf[i++] = *p;
-						j+=2;
-						p+=2;
-					}
-					if (i == INTERFACETOKEN_BUFF_SIZE) buf[i-1] = '\0';
-				}
-				binder_report(target_proc->tsk, tr->code, buf, tr->flags & TF_ONE_WAY);
+		&& (proc->pid != target_proc->pid)))
+		return;
+	if (!thread_group_is_frozen(target_proc->tsk))
+		return;
+	if (t->buffer->data_size <= skip_bytes)
+		return;
+
+	node_debug_id = t->buffer->target_node ?
+		t->buffer->target_node->debug_id : 0;
+	cache = node_debug_id ? freecess_token_cache_get(target_proc) : NULL;
+	if (cache) {
+		e = &cache->entries[hash_32(node_debug_id ^ tr->code,
+					    FREECESS_TOKEN_CACHE_BITS)];
+		spin_lock(&cache->lock);
+		if (e->node_debug_id == node_debug_id && e->code == tr->code) {
+			hit = true;
+			/* storms to a frozen app need one report, not one per txn */
+			if (time_before(jiffies, e->last_report +
+					FREECESS_REPORT_INTERVAL)) {
+				spin_unlock(&cache->lock);
+				return;
 			}
+			e->last_report = jiffies;
+			strlcpy(buf, e->name, sizeof(buf));
+		}
+		spin_unlock(&cache->lock);
+	}
+
+	if (!hit) {
+		freecess_decode_token(target_proc, t, skip_bytes, buf);
+		if (e) {
+			spin_lock(&cache->lock);
+			e->node_debug_id = node_debug_id;
+			e->code = tr->code;
+			e->last_report = jiffies;
+			strlcpy(e->name, buf, sizeof(e->name));
+			spin_unlock(&cache->lock);
 		}
 	}
+
+	binder_report(target_proc->tsk, tr->code, buf, tr->flags & TF_ONE_WAY);
 }
 
 static void freecess_sync_binder_report(struct binder_proc *proc,
@@ -3901,6 +4127,13 @@ static void binder_transaction(struct binder_proc *proc,
 #endif
 
 		binder_restore_priority(current, in_reply_to->saved_priority);
+		if (static_branch_unlikely(&binder_lat_enabled) &&
+		    in_reply_to->lat_deliver_ns)
+			binder_lat_record(proc->pid, in_reply_to->code,
+					  in_reply_to->lat_ftt ?
+					  BINDER_LAT_REPLY_FTT :
+					  BINDER_LAT_REPLY,
+					  in_reply_to->lat_deliver_ns);
 		binder_free_transaction(in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
 		BUG_ON(t->buffer->async_transaction != 0);
@@ -4892,6 +5125,13 @@ retry:
 #ifdef CONFIG_DEBUG_SNAPSHOT_BINDER
 		dss_binder_transaction_received(t, thread);
 #endif
+		if (static_branch_unlikely(&binder_lat_enabled) &&
+		    cmd != BR_REPLY && t->lat_enqueue_ns) {
+			binder_lat_record(proc->pid, t->code, t->lat_wakeup ?
+					  BINDER_LAT_WAKEUP : BINDER_LAT_QUEUE,
+					  t->lat_enqueue_ns);
+			t->lat_deliver_ns = ktime_get_ns();
+		}
 		trace_binder_transaction_received(t);
 		binder_stat_br(proc, thread, cmd);
 		binder_debug(BINDER_DEBUG_TRANSACTION,
@@ -5069,6 +5309,9 @@ static void binder_free_proc(struct binder_proc *proc)
 	BUG_ON(!list_empty(&proc->todo));
 	BUG_ON(!list_empty(&proc->delivered_death));
 	binder_alloc_deferred_release(&proc->alloc);
+#ifdef CONFIG_SAMSUNG_FREECESS
+	kfree(proc->freecess_cache);
+#endif
 	put_task_struct(proc->tsk);
 	put_cred(proc->cred);
 	binder_stats_deleted(BINDER_STAT_PROC);
@@ -6574,6 +6817,125 @@ static int binder_transaction_log_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static int binder_transaction_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_lat_table *sum, *table;
+	struct binder_lat_hist *h, *src;
+	int cpu, i, type, bucket;
+	u64 count;
+
+	mutex_lock(&binder_lat_lock);
+	if (!binder_lat_allocated) {
+		mutex_unlock(&binder_lat_lock);
+		return 0;
+	}
+
+	sum = vzalloc(sizeof(*sum));
+	if (!sum) {
+		mutex_unlock(&binder_lat_lock);
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		table = per_cpu(binder_lat_tables, cpu);
+		sum->dropped += READ_ONCE(table->dropped);
+		for (i = 0; i < ARRAY_SIZE(table->hist); i++) {
+			src = &table->hist[i];
+			if (!READ_ONCE(src->pid))
+				continue;
+			smp_rmb();
+			h = binder_lat_lookup(sum, src->pid, src->code);
+			if (!h) {
+				sum->dropped++;
+				continue;
+			}
+			for (type = 0; type < BINDER_LAT_NR; type++) {
+				for (bucket = 0; bucket < BINDER_LAT_HIST_BUCKETS;
+				     bucket++)
+					h->bucket[type][bucket] +=
+						READ_ONCE(src->bucket[type][bucket]);
+				h->total_ns[type] += READ_ONCE(src->total_ns[type]);
+			}
+		}
+	}
+	mutex_unlock(&binder_lat_lock);
+
+	seq_printf(m, "buckets: <1us then [2^(n-1), 2^n) us, dropped %llu\n",
+		   sum->dropped);
+	for (i = 0; i < ARRAY_SIZE(sum->hist); i++) {
+		h = &sum->hist[i];
+		if (!h->pid)
+			continue;
+		for (type = 0; type < BINDER_LAT_NR; type++) {
+			count = 0;
+			for (bucket = 0; bucket < BINDER_LAT_HIST_BUCKETS; bucket++)
+				count += h->bucket[type][bucket];
+			if (!count)
+				continue;
+			seq_printf(m, "%d %u %s count %llu avg_us %llu:",
+				   h->pid, h->code, binder_lat_type_names[type],
+				   count, div64_u64(h->total_ns[type], count) /
+				   NSEC_PER_USEC);
+			for (bucket = 0; bucket < BINDER_LAT_HIST_BUCKETS; bucket++)
+				seq_printf(m, " %u", h->bucket[type][bucket]);
+			seq_puts(m, "\n");
+		}
+	}
+	vfree(sum);
+	return 0;
+}
+
+static int binder_transaction_latency_enable_show(struct seq_file *m,
+						  void *unused)
+{
+	seq_printf(m, "%d\n", static_branch_unlikely(&binder_lat_enabled));
+	return 0;
+}
+
+static int binder_transaction_latency_enable_open(struct inode *inode,
+						  struct file *file)
+{
+	return single_open(file, binder_transaction_latency_enable_show,
+			   inode->i_private);
+}
+
+static ssize_t binder_transaction_latency_enable_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *pos)
+{
+	bool enable;
+	int ret;
+
+	ret = kstrtobool_from_user(buffer, count, &enable);
+	if (ret)
+		return ret;
+
+	mutex_lock(&binder_lat_lock);
+	if (enable && !binder_lat_allocated) {
+		ret = binder_lat_alloc_tables();
+		if (ret) {
+			mutex_unlock(&binder_lat_lock);
+			return ret;
+		}
+		binder_lat_allocated = true;
+	}
+	if (enable)
+		static_branch_enable(&binder_lat_enabled);
+	else
+		static_branch_disable(&binder_lat_enabled);
+	mutex_unlock(&binder_lat_lock);
+
+	return count;
+}
+
+static const struct file_operations binder_transaction_latency_enable_fops = {
+	.owner = THIS_MODULE,
+	.open = binder_transaction_latency_enable_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = binder_transaction_latency_enable_write,
+};
+
 static const struct file_operations binder_fops = {
 	.owner = THIS_MODULE,
 	.poll = binder_poll,
@@ -6589,6 +6951,7 @@ BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
+BINDER_DEBUG_ENTRY(transaction_latency);
 
 static int __init init_binder_device(const char *name)
 {
@@ -6663,6 +7026,16 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    &binder_transaction_log_failed,
 				    &binder_transaction_log_fops);
+		debugfs_create_file("transaction_latency",
+				    0444,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_transaction_latency_fops);
+		debugfs_create_file("transaction_latency_enable",
+				    0644,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_transaction_latency_enable_fops);
 #ifdef CONFIG_FAST_TRACK
 		debugfs_create_file("count",
 				    S_IRUGO,
@@ -53,6 +53,20 @@ static uint32_t binder_alloc_debug_mask;
 module_param_named(debug_mask, binder_alloc_debug_mask,
 		   uint, 0644);
 
+static bool binder_alloc_buffer_cache = true;
+
+module_param_named(buffer_cache, binder_alloc_buffer_cache,
+		   bool, 0644);
+
+/* the selftest expects exact page states, keep prefetch off for it */
+static uint binder_alloc_prefetch_pages =
+	IS_ENABLED(CONFIG_ANDROID_BINDER_IPC_SELFTEST) ? 0 : 8;
+
+module_param_named(prefetch_pages, binder_alloc_prefetch_pages,
+		   uint, 0644);
+
+#define BINDER_ALLOC_RECLAIM_BATCH	32
+
 #define binder_alloc_debug(mask, x...) \
 	do { \
 		if (binder_alloc_debug_mask & mask) \
@@ -282,6 +296,7 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 
 		if (index + 1 > alloc->pages_high)
 			alloc->pages_high = index + 1;
+		alloc->pages_inline++;
 
 		trace_binder_alloc_page_end(alloc, index);
 		/* vm_insert_page does not seem to increment the refcount */
@@ -352,6 +367,233 @@ static inline struct vm_area_struct *binder_alloc_get_vma(
 	return vma;
 }
 
+/**
+ * binder_alloc_prefetch_range() - populate pages ahead of allocation
+ * @alloc:	binder_alloc for this proc
+ * @start:	start of the range, page aligned
+ * @end:	end of the range, page aligned
+ *
+ * Allocate and map the missing pages of a range inside a free buffer and
+ * put them on the binder LRU, the same state a page is left in when its
+ * buffer is freed. The transaction path then only takes them off the LRU,
+ * and the shrinker can still reclaim them if they are never used.
+ */
+static void binder_alloc_prefetch_range(struct binder_alloc *alloc,
+					void __user *start, void __user *end)
+{
+	struct binder_lru_page *page;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	void __user *page_addr;
+	size_t index;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &alloc->pages[(page_addr - alloc->buffer) / PAGE_SIZE];
+		if (!page->page_ptr)
+			break;
+	}
+	if (page_addr >= end)
+		return;
+
+	mm = alloc->vma_vm_mm;
+	if (!mmget_not_zero(mm))
+		return;
+	down_read(&mm->mmap_sem);
+	vma = binder_alloc_get_vma(alloc);
+	if (!mmget_still_valid(mm) || !vma)
+		goto out;
+
+	for (; page_addr < end; page_addr += PAGE_SIZE) {
+		index = (page_addr - alloc->buffer) / PAGE_SIZE;
+		page = &alloc->pages[index];
+		if (page->page_ptr)
+			continue;
+
+		page->page_ptr = alloc_page(GFP_KERNEL |
+					    __GFP_HIGHMEM |
+					    __GFP_ZERO |
+					    __GFP_NOWARN);
+		if (!page->page_ptr)
+			break;
+		page->alloc = alloc;
+		INIT_LIST_HEAD(&page->lru);
+
+		if (vm_insert_page(vma, (uintptr_t)page_addr, page->page_ptr)) {
+			__free_page(page->page_ptr);
+			page->page_ptr = NULL;
+			break;
+		}
+
+		if (index + 1 > alloc->pages_high)
+			alloc->pages_high = index + 1;
+		alloc->pages_prefetched++;
+		list_lru_add(&binder_alloc_lru, &page->lru);
+	}
+out:
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+}
+
+/*
+ * Allocations are carved from the start of the largest free buffer
+ * once the smaller ones are used up, so that is where pages are needed.
+ */
+static void binder_alloc_prefetch_work_func(struct work_struct *work)
+{
+	struct binder_alloc *alloc =
+		container_of(work, struct binder_alloc, prefetch_work);
+	size_t bytes = (size_t)binder_alloc_prefetch_pages * PAGE_SIZE;
+	struct binder_buffer *buffer;
+	void __user *start;
+	void __user *end;
+	struct rb_node *n;
+
+	mutex_lock(&alloc->mutex);
+	n = rb_last(&alloc->free_buffers);
+	if (!n || !bytes || !binder_alloc_get_vma(alloc))
+		goto out;
+
+	buffer = rb_entry(n, struct binder_buffer, rb_node);
+	start = (void __user *)PAGE_ALIGN((uintptr_t)buffer->user_data);
+	end = (void __user *)(((uintptr_t)buffer->user_data +
+			       binder_alloc_buffer_size(alloc, buffer)) &
+			      PAGE_MASK);
+	if (end - start > bytes)
+		end = start + bytes;
+	binder_alloc_prefetch_range(alloc, start, end);
+out:
+	mutex_unlock(&alloc->mutex);
+}
+
+static int binder_alloc_cache_class(size_t size)
+{
+	return ilog2(size) - BINDER_ALLOC_CACHE_MIN_SHIFT;
+}
+
+/**
+ * binder_alloc_cache_get() - take a cached buffer that fits @size
+ * @alloc:	binder_alloc for this proc
+ * @size:	padded size of the new buffer
+ *
+ * Buffers in the class of @size are checked one by one. Buffers in the
+ * next class up always fit, so the latest one is taken from there.
+ *
+ * Return:	cached buffer or %NULL
+ */
+static struct binder_buffer *binder_alloc_cache_get(struct binder_alloc *alloc,
+						    size_t size)
+{
+	int class = binder_alloc_cache_class(size);
+	struct binder_buffer_cache *cache;
+	struct binder_buffer *buffer;
+	int i;
+
+	if (class >= BINDER_ALLOC_CACHE_CLASSES)
+		return NULL;
+
+	if (class >= 0) {
+		cache = &alloc->cache[class];
+		for (i = cache->count - 1; i >= 0; i--) {
+			buffer = cache->buffers[i];
+			if (binder_alloc_buffer_size(alloc, buffer) >= size)
+				goto found;
+		}
+	}
+
+	class = max(class + 1, 0);
+	if (class >= BINDER_ALLOC_CACHE_CLASSES)
+		return NULL;
+	cache = &alloc->cache[class];
+	if (!cache->count)
+		return NULL;
+	i = cache->count - 1;
+	buffer = cache->buffers[i];
+found:
+	cache->buffers[i] = cache->buffers[--cache->count];
+	return buffer;
+}
+
+/**
+ * binder_alloc_cache_put() - cache a buffer instead of merging it
+ * @alloc:	binder_alloc for this proc
+ * @buffer:	buffer removed from allocated_buffers
+ * @buffer_size: full size of @buffer
+ *
+ * Return:	%true if @buffer was cached
+ */
+static bool binder_alloc_cache_put(struct binder_alloc *alloc,
+				   struct binder_buffer *buffer,
+				   size_t buffer_size)
+{
+	int class = binder_alloc_cache_class(buffer_size);
+	struct binder_buffer_cache *cache;
+
+	if (!binder_alloc_buffer_cache || class < 0 ||
+	    class >= BINDER_ALLOC_CACHE_CLASSES)
+		return false;
+
+	cache = &alloc->cache[class];
+	if (cache->count == BINDER_ALLOC_CACHE_DEPTH)
+		return false;
+
+	cache->buffers[cache->count++] = buffer;
+	return true;
+}
+
+static void binder_merge_free_buf_locked(struct binder_alloc *alloc,
+					 struct binder_buffer *buffer);
+
+static int binder_alloc_cache_drain_locked(struct binder_alloc *alloc)
+{
+	struct binder_buffer_cache *cache;
+	int drained = 0;
+
+	for (cache = alloc->cache;
+	     cache < alloc->cache + BINDER_ALLOC_CACHE_CLASSES; cache++) {
+		while (cache->count) {
+			binder_merge_free_buf_locked(alloc,
+					cache->buffers[--cache->count]);
+			drained++;
+		}
+	}
+	return drained;
+}
+
+static struct binder_buffer *binder_alloc_commit_buf_locked(
+				struct binder_alloc *alloc,
+				struct binder_buffer *buffer,
+				size_t size,
+				size_t data_size,
+				size_t offsets_size,
+				size_t extra_buffers_size,
+				int is_async)
+{
+	buffer->allow_user_free = 0;
+	binder_insert_allocated_buffer_locked(alloc, buffer);
+	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "%d: binder_alloc_buf size %zd got %pK\n",
+		      alloc->pid, size, buffer);
+	buffer->data_size = data_size;
+	buffer->offsets_size = offsets_size;
+	buffer->async_transaction = is_async;
+	buffer->extra_buffers_size = extra_buffers_size;
+	if (is_async) {
+		alloc->free_async_space -= size + sizeof(struct binder_buffer);
+		if ((system_server_pid == alloc->pid) && (alloc->free_async_space <= 153600)) { // 150K
+			pr_info("%d: [free_size<150K] binder_alloc_buf size %zd async free %zd\n",
+					alloc->pid, size, alloc->free_async_space);
+		}
+		if ((system_server_pid == alloc->pid) && (size >= 122880)) { // 120K
+			pr_info("%d: [alloc_size>120K] binder_alloc_buf size %zd async free %zd\n",
+				alloc->pid, size, alloc->free_async_space);
+		}
+		binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
+			     "%d: binder_alloc_buf size %zd async free %zd\n",
+			      alloc->pid, size, alloc->free_async_space);
+	}
+	return buffer;
+}
+
 static struct binder_buffer *binder_alloc_new_buf_locked(
 				struct binder_alloc *alloc,
 				size_t data_size,
@@ -359,7 +601,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				size_t extra_buffers_size,
 				int is_async)
 {
-	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
 	struct rb_node *best_fit = NULL;
@@ -420,6 +662,29 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	/* Pad 0-size buffers so they get assigned unique addresses */
 	size = max(size, sizeof(void *));
 
+	buffer = binder_alloc_cache_get(alloc, size);
+	if (buffer) {
+		buffer_size = binder_alloc_buffer_size(alloc, buffer);
+		ret = binder_update_page_range(alloc, 1, (void __user *)
+			PAGE_ALIGN((uintptr_t)buffer->user_data),
+			(void __user *)(((uintptr_t)buffer->user_data +
+					 buffer_size) & PAGE_MASK));
+		if (ret) {
+			binder_merge_free_buf_locked(alloc, buffer);
+			return ERR_PTR(ret);
+		}
+		alloc->cache_hits++;
+		binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+			     "%d: binder_alloc_buf size %zd got cached buffer %pK size %zd\n",
+			      alloc->pid, size, buffer, buffer_size);
+		return binder_alloc_commit_buf_locked(alloc, buffer, size,
+				data_size, offsets_size, extra_buffers_size,
+				is_async);
+	}
+	alloc->cache_misses++;
+
+retry:
+	n = alloc->free_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
@@ -435,6 +700,8 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 			break;
 		}
 	}
+	if (best_fit == NULL && binder_alloc_cache_drain_locked(alloc))
+		goto retry;
 	if (best_fit == NULL) {
 		size_t allocated_buffers = 0;
 		size_t largest_alloc_size = 0;
@@ -506,30 +773,9 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 
 	rb_erase(best_fit, &alloc->free_buffers);
 	buffer->free = 0;
-	buffer->allow_user_free = 0;
-	binder_insert_allocated_buffer_locked(alloc, buffer);
-	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
-		     "%d: binder_alloc_buf size %zd got %pK\n",
-		      alloc->pid, size, buffer);
-	buffer->data_size = data_size;
-	buffer->offsets_size = offsets_size;
-	buffer->async_transaction = is_async;
-	buffer->extra_buffers_size = extra_buffers_size;
-	if (is_async) {
-		alloc->free_async_space -= size + sizeof(struct binder_buffer);
-		if ((system_server_pid == alloc->pid) && (alloc->free_async_space <= 153600)) { // 150K
-			pr_info("%d: [free_size<150K] binder_alloc_buf size %zd async free %zd\n",
-					alloc->pid, size, alloc->free_async_space);
-		}
-		if ((system_server_pid == alloc->pid) && (size >= 122880)) { // 120K
-			pr_info("%d: [alloc_size>120K] binder_alloc_buf size %zd async free %zd\n",
-				alloc->pid, size, alloc->free_async_space);
-		}
-		binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
-			     "%d: binder_alloc_buf size %zd async free %zd\n",
-			      alloc->pid, size, alloc->free_async_space);
-	}
-	return buffer;
+	return binder_alloc_commit_buf_locked(alloc, buffer, size, data_size,
+					      offsets_size, extra_buffers_size,
+					      is_async);
 
 err_alloc_buf_struct_failed:
 	binder_update_page_range(alloc, 0, (void __user *)
@@ -560,11 +806,19 @@ struct binder_buffer *binder_alloc_new_buf(struct binder_alloc *alloc,
 					   int is_async)
 {
 	struct binder_buffer *buffer;
+	size_t pages_inline;
+	bool prefetch;
 
 	mutex_lock(&alloc->mutex);
+	pages_inline = alloc->pages_inline;
 	buffer = binder_alloc_new_buf_locked(alloc, data_size, offsets_size,
 					     extra_buffers_size, is_async);
+	/* populated pages ran out, refill them before the next one */
+	prefetch = binder_alloc_prefetch_pages &&
+		alloc->pages_inline != pages_inline;
 	mutex_unlock(&alloc->mutex);
+	if (prefetch)
+		schedule_work(&alloc->prefetch_work);
 	return buffer;
 }
 
@@ -662,6 +916,14 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 			  buffer->user_data + buffer_size) & PAGE_MASK));
 
 	rb_erase(&buffer->rb_node, &alloc->allocated_buffers);
+	if (binder_alloc_cache_put(alloc, buffer, buffer_size))
+		return;
+	binder_merge_free_buf_locked(alloc, buffer);
+}
+
+static void binder_merge_free_buf_locked(struct binder_alloc *alloc,
+					 struct binder_buffer *buffer)
+{
 	buffer->free = 1;
 	if (!list_is_last(&buffer->entry, &alloc->buffers)) {
 		struct binder_buffer *next = binder_buffer_next(buffer);
@@ -698,6 +960,20 @@ void binder_alloc_free_buf(struct binder_alloc *alloc,
 	mutex_unlock(&alloc->mutex);
 }
 
+/**
+ * binder_alloc_cache_drain() - return cached buffers to the free tree
+ * @alloc:	binder_alloc for this proc
+ *
+ * Merge every cached buffer back into @alloc->free_buffers, leaving the
+ * address space as if the buffers had been freed without the cache.
+ */
+void binder_alloc_cache_drain(struct binder_alloc *alloc)
+{
+	mutex_lock(&alloc->mutex);
+	binder_alloc_cache_drain_locked(alloc);
+	mutex_unlock(&alloc->mutex);
+}
+
 /**
  * binder_alloc_mmap_handler() - map virtual address space for proc
  * @alloc:	alloc structure for this proc
@@ -776,6 +1052,7 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 	struct binder_buffer *buffer;
 
 	buffers = 0;
+	cancel_work_sync(&alloc->prefetch_work);
 	mutex_lock(&alloc->mutex);
 	BUG_ON(alloc->vma);
 
@@ -788,6 +1065,7 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 		binder_free_buf_locked(alloc, buffer);
 		buffers++;
 	}
+	binder_alloc_cache_drain_locked(alloc);
 
 	while (!list_empty(&alloc->buffers)) {
 		buffer = list_first_entry(&alloc->buffers,
@@ -888,6 +1166,10 @@ void binder_alloc_print_pages(struct seq_file *m,
 	mutex_unlock(&alloc->mutex);
 	seq_printf(m, "  pages: %d:%d:%d\n", active, lru, free);
 	seq_printf(m, "  pages high watermark: %zu\n", alloc->pages_high);
+	seq_printf(m, "  buffer cache hits: %zu misses: %zu\n",
+		   alloc->cache_hits, alloc->cache_misses);
+	seq_printf(m, "  pages populated inline: %zu prefetched: %zu\n",
+		   alloc->pages_inline, alloc->pages_prefetched);
 }
 
 /**
@@ -996,6 +1278,115 @@ err_get_alloc_mutex_failed:
 	return LRU_SKIP;
 }
 
+/**
+ * struct binder_alloc_reclaim_batch - pages of one proc isolated for reclaim
+ * @alloc: binder_alloc owning every page in @pages, its mutex is held
+ * @pages: isolated binder_lru_page entries
+ * @count: number of entries in @pages
+ */
+struct binder_alloc_reclaim_batch {
+	struct binder_alloc *alloc;
+	struct list_head pages;
+	int count;
+};
+
+static enum lru_status binder_alloc_isolate_page(struct list_head *item,
+						 struct list_lru_one *lru,
+						 spinlock_t *lock,
+						 void *cb_arg)
+{
+	struct binder_alloc_reclaim_batch *batch = cb_arg;
+	struct binder_lru_page *page = container_of(item,
+						    struct binder_lru_page,
+						    lru);
+
+	if (!batch->alloc) {
+		if (!mutex_trylock(&page->alloc->mutex))
+			return LRU_SKIP;
+		batch->alloc = page->alloc;
+	} else if (page->alloc != batch->alloc ||
+		   batch->count == BINDER_ALLOC_RECLAIM_BATCH) {
+		return LRU_SKIP;
+	}
+
+	if (!page->page_ptr)
+		return LRU_SKIP;
+
+	list_lru_isolate_move(lru, item, &batch->pages);
+	batch->count++;
+	return LRU_REMOVED;
+}
+
+/**
+ * binder_alloc_free_batch() - unmap and free a batch of isolated pages
+ * @batch: pages isolated by binder_alloc_isolate_page()
+ *
+ * Unlike binder_alloc_free_page(), mmap_sem is taken once for the batch
+ * and contiguous pages are zapped as one range.
+ *
+ * Return: number of pages freed
+ */
+static unsigned long
+binder_alloc_free_batch(struct binder_alloc_reclaim_batch *batch)
+{
+	struct binder_alloc *alloc = batch->alloc;
+	struct mm_struct *mm = alloc->vma_vm_mm;
+	struct binder_lru_page *page, *tmp;
+	struct vm_area_struct *vma;
+	size_t index, first = 0, nr = 0;
+	unsigned long freed = 0;
+
+	if (!batch->count)
+		goto out;
+	if (!mmget_not_zero(mm))
+		goto err_mmget;
+	if (!down_write_trylock(&mm->mmap_sem))
+		goto err_down_write_mmap_sem_failed;
+
+	vma = binder_alloc_get_vma(alloc);
+	list_for_each_entry(page, &batch->pages, lru) {
+		index = page - alloc->pages;
+		if (nr && index == first + nr) {
+			nr++;
+			continue;
+		}
+		if (nr && vma)
+			zap_page_range(vma, (uintptr_t)alloc->buffer +
+				       first * PAGE_SIZE, nr * PAGE_SIZE);
+		first = index;
+		nr = 1;
+	}
+	if (nr && vma)
+		zap_page_range(vma, (uintptr_t)alloc->buffer +
+			       first * PAGE_SIZE, nr * PAGE_SIZE);
+	up_write(&mm->mmap_sem);
+	mmput(mm);
+
+	list_for_each_entry_safe(page, tmp, &batch->pages, lru) {
+		index = page - alloc->pages;
+		trace_binder_unmap_kernel_start(alloc, index);
+
+		list_del_init(&page->lru);
+		__free_page(page->page_ptr);
+		page->page_ptr = NULL;
+		freed++;
+
+		trace_binder_unmap_kernel_end(alloc, index);
+	}
+	goto out;
+
+err_down_write_mmap_sem_failed:
+	mmput_async(mm);
+err_mmget:
+	list_for_each_entry_safe(page, tmp, &batch->pages, lru) {
+		list_del_init(&page->lru);
+		list_lru_add(&binder_alloc_lru, &page->lru);
+	}
+out:
+	mutex_unlock(&alloc->mutex);
+	return freed;
+}
+
 static unsigned long
 binder_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 {
@@ -1006,10 +1397,24 @@ binder_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 static unsigned long
 binder_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 {
-	unsigned long ret;
-
-	ret = list_lru_walk(&binder_alloc_lru, binder_alloc_free_page,
-			    NULL, sc->nr_to_scan);
+	struct binder_alloc_reclaim_batch batch;
+	unsigned long nr_to_scan = sc->nr_to_scan;
+	unsigned long nr, ret = 0;
+
+	while (nr_to_scan) {
+		nr = min_t(unsigned long, nr_to_scan,
+			   BINDER_ALLOC_RECLAIM_BATCH);
+		nr_to_scan -= nr;
+
+		batch.alloc = NULL;
+		INIT_LIST_HEAD(&batch.pages);
+		batch.count = 0;
+		list_lru_walk(&binder_alloc_lru, binder_alloc_isolate_page,
+			      &batch, nr);
+		if (!batch.alloc)
+			break;
+		ret += binder_alloc_free_batch(&batch);
+	}
 	return ret;
 }
 
@@ -1031,6 +1436,7 @@ void binder_alloc_init(struct binder_alloc *alloc)
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
 	INIT_LIST_HEAD(&alloc->buffers);
+	INIT_WORK(&alloc->prefetch_work, binder_alloc_prefetch_work_func);
 }
 
 int binder_alloc_shrinker_init(void)
@@ -22,6 +22,7 @@
 #include <linux/vmalloc.h>
 #include <linux/slab.h>
 #include <linux/list_lru.h>
+#include <linux/workqueue.h>
 #include <uapi/linux/android/binder.h>
 
 extern struct list_lru binder_alloc_lru;
@@ -74,6 +75,24 @@ struct binder_lru_page {
 	struct binder_alloc *alloc;
 };
 
+#define BINDER_ALLOC_CACHE_MIN_SHIFT	6	/* smallest class is 64 bytes */
+#define BINDER_ALLOC_CACHE_CLASSES	6	/* largest class is < 4K */
+#define BINDER_ALLOC_CACHE_DEPTH	4
+
+/**
+ * struct binder_buffer_cache - recently freed buffers of one size class
+ * @buffers: cached buffers of size [2^shift, 2^(shift + 1))
+ * @count:   number of valid entries in @buffers
+ *
+ * A cached buffer is neither free nor allocated: it is kept out of both
+ * rb trees and is not merged with its neighbours, so it can be handed out
+ * again without a best-fit search, split and merge.
+ */
+struct binder_buffer_cache {
+	struct binder_buffer *buffers[BINDER_ALLOC_CACHE_DEPTH];
+	int count;
+};
+
 /**
  * struct binder_alloc - per-binder proc state for binder allocator
  * @vma:                vm_area_struct passed to mmap_handler
@@ -92,6 +111,12 @@ struct binder_lru_page {
  * @buffer_size:        size of address space specified via mmap
  * @pid:                pid for associated binder_proc (invariant after init)
  * @pages_high:         high watermark of offset in @pages
+ * @cache:              per size class caches of recently freed buffers
+ * @cache_hits:         allocations served from @cache
+ * @cache_misses:       allocations served from @free_buffers
+ * @prefetch_work:      populates pages ahead of the next allocations
+ * @pages_inline:       pages allocated and mapped on the transaction path
+ * @pages_prefetched:   pages allocated and mapped by @prefetch_work
  *
  * Bookkeeping structure for per-proc address space management for binder
  * buffers. It is normally initialized during binder_init() and binder_mmap()
@@ -112,6 +137,12 @@ struct binder_alloc {
 	uint32_t buffer_free;
 	int pid;
 	size_t pages_high;
+	struct binder_buffer_cache cache[BINDER_ALLOC_CACHE_CLASSES];
+	size_t cache_hits;
+	size_t cache_misses;
+	struct work_struct prefetch_work;
+	size_t pages_inline;
+	size_t pages_prefetched;
 };
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_SELFTEST
@@ -135,6 +166,7 @@ binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 			     uintptr_t user_ptr);
 extern void binder_alloc_free_buf(struct binder_alloc *alloc,
 				  struct binder_buffer *buffer);
+extern void binder_alloc_cache_drain(struct binder_alloc *alloc);
 extern int binder_alloc_mmap_handler(struct binder_alloc *alloc,
 				     struct vm_area_struct *vma);
 extern void binder_alloc_deferred_release(struct binder_alloc *alloc);
@@ -19,10 +19,12 @@
 
 #include <linux/mm_types.h>
 #include <linux/err.h>
+#include <linux/ktime.h>
 #include "binder_alloc.h"
 
 #define BUFFER_NUM 5
 #define BUFFER_MIN_SIZE (PAGE_SIZE / 8)
+#define CACHE_LOOPS 1000
 
 static bool binder_selftest_run = true;
 static int binder_selftest_failures;
@@ -146,6 +148,7 @@ static void binder_selftest_free_buf(struct binder_alloc *alloc,
 
 	for (i = 0; i < BUFFER_NUM; i++)
 		binder_alloc_free_buf(alloc, buffers[seq[i]]);
+	binder_alloc_cache_drain(alloc);
 
 	for (i = 0; i < end / PAGE_SIZE; i++) {
 		/**
@@ -280,6 +283,78 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
 	}
 }
 
+/**
+ * binder_selftest_cache() - Test reuse of cached buffers.
+ * @alloc: Pointer to alloc struct.
+ *
+ * Allocate and free a buffer of one size repeatedly and check that the
+ * freed buffer is handed out again from the cache. Then time the same
+ * loop with the cache drained after every free, which takes the best-fit,
+ * split and merge path, and check that no fragment is left behind.
+ */
+static void binder_selftest_cache(struct binder_alloc *alloc)
+{
+	size_t size = BUFFER_MIN_SIZE;
+	int class = ilog2(size) - BINDER_ALLOC_CACHE_MIN_SHIFT;
+	struct binder_buffer *buffer, *cached;
+	u64 start, cached_ns, best_fit_ns;
+	size_t hits;
+	int i;
+
+	cached = binder_alloc_new_buf(alloc, size, 0, 0, 0);
+	if (IS_ERR(cached)) {
+		pr_err("cache: alloc size %zu failed\n", size);
+		binder_selftest_failures++;
+		return;
+	}
+	binder_alloc_free_buf(alloc, cached);
+	if (!alloc->cache[class].count) {
+		pr_info("cache: disabled, skipped\n");
+		binder_alloc_cache_drain(alloc);
+		return;
+	}
+
+	hits = alloc->cache_hits;
+	start = ktime_get_ns();
+	for (i = 0; i < CACHE_LOOPS; i++) {
+		buffer = binder_alloc_new_buf(alloc, size, 0, 0, 0);
+		if (IS_ERR(buffer))
+			break;
+		if (buffer != cached) {
+			pr_err("cache: expect %pK but got %pK\n",
+			       cached->user_data, buffer->user_data);
+			binder_selftest_failures++;
+		}
+		binder_alloc_free_buf(alloc, buffer);
+	}
+	cached_ns = ktime_get_ns() - start;
+	if (alloc->cache_hits - hits != CACHE_LOOPS) {
+		pr_err("cache: expect %d hits but got %zu\n",
+		       CACHE_LOOPS, alloc->cache_hits - hits);
+		binder_selftest_failures++;
+	}
+
+	binder_alloc_cache_drain(alloc);
+	start = ktime_get_ns();
+	for (i = 0; i < CACHE_LOOPS; i++) {
+		buffer = binder_alloc_new_buf(alloc, size, 0, 0, 0);
+		if (IS_ERR(buffer))
+			break;
+		binder_alloc_free_buf(alloc, buffer);
+		binder_alloc_cache_drain(alloc);
+	}
+	best_fit_ns = ktime_get_ns() - start;
+
+	if (!list_is_singular(&alloc->buffers)) {
+		pr_err("cache: address space is fragmented after drain\n");
+		binder_selftest_failures++;
+	}
+	pr_info("cache: %d allocs of %zu bytes, cached %llu ns, best-fit %llu ns\n",
+		CACHE_LOOPS, size, cached_ns, best_fit_ns);
+
+	binder_selftest_free_page(alloc);
+}
+
 /**
  * binder_selftest_alloc() - Test alloc and free of buffer pages.
  * @alloc: Pointer to alloc struct.
@@ -287,7 +362,8 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
  * Allocate BUFFER_NUM buffers to cover all page alignment cases,
  * then free them in all orders possible. Check that pages are
  * correctly allocated, put onto lru when buffers are freed, and
- * are freed when binder_alloc_free_page is called.
+ * are freed when binder_alloc_free_page is called. Then check reuse
+ * of buffers through the per size class buffer cache.
  */
 void binder_selftest_alloc(struct binder_alloc *alloc)
 {
@@ -300,6 +376,7 @@ void binder_selftest_alloc(struct binder_alloc *alloc)
 		goto done;
 	pr_info("STARTED\n");
 	binder_selftest_alloc_offset(alloc, end_offset, 0);
+	binder_selftest_cache(alloc);
 	binder_selftest_run = false;
 	if (binder_selftest_failures > 0)
 		pr_info("%d tests FAILED\n", binder_selftest_failures);
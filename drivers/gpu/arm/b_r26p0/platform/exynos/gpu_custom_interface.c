@@ -31,6 +31,9 @@
 #include "gpu_ipa.h"
 #endif /* CONFIG_CPU_THERMAL_IPA */
 #include "gpu_custom_interface.h"
+#ifdef CONFIG_MALI_IPA_POWER_MODEL
+#include "gpu_ipa_model.h"
+#endif /* CONFIG_MALI_IPA_POWER_MODEL */
 
 #ifdef CONFIG_MALI_RT_PM
 #include <soc/samsung/exynos-pd.h>
@@ -455,6 +458,118 @@ static ssize_t set_governor(struct device *dev, struct device_attribute *attr, c
 	return count;
 }
 
+static ssize_t show_dvfs_replay_trace(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	ssize_t ret = 0;
+	bool capture;
+	int nr;
+
+	nr = gpu_dvfs_replay_get_status(&capture);
+
+	ret += snprintf(buf+ret, PAGE_SIZE-ret, "samples %d/%d capture %s\n",
+			nr, GPU_DVFS_REPLAY_MAX_SAMPLES, capture ? "on" : "off");
+
+	return ret;
+}
+
+/*
+ * "start" and "stop" capture the live (clock, utilization) samples,
+ * "clear" drops the trace, anything else is parsed as whitespace separated
+ * "clock utilization" pairs and appended to the trace.
+ */
+static ssize_t set_dvfs_replay_trace(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct gpu_dvfs_replay_sample *samples;
+	unsigned int clock, utilization;
+	int nr = 0, max_nr, pos, ret;
+	struct exynos_context *platform = (struct exynos_context *)pkbdev->platform_context;
+
+	if (!platform)
+		return -ENODEV;
+
+	if (sysfs_streq("clear", buf)) {
+		gpu_dvfs_replay_clear(platform);
+		return count;
+	} else if (sysfs_streq("start", buf)) {
+		ret = gpu_dvfs_replay_capture(platform, true);
+		return ret ? ret : count;
+	} else if (sysfs_streq("stop", buf)) {
+		ret = gpu_dvfs_replay_capture(platform, false);
+		return ret ? ret : count;
+	}
+
+	/* each pair takes at least four characters: "c u " */
+	max_nr = count / 4 + 1;
+	samples = kmalloc_array(max_nr, sizeof(*samples), GFP_KERNEL);
+	if (!samples)
+		return -ENOMEM;
+
+	while (nr < max_nr && sscanf(buf, "%u %u%n", &clock, &utilization, &pos) == 2) {
+		if (gpu_dvfs_get_level(clock) < 0 || utilization > 100) {
+			GPU_LOG(DVFS_WARNING, DUMMY, 0u, 0u, "%s: invalid sample (%u %u)\n", __func__, clock, utilization);
+			ret = -EINVAL;
+			goto out;
+		}
+		samples[nr].clock = clock;
+		samples[nr].utilization = utilization;
+		nr++;
+		buf += pos;
+	}
+
+	ret = gpu_dvfs_replay_append(samples, nr);
+out:
+	kfree(samples);
+
+	return ret < 0 ? ret : count;
+}
+
+static ssize_t show_dvfs_replay(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	ssize_t ret = 0;
+	gpu_dvfs_governor_info *governor_info;
+	struct gpu_dvfs_replay_result result;
+	int i, level, err;
+	struct exynos_context *platform = (struct exynos_context *)pkbdev->platform_context;
+
+	if (!platform)
+		return -ENODEV;
+
+	governor_info = (gpu_dvfs_governor_info *)gpu_dvfs_get_governor_info();
+
+	result.table_size = platform->table_size;
+	result.time_in_state = kcalloc(result.table_size, sizeof(*result.time_in_state), GFP_KERNEL);
+	if (!result.time_in_state)
+		return -ENOMEM;
+
+	for (i = 0; i < G3D_MAX_GOVERNOR_NUM; i++) {
+		err = gpu_dvfs_governor_replay(platform, i, &result);
+		if (err) {
+			ret = err;
+			break;
+		}
+
+		ret += snprintf(buf+ret, PAGE_SIZE-ret, "[%s] samples %d missed %d energy %llu uJ\n",
+				governor_info[i].name, result.nr_samples, result.nr_missed, result.energy_uj);
+
+		for (level = gpu_dvfs_get_level(platform->gpu_min_clock); level >= gpu_dvfs_get_level(platform->gpu_max_clock); level--) {
+			if (!result.time_in_state[level])
+				continue;
+			ret += snprintf(buf+ret, PAGE_SIZE-ret, "  %d %llu\n",
+					platform->table[level].clock, result.time_in_state[level]);
+		}
+	}
+
+	kfree(result.time_in_state);
+
+	if (ret >= PAGE_SIZE - 1) {
+		buf[PAGE_SIZE-2] = '\n';
+		buf[PAGE_SIZE-1] = '\0';
+		ret = PAGE_SIZE-1;
+	}
+
+	return ret;
+}
+
 static ssize_t show_max_lock_status(struct device *dev, struct device_attribute *attr, char *buf)
 {
 	ssize_t ret = 0;
@@ -1093,6 +1208,46 @@ static ssize_t show_utilization_stats(struct device *dev, struct device_attribut
 #endif /* CONFIG_CPU_THERMAL_IPA */
 #endif /* CONFIG_MALI_DVFS */
 
+#ifdef CONFIG_MALI_IPA_POWER_MODEL
+static ssize_t show_ipa_model(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	ssize_t ret = 0;
+	struct gpu_ipa_model_stats stats;
+
+	gpu_ipa_model_get_stats(&stats);
+
+	ret += snprintf(buf+ret, PAGE_SIZE-ret, "valid %d samples %d err %d mW (%d%%) coeff %lld %lld %lld\n",
+			stats.valid, stats.nr_samples, stats.err_mw, stats.err_pct,
+			stats.coeff[0], stats.coeff[1], stats.coeff[2]);
+
+	return ret;
+}
+
+/*
+ * "reset" drops the fit and "<utilization> <clock> <temp> <power>" lines feed
+ * samples, e.g. a captured or synthetic trace.
+ */
+static ssize_t set_ipa_model(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	int utilization, clock, temp, power, pos;
+	int ret = -EINVAL;
+
+	if (sysfs_streq("reset", buf)) {
+		gpu_ipa_model_reset();
+		return count;
+	}
+
+	while (sscanf(buf, "%d %d %d %d%n", &utilization, &clock, &temp, &power, &pos) == 4) {
+		ret = gpu_ipa_model_add_sample(utilization, clock, temp, power);
+		if (ret)
+			break;
+		buf += pos;
+	}
+
+	return ret ? ret : count;
+}
+#endif /* CONFIG_MALI_IPA_POWER_MODEL */
+
 static ssize_t show_debug_level(struct device *dev, struct device_attribute *attr, char *buf)
 {
 	ssize_t ret = 0;
@@ -1444,6 +1599,8 @@ DEVICE_ATTR(perf, S_IRUGO, show_perf, NULL);
 #ifdef CONFIG_MALI_DVFS
 DEVICE_ATTR(dvfs, S_IRUGO|S_IWUSR, show_dvfs, set_dvfs);
 DEVICE_ATTR(dvfs_governor, S_IRUGO|S_IWUSR, show_governor, set_governor);
+DEVICE_ATTR(dvfs_replay_trace, S_IRUGO|S_IWUSR, show_dvfs_replay_trace, set_dvfs_replay_trace);
+DEVICE_ATTR(dvfs_replay, S_IRUGO, show_dvfs_replay, NULL);
 DEVICE_ATTR(dvfs_max_lock_status, S_IRUGO, show_max_lock_status, NULL);
 DEVICE_ATTR(dvfs_min_lock_status, S_IRUGO, show_min_lock_status, NULL);
 DEVICE_ATTR(dvfs_max_lock, S_IRUGO|S_IWUSR, show_max_lock_dvfs, set_max_lock_dvfs);
@@ -1459,6 +1616,9 @@ DEVICE_ATTR(tmu, S_IRUGO|S_IWUSR, show_tmu, set_tmu_control);
 DEVICE_ATTR(norm_utilization, S_IRUGO, show_norm_utilization, NULL);
 DEVICE_ATTR(utilization_stats, S_IRUGO, show_utilization_stats, NULL);
 #endif /* CONFIG_CPU_THERMAL_IPA */
+#ifdef CONFIG_MALI_IPA_POWER_MODEL
+DEVICE_ATTR(ipa_model, S_IRUGO|S_IWUSR, show_ipa_model, set_ipa_model);
+#endif /* CONFIG_MALI_IPA_POWER_MODEL */
 #endif /* CONFIG_MALI_DVFS */
 DEVICE_ATTR(debug_level, S_IRUGO|S_IWUSR, show_debug_level, set_debug_level);
 #ifdef CONFIG_MALI_EXYNOS_TRACE
@@ -2027,6 +2187,16 @@ int gpu_create_sysfs_file(struct device *dev)
 		goto out;
 	}
 
+	if (device_create_file(dev, &dev_attr_dvfs_replay_trace)) {
+		GPU_LOG(DVFS_ERROR, DUMMY, 0u, 0u, "couldn't create sysfs file [dvfs_replay_trace]\n");
+		goto out;
+	}
+
+	if (device_create_file(dev, &dev_attr_dvfs_replay)) {
+		GPU_LOG(DVFS_ERROR, DUMMY, 0u, 0u, "couldn't create sysfs file [dvfs_replay]\n");
+		goto out;
+	}
+
 	if (device_create_file(dev, &dev_attr_dvfs_max_lock_status)) {
 		GPU_LOG(DVFS_ERROR, DUMMY, 0u, 0u, "couldn't create sysfs file [dvfs_max_lock_status]\n");
 		goto out;
@@ -2092,6 +2262,12 @@ int gpu_create_sysfs_file(struct device *dev)
 		goto out;
 	}
 #endif /* CONFIG_CPU_THERMAL_IPA */
+#ifdef CONFIG_MALI_IPA_POWER_MODEL
+	if (device_create_file(dev, &dev_attr_ipa_model)) {
+		GPU_LOG(DVFS_ERROR, DUMMY, 0u, 0u, "couldn't create sysfs file [ipa_model]\n");
+		goto out;
+	}
+#endif /* CONFIG_MALI_IPA_POWER_MODEL */
 #endif /* CONFIG_MALI_DVFS */
 	if (device_create_file(dev, &dev_attr_debug_level)) {
 		GPU_LOG(DVFS_ERROR, DUMMY, 0u, 0u, "couldn't create sysfs file [debug_level]\n");
@@ -2181,6 +2357,10 @@ void gpu_remove_sysfs_file(struct device *dev)
 #ifdef CONFIG_MALI_DVFS
 	device_remove_file(dev, &dev_attr_dvfs);
 	device_remove_file(dev, &dev_attr_dvfs_governor);
+	device_remove_file(dev, &dev_attr_dvfs_replay_trace);
+	device_remove_file(dev, &dev_attr_dvfs_replay);
+	if (pkbdev->platform_context)
+		gpu_dvfs_replay_clear((struct exynos_context *)pkbdev->platform_context);
 	device_remove_file(dev, &dev_attr_dvfs_max_lock_status);
 	device_remove_file(dev, &dev_attr_dvfs_min_lock_status);
 	device_remove_file(dev, &dev_attr_dvfs_max_lock);
@@ -2196,6 +2376,9 @@ void gpu_remove_sysfs_file(struct device *dev)
 	device_remove_file(dev, &dev_attr_norm_utilization);
 	device_remove_file(dev, &dev_attr_utilization_stats);
 #endif /* CONFIG_CPU_THERMAL_IPA */
+#ifdef CONFIG_MALI_IPA_POWER_MODEL
+	device_remove_file(dev, &dev_attr_ipa_model);
+#endif /* CONFIG_MALI_IPA_POWER_MODEL */
 #endif /* CONFIG_MALI_DVFS */
 	device_remove_file(dev, &dev_attr_debug_level);
 #ifdef CONFIG_MALI_EXYNOS_TRACE
@@ -16,6 +16,9 @@
  */
 
 #include <mali_kbase.h>
+#ifdef CONFIG_MALI_DEBUG_SYS
+#include <linux/vmalloc.h>
+#endif /* CONFIG_MALI_DEBUG_SYS */
 
 #include "mali_kbase_platform.h"
 #include "gpu_dvfs_handler.h"
@@ -34,6 +37,19 @@ static int gpu_dvfs_governor_static(struct exynos_context *platform, int utiliza
 static int gpu_dvfs_governor_booster(struct exynos_context *platform, int utilization);
 static int gpu_dvfs_governor_dynamic(struct exynos_context *platform, int utilization);
 
+/* Governor state that is not part of exynos_context. It is reached through a
+ * pointer so that a replay can run the governors on a scratch copy of it. */
+struct gpu_dvfs_governor_state {
+	bool static_step_down;
+	int static_count;
+	int booster_weight;
+};
+
+#define GPU_DVFS_GOVERNOR_STATE_INIT { .static_step_down = true, }
+
+static struct gpu_dvfs_governor_state live_governor_state = GPU_DVFS_GOVERNOR_STATE_INIT;
+static struct gpu_dvfs_governor_state *governor_state = &live_governor_state;
+
 static gpu_dvfs_governor_info governor_info[G3D_MAX_GOVERNOR_NUM] = {
 	{
 		G3D_DVFS_GOVERNOR_DEFAULT,
@@ -158,29 +174,29 @@ static int gpu_dvfs_governor_interactive(struct exynos_context *platform, int ut
 #define G3D_GOVERNOR_STATIC_PERIOD		10
 static int gpu_dvfs_governor_static(struct exynos_context *platform, int utilization)
 {
-	static bool step_down = true;
-	static int count;
+	bool *step_down = &governor_state->static_step_down;
+	int *count = &governor_state->static_count;
 
 	DVFS_ASSERT(platform);
 
-	if (count == G3D_GOVERNOR_STATIC_PERIOD) {
-		if (step_down) {
+	if (*count == G3D_GOVERNOR_STATIC_PERIOD) {
+		if (*step_down) {
 			if (platform->step > gpu_dvfs_get_level(platform->gpu_max_clock))
 				platform->step--;
 			if (((platform->max_lock > 0) && (platform->table[platform->step].clock == platform->max_lock))
 					|| (platform->step == gpu_dvfs_get_level(platform->gpu_max_clock)))
-				step_down = false;
+				*step_down = false;
 		} else {
 			if (platform->step < gpu_dvfs_get_level(platform->gpu_min_clock))
 				platform->step++;
 			if (((platform->min_lock > 0) && (platform->table[platform->step].clock == platform->min_lock))
 					|| (platform->step == gpu_dvfs_get_level(platform->gpu_min_clock)))
-				step_down = true;
+				*step_down = true;
 		}
 
-		count = 0;
+		*count = 0;
 	} else {
-		count++;
+		(*count)++;
 	}
 
 	return 0;
@@ -188,7 +204,7 @@ static int gpu_dvfs_governor_static(struct exynos_context *platform, int utiliza
 
 static int gpu_dvfs_governor_booster(struct exynos_context *platform, int utilization)
 {
-	static int weight;
+	int *weight = &governor_state->booster_weight;
 	int cur_weight, booster_threshold, dvfs_table_lock;
 
 	DVFS_ASSERT(platform);
@@ -200,7 +216,7 @@ static int gpu_dvfs_governor_booster(struct exynos_context *platform, int utiliz
 	dvfs_table_lock = gpu_dvfs_get_level(platform->gpu_max_clock);
 
 	if ((platform->step >= dvfs_table_lock+2) &&
-			((cur_weight - weight) > booster_threshold)) {
+			((cur_weight - *weight) > booster_threshold)) {
 		platform->step -= 2;
 		platform->down_requirement = platform->table[platform->step].down_staycount;
 		GPU_LOG(DVFS_WARNING, DUMMY, 0u, 0u, "Booster Governor: G3D level 2 step\n");
@@ -222,7 +238,7 @@ static int gpu_dvfs_governor_booster(struct exynos_context *platform, int utiliz
 	DVFS_ASSERT((platform->step >= gpu_dvfs_get_level(platform->gpu_max_clock))
 					&& (platform->step <= gpu_dvfs_get_level(platform->gpu_min_clock)));
 
-	weight = cur_weight;
+	*weight = cur_weight;
 
 	return 0;
 }
@@ -275,6 +291,216 @@ static int gpu_dvfs_governor_dynamic(struct exynos_context *platform, int utiliz
 	return 0;
 }
 
+#ifdef CONFIG_MALI_DEBUG_SYS
+/*
+ * Governor replay
+ *
+ * A trace is a list of (clock, utilization) samples, one per DVFS polling
+ * period, either captured from gpu_dvfs_decide_next_freq() or written from
+ * userspace. Replaying it runs a governor on a scratch copy of the platform
+ * context: the work of each sample (clock * utilization) is served at the
+ * clock the governor picked, a period whose work does not fit is counted as a
+ * missed deadline and its excess is carried into the next period, and the
+ * energy of each period is estimated with the IPA power model of the level
+ * (ipa_power_coeff_gpu * f * V^2) scaled by the busy ratio.
+ */
+static DEFINE_MUTEX(replay_lock);
+static struct gpu_dvfs_replay_sample *replay_trace;
+static int replay_nr_samples;
+static bool replay_capture;
+
+static int gpu_dvfs_replay_alloc(void)
+{
+	if (replay_trace)
+		return 0;
+
+	replay_trace = vmalloc(sizeof(*replay_trace) * GPU_DVFS_REPLAY_MAX_SAMPLES);
+	if (!replay_trace)
+		return -ENOMEM;
+
+	replay_nr_samples = 0;
+
+	return 0;
+}
+
+int gpu_dvfs_replay_append(const struct gpu_dvfs_replay_sample *samples, int nr)
+{
+	int ret;
+
+	if (nr < 0)
+		return -EINVAL;
+
+	mutex_lock(&replay_lock);
+	if (replay_capture) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	ret = gpu_dvfs_replay_alloc();
+	if (ret)
+		goto out;
+
+	nr = min(nr, GPU_DVFS_REPLAY_MAX_SAMPLES - replay_nr_samples);
+	memcpy(&replay_trace[replay_nr_samples], samples, sizeof(*samples) * nr);
+	replay_nr_samples += nr;
+	ret = nr;
+out:
+	mutex_unlock(&replay_lock);
+
+	return ret;
+}
+
+int gpu_dvfs_replay_capture(struct exynos_context *platform, bool enable)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	mutex_lock(&replay_lock);
+	if (enable) {
+		ret = gpu_dvfs_replay_alloc();
+		if (ret)
+			goto out;
+	}
+
+	spin_lock_irqsave(&platform->gpu_dvfs_spinlock, flags);
+	replay_capture = enable;
+	spin_unlock_irqrestore(&platform->gpu_dvfs_spinlock, flags);
+out:
+	mutex_unlock(&replay_lock);
+
+	return ret;
+}
+
+void gpu_dvfs_replay_clear(struct exynos_context *platform)
+{
+	unsigned long flags;
+	struct gpu_dvfs_replay_sample *trace;
+
+	mutex_lock(&replay_lock);
+	spin_lock_irqsave(&platform->gpu_dvfs_spinlock, flags);
+	replay_capture = false;
+	trace = replay_trace;
+	replay_trace = NULL;
+	replay_nr_samples = 0;
+	spin_unlock_irqrestore(&platform->gpu_dvfs_spinlock, flags);
+	mutex_unlock(&replay_lock);
+
+	vfree(trace);
+}
+
+int gpu_dvfs_replay_get_status(bool *capture)
+{
+	int nr;
+
+	mutex_lock(&replay_lock);
+	nr = replay_nr_samples;
+	*capture = replay_capture;
+	mutex_unlock(&replay_lock);
+
+	return nr;
+}
+
+static u64 gpu_dvfs_replay_power(struct exynos_context *platform, int level)
+{
+	unsigned int vol = platform->table[level].voltage / 10000;
+
+	/* same units as kbase_platform_dvfs_freq_to_power() */
+	return div_u64((u64)platform->ipa_power_coeff_gpu * platform->table[level].clock * vol * vol, 1000000);
+}
+
+int gpu_dvfs_governor_replay(struct exynos_context *platform, int governor_type,
+		struct gpu_dvfs_replay_result *result)
+{
+	struct gpu_dvfs_governor_state state = GPU_DVFS_GOVERNOR_STATE_INIT;
+	struct gpu_dvfs_governor_state *saved_state;
+	struct exynos_context *sim;
+	GET_NEXT_LEVEL next_level;
+	unsigned long flags;
+	u64 backlog = 0;
+	int period_ms;
+	int i, ret = 0;
+
+	DVFS_ASSERT(platform);
+
+	if ((governor_type < 0) || (governor_type >= G3D_MAX_GOVERNOR_NUM))
+		return -EINVAL;
+
+	if (!result->time_in_state || result->table_size < platform->table_size)
+		return -EINVAL;
+
+	sim = kmalloc(sizeof(*sim), GFP_KERNEL);
+	if (!sim)
+		return -ENOMEM;
+
+	mutex_lock(&replay_lock);
+	if (replay_capture) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (!replay_nr_samples) {
+		ret = -ENODATA;
+		goto out;
+	}
+
+	spin_lock_irqsave(&platform->gpu_dvfs_spinlock, flags);
+	memcpy(sim, platform, sizeof(*sim));
+	spin_unlock_irqrestore(&platform->gpu_dvfs_spinlock, flags);
+
+	/* level lookups go through the live table, so the scratch copy keeps it */
+	sim->step = gpu_dvfs_get_level(governor_info[governor_type].start_clk);
+	if (sim->step < 0)
+		sim->step = gpu_dvfs_get_level(platform->gpu_max_clock);
+	sim->down_requirement = 1;
+	sim->interactive.delay_count = 0;
+	sim->cur_clock = sim->table[sim->step].clock;
+	next_level = (GET_NEXT_LEVEL)(governor_info[governor_type].governor);
+	period_ms = max(platform->polling_speed, 1);
+
+	memset(result->time_in_state, 0, sizeof(*result->time_in_state) * result->table_size);
+	result->nr_samples = replay_nr_samples;
+	result->nr_missed = 0;
+	result->energy_uj = 0;
+
+	for (i = 0; i < replay_nr_samples; i++) {
+		u64 demand = (u64)replay_trace[i].clock * replay_trace[i].utilization + backlog;
+		u64 capacity = (u64)sim->cur_clock * 100;
+		int utilization;
+
+		if (demand > capacity) {
+			result->nr_missed++;
+			/* carry at most one period of excess so a long overload does not snowball */
+			backlog = min(demand - capacity, capacity);
+			demand = capacity;
+		} else {
+			backlog = 0;
+		}
+
+		utilization = sim->cur_clock ? (int)div_u64(demand, sim->cur_clock) : 0;
+
+		result->time_in_state[sim->step] += period_ms;
+		result->energy_uj += div_u64(gpu_dvfs_replay_power(sim, sim->step) * utilization * period_ms, 100);
+
+		sim->env_data.utilization = utilization;
+
+		spin_lock_irqsave(&platform->gpu_dvfs_spinlock, flags);
+		saved_state = governor_state;
+		governor_state = &state;
+		next_level(sim, utilization);
+		governor_state = saved_state;
+		spin_unlock_irqrestore(&platform->gpu_dvfs_spinlock, flags);
+
+		sim->cur_clock = sim->table[sim->step].clock;
+	}
+
+out:
+	mutex_unlock(&replay_lock);
+	kfree(sim);
+
+	return ret;
+}
+#endif /* CONFIG_MALI_DEBUG_SYS */
+
 static int gpu_dvfs_decide_next_governor(struct exynos_context *platform)
 {
 	return 0;
@@ -288,6 +514,13 @@ int gpu_dvfs_decide_next_freq(struct kbase_device *kbdev, int utilization)
 	DVFS_ASSERT(platform);
 
 	spin_lock_irqsave(&platform->gpu_dvfs_spinlock, flags);
+#ifdef CONFIG_MALI_DEBUG_SYS
+	if (replay_capture && replay_nr_samples < GPU_DVFS_REPLAY_MAX_SAMPLES) {
+		replay_trace[replay_nr_samples].clock = platform->cur_clock;
+		replay_trace[replay_nr_samples].utilization = utilization;
+		replay_nr_samples++;
+	}
+#endif /* CONFIG_MALI_DEBUG_SYS */
 	gpu_dvfs_decide_next_governor(platform);
 	gpu_dvfs_get_next_level(platform, utilization);
 	spin_unlock_irqrestore(&platform->gpu_dvfs_spinlock, flags);
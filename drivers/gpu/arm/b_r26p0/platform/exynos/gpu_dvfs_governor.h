@@ -35,4 +35,29 @@ int gpu_dvfs_decide_next_freq(struct kbase_device *kbdev, int utilization);
 int gpu_dvfs_governor_setting(struct exynos_context *platform, int governor_type);
 int gpu_dvfs_governor_init(struct kbase_device *kbdev);
 
+#ifdef CONFIG_MALI_DEBUG_SYS
+#define GPU_DVFS_REPLAY_MAX_SAMPLES	8192
+
+struct gpu_dvfs_replay_sample {
+	unsigned int clock;
+	unsigned int utilization;
+};
+
+struct gpu_dvfs_replay_result {
+	int nr_samples;
+	int nr_missed;
+	u64 energy_uj;
+	/* replayed time in ms per DVFS level, indexed like platform->table */
+	u64 *time_in_state;
+	int table_size;
+};
+
+int gpu_dvfs_replay_append(const struct gpu_dvfs_replay_sample *samples, int nr);
+int gpu_dvfs_replay_capture(struct exynos_context *platform, bool enable);
+void gpu_dvfs_replay_clear(struct exynos_context *platform);
+int gpu_dvfs_replay_get_status(bool *capture);
+int gpu_dvfs_governor_replay(struct exynos_context *platform, int governor_type,
+		struct gpu_dvfs_replay_result *result);
+#endif /* CONFIG_MALI_DEBUG_SYS */
+
 #endif /* _GPU_DVFS_GOVERNOR_H_ */
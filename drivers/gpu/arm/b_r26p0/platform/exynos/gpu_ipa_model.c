@@ -0,0 +1,240 @@
+/* drivers/gpu/arm/.../platform/gpu_ipa_model.c
+ *
+ * Copyright 2011 by S.LSI. Samsung Electronics Inc.
+ * San#24, Nongseo-Dong, Giheung-Gu, Yongin, Korea
+ *
+ * Samsung SoC Mali-T Series DVFS driver
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software FoundatIon.
+ */
+
+/**
+ * @file gpu_ipa_model.c
+ * Offline GPU power model for evaluating the thermal power allocator inputs
+ *
+ * P = c_dyn * u * f * V^2 + V * (l_0 + l_1 * T)
+ *
+ * The three coefficients are fitted by exponentially weighted least squares
+ * over (utilization, clock, voltage, temperature, power) samples written
+ * through sysfs, e.g. a captured or synthetic trace, and the model error can
+ * then be read back. There is no power meter on this platform, so the fit is
+ * never used by the GPU cooling device.
+ */
+
+#include <mali_kbase.h>
+
+#include "mali_kbase_platform.h"
+#include "gpu_dvfs_handler.h"
+#include "gpu_ipa_model.h"
+
+extern struct kbase_device *pkbdev;
+
+/* features are scaled to [0, GPU_IPA_MODEL_ONE] */
+#define GPU_IPA_MODEL_ONE		1024
+/* coefficients are kept in Q16 */
+#define GPU_IPA_MODEL_COEFF_SHIFT	16
+/* weight of a new sample is 1 / 2^GPU_IPA_MODEL_DECAY_SHIFT */
+#define GPU_IPA_MODEL_DECAY_SHIFT	6
+#define GPU_IPA_MODEL_MIN_SAMPLES	32
+#define GPU_IPA_MODEL_TEMP_MAX		127
+
+struct gpu_ipa_model {
+	spinlock_t lock;
+	/* weighted means of x * x^T and x * power */
+	s64 xx[GPU_IPA_MODEL_NR_TERMS][GPU_IPA_MODEL_NR_TERMS];
+	s64 xy[GPU_IPA_MODEL_NR_TERMS];
+	s64 coeff[GPU_IPA_MODEL_NR_TERMS];
+	bool valid;
+	int nr_samples;
+	/* weighted means of the a-priori prediction error */
+	int err_mw;
+	int err_pct;
+};
+
+static struct gpu_ipa_model ipa_model = {
+	.lock = __SPIN_LOCK_UNLOCKED(ipa_model.lock),
+};
+
+static int gpu_ipa_model_features(struct exynos_context *platform, int utilization, int clock,
+		int temp, s64 *x)
+{
+	int max_level = gpu_dvfs_get_level(platform->gpu_max_clock);
+	int voltage = gpu_dvfs_get_voltage(clock);
+	u64 max_vol, vol, dyn;
+
+	if (max_level < 0 || clock <= 0 || voltage <= 0)
+		return -EINVAL;
+
+	/* mV keeps clock * V^2 within 64 bits */
+	vol = voltage / 1000;
+	max_vol = platform->table[max_level].voltage / 1000;
+	if (!max_vol)
+		return -EINVAL;
+
+	utilization = clamp(utilization, 0, 100);
+	temp = clamp(temp, 0, GPU_IPA_MODEL_TEMP_MAX);
+
+	dyn = (u64)utilization * GPU_IPA_MODEL_ONE * clock * vol * vol;
+	x[0] = div64_u64(dyn, 100ULL * platform->gpu_max_clock * max_vol * max_vol);
+	x[1] = div64_u64(vol * GPU_IPA_MODEL_ONE, max_vol);
+	x[2] = div_s64(x[1] * temp, GPU_IPA_MODEL_TEMP_MAX + 1);
+
+	return 0;
+}
+
+/*
+ * Solves xx * coeff = xy by Gaussian elimination with partial pivoting.
+ * Means of products of features stay below 2^20 and the right hand side is
+ * scaled to Q16, so every intermediate product fits in 64 bits.
+ */
+static int gpu_ipa_model_solve(struct gpu_ipa_model *model, s64 *coeff)
+{
+	s64 a[GPU_IPA_MODEL_NR_TERMS][GPU_IPA_MODEL_NR_TERMS];
+	s64 b[GPU_IPA_MODEL_NR_TERMS];
+	int i, j, k;
+
+	for (i = 0; i < GPU_IPA_MODEL_NR_TERMS; i++) {
+		for (j = 0; j < GPU_IPA_MODEL_NR_TERMS; j++)
+			a[i][j] = model->xx[i][j];
+		b[i] = model->xy[i] << GPU_IPA_MODEL_COEFF_SHIFT;
+	}
+
+	for (k = 0; k < GPU_IPA_MODEL_NR_TERMS; k++) {
+		int pivot = k;
+
+		for (i = k + 1; i < GPU_IPA_MODEL_NR_TERMS; i++)
+			if (abs(a[i][k]) > abs(a[pivot][k]))
+				pivot = i;
+
+		/* the samples do not span this term (e.g. constant temperature) */
+		if (abs(a[pivot][k]) < GPU_IPA_MODEL_ONE)
+			return -EDOM;
+
+		if (pivot != k) {
+			for (j = 0; j < GPU_IPA_MODEL_NR_TERMS; j++)
+				swap(a[k][j], a[pivot][j]);
+			swap(b[k], b[pivot]);
+		}
+
+		for (i = k + 1; i < GPU_IPA_MODEL_NR_TERMS; i++) {
+			for (j = k + 1; j < GPU_IPA_MODEL_NR_TERMS; j++)
+				a[i][j] -= div64_s64(a[i][k] * a[k][j], a[k][k]);
+			b[i] -= div64_s64(a[i][k] * b[k], a[k][k]);
+			a[i][k] = 0;
+		}
+	}
+
+	for (k = GPU_IPA_MODEL_NR_TERMS - 1; k >= 0; k--) {
+		s64 sum = b[k];
+
+		for (j = k + 1; j < GPU_IPA_MODEL_NR_TERMS; j++)
+			sum -= a[k][j] * coeff[j];
+		coeff[k] = div64_s64(sum, a[k][k]);
+	}
+
+	/* a negative capacitance or leakage is a bad fit, not physics */
+	for (k = 0; k < GPU_IPA_MODEL_NR_TERMS; k++)
+		if (coeff[k] < 0)
+			return -EDOM;
+
+	return 0;
+}
+
+static void gpu_ipa_model_predict(struct gpu_ipa_model *model, const s64 *x,
+		u32 *dynamic_power, u32 *static_power)
+{
+	*dynamic_power = (u32)((model->coeff[0] * x[0]) >> GPU_IPA_MODEL_COEFF_SHIFT);
+	*static_power = (u32)((model->coeff[1] * x[1] + model->coeff[2] * x[2]) >> GPU_IPA_MODEL_COEFF_SHIFT);
+}
+
+static void gpu_ipa_model_update(struct gpu_ipa_model *model, const s64 *x, int power)
+{
+	s64 coeff[GPU_IPA_MODEL_NR_TERMS];
+	int shift = GPU_IPA_MODEL_DECAY_SHIFT;
+	int i, j;
+
+	if (model->valid && power > 0) {
+		u32 dynamic_power, static_power;
+		int err;
+
+		gpu_ipa_model_predict(model, x, &dynamic_power, &static_power);
+		err = abs((int)(dynamic_power + static_power) - power);
+		model->err_mw += (err - model->err_mw) >> 3;
+		model->err_pct += (err * 100 / power - model->err_pct) >> 3;
+	}
+
+	/* plain average until the window is filled */
+	if (model->nr_samples < (1 << GPU_IPA_MODEL_DECAY_SHIFT))
+		shift = ilog2(model->nr_samples + 1);
+	model->nr_samples++;
+
+	for (i = 0; i < GPU_IPA_MODEL_NR_TERMS; i++) {
+		for (j = 0; j < GPU_IPA_MODEL_NR_TERMS; j++)
+			model->xx[i][j] += (x[i] * x[j] - model->xx[i][j]) >> shift;
+		model->xy[i] += (x[i] * power - model->xy[i]) >> shift;
+	}
+
+	if (model->nr_samples < GPU_IPA_MODEL_MIN_SAMPLES)
+		return;
+
+	if (!gpu_ipa_model_solve(model, coeff)) {
+		memcpy(model->coeff, coeff, sizeof(coeff));
+		model->valid = true;
+	}
+}
+
+int gpu_ipa_model_add_sample(int utilization, int clock, int temp, int power)
+{
+	struct exynos_context *platform = (struct exynos_context *)pkbdev->platform_context;
+	s64 x[GPU_IPA_MODEL_NR_TERMS];
+	unsigned long flags;
+	int ret;
+
+	if (!platform)
+		return -ENODEV;
+
+	if (power < 0)
+		return -EINVAL;
+
+	ret = gpu_ipa_model_features(platform, utilization, clock, temp, x);
+	if (ret)
+		return ret;
+
+	spin_lock_irqsave(&ipa_model.lock, flags);
+	gpu_ipa_model_update(&ipa_model, x, power);
+	spin_unlock_irqrestore(&ipa_model.lock, flags);
+
+	return 0;
+}
+
+void gpu_ipa_model_reset(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ipa_model.lock, flags);
+	memset(ipa_model.xx, 0, sizeof(ipa_model.xx));
+	memset(ipa_model.xy, 0, sizeof(ipa_model.xy));
+	memset(ipa_model.coeff, 0, sizeof(ipa_model.coeff));
+	ipa_model.valid = false;
+	ipa_model.nr_samples = 0;
+	ipa_model.err_mw = 0;
+	ipa_model.err_pct = 0;
+	spin_unlock_irqrestore(&ipa_model.lock, flags);
+}
+
+void gpu_ipa_model_get_stats(struct gpu_ipa_model_stats *stats)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&ipa_model.lock, flags);
+	stats->valid = ipa_model.valid;
+	stats->nr_samples = ipa_model.nr_samples;
+	stats->err_mw = ipa_model.err_mw;
+	stats->err_pct = ipa_model.err_pct;
+	for (i = 0; i < GPU_IPA_MODEL_NR_TERMS; i++)
+		stats->coeff[i] = ipa_model.coeff[i];
+	spin_unlock_irqrestore(&ipa_model.lock, flags);
+}
@@ -0,0 +1,37 @@
+/* drivers/gpu/arm/.../platform/gpu_ipa_model.h
+ *
+ * Copyright 2011 by S.LSI. Samsung Electronics Inc.
+ * San#24, Nongseo-Dong, Giheung-Gu, Yongin, Korea
+ *
+ * Samsung SoC Mali-T Series DVFS driver
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software FoundatIon.
+ */
+
+/**
+ * @file gpu_ipa_model.h
+ * Offline GPU power model for evaluating the thermal power allocator inputs
+ */
+
+#ifndef _GPU_IPA_MODEL_H_
+#define _GPU_IPA_MODEL_H_
+
+/* dynamic (u * f * V^2), leakage (V) and thermal leakage (V * T) terms */
+#define GPU_IPA_MODEL_NR_TERMS	3
+
+struct gpu_ipa_model_stats {
+	bool valid;
+	int nr_samples;
+	int err_mw;
+	int err_pct;
+	/* Q16, per unit of the normalised terms */
+	s64 coeff[GPU_IPA_MODEL_NR_TERMS];
+};
+
+int gpu_ipa_model_add_sample(int utilization, int clock, int temp, int power);
+void gpu_ipa_model_reset(void);
+void gpu_ipa_model_get_stats(struct gpu_ipa_model_stats *stats);
+
+#endif /* _GPU_IPA_MODEL_H_ */
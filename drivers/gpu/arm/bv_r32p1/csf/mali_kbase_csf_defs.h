@@ -499,6 +499,10 @@ struct kbase_queue_group {
  *                      just-in-time memory allocation command which will be
  *                      reattempted after the impending free of other active
  *                      allocations.
+ * @inline_budget:      The maximum number of commands executed directly from
+ *                      an enqueue call across the queues it unblocks. Zero
+ *                      only executes the enqueuing queue, without a limit,
+ *                      and leaves other queues to their work items.
  */
 struct kbase_csf_kcpu_queue_context {
 	struct mutex lock;
@@ -509,6 +513,7 @@ struct kbase_csf_kcpu_queue_context {
 
 	struct list_head jit_cmds_head;
 	struct list_head jit_blocked_queues;
+	u32 inline_budget;
 };
 
 /**
@@ -566,12 +571,17 @@ struct kbase_csf_heap_context_allocator {
  * @ctx_alloc:   Allocator for heap context structures.
  * @nr_of_heaps: Total number of tiler heaps that were added during the
  *               life time of the context.
+ * @pool_work:   Work item refilling the chunk pools of the tiler heaps.
+ * @pool_enabled: Whether out-of-memory events are served from, and the
+ *                background work refills, the chunk pools.
  */
 struct kbase_csf_tiler_heap_context {
 	struct mutex lock;
 	struct list_head list;
 	struct kbase_csf_heap_context_allocator ctx_alloc;
 	u64 nr_of_heaps;
+	struct work_struct pool_work;
+	bool pool_enabled;
 };
 
 /**
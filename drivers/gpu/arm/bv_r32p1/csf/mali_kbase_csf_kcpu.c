@@ -33,8 +33,20 @@
 static DEFINE_SPINLOCK(kbase_csf_fence_lock);
 #endif
 
+/**
+ * struct kcpu_inline_budget - Work allowed to an enqueue call
+ *
+ * @cmds_left: Number of commands that may still be executed.
+ * @signalled: Set when an executed command may have unblocked a wait in
+ *             another queue of the same context.
+ */
+struct kcpu_inline_budget {
+	u32 cmds_left;
+	bool signalled;
+};
+
 static void kcpu_queue_process(struct kbase_kcpu_command_queue *kcpu_queue,
-			bool ignore_waits);
+			bool ignore_waits, struct kcpu_inline_budget *budget);
 
 static void kcpu_queue_process_worker(struct work_struct *data);
 
@@ -1422,7 +1434,7 @@ static void kcpu_queue_process_worker(struct work_struct *data)
 
 	mutex_lock(&queue->kctx->csf.kcpu_queues.lock);
 
-	kcpu_queue_process(queue, false);
+	kcpu_queue_process(queue, false, NULL);
 
 	mutex_unlock(&queue->kctx->csf.kcpu_queues.lock);
 }
@@ -1443,7 +1455,7 @@ static int delete_queue(struct kbase_context *kctx, u32 id)
 		/* Drain the remaining work for this queue first and go past
 		 * all the waits.
 		 */
-		kcpu_queue_process(queue, true);
+		kcpu_queue_process(queue, true, NULL);
 
 		/* All commands should have been processed */
 		WARN_ON(queue->num_pending_cmds);
@@ -1524,8 +1536,17 @@ static void KBASE_TLSTREAM_TL_KBASE_KCPUQUEUE_EXECUTE_JIT_FREE_END(
 		kbdev, queue);
 }
 
+/**
+ * kcpu_queue_process - Execute the pending commands of a KCPU queue
+ *
+ * @queue:        The queue to process.
+ * @ignore_waits: Go past all the waits, used when the queue is deleted.
+ * @budget:       Work allowed to the calling enqueue, or NULL when called
+ *                from the queue's work item or on deletion. Once it is used
+ *                up, the remaining commands are left to the work item.
+ */
 static void kcpu_queue_process(struct kbase_kcpu_command_queue *queue,
-			bool ignore_waits)
+			bool ignore_waits, struct kcpu_inline_budget *budget)
 {
 	struct kbase_device *kbdev = queue->kctx->kbdev;
 	bool process_next = true;
@@ -1538,6 +1559,15 @@ static void kcpu_queue_process(struct kbase_kcpu_command_queue *queue,
 			&queue->commands[(u8)(queue->start_offset + i)];
 		int status;
 
+		if (budget) {
+			if (!budget->cmds_left) {
+				queue_work(queue->kctx->csf.kcpu_queues.wq,
+					&queue->work);
+				break;
+			}
+			budget->cmds_left--;
+		}
+
 		switch (cmd->type) {
 		case BASE_KCPU_COMMAND_TYPE_FENCE_WAIT:
 			if (!queue->command_started) {
@@ -1596,6 +1626,9 @@ static void kcpu_queue_process(struct kbase_kcpu_command_queue *queue,
 
 			KBASE_TLSTREAM_TL_KBASE_KCPUQUEUE_EXECUTE_FENCE_SIGNAL_END(
 				kbdev, queue, status);
+
+			if (budget)
+				budget->signalled = true;
 			break;
 		case BASE_KCPU_COMMAND_TYPE_CQS_WAIT:
 			status = kbase_kcpu_cqs_wait_process(kbdev, queue,
@@ -1618,6 +1651,8 @@ static void kcpu_queue_process(struct kbase_kcpu_command_queue *queue,
 			kbase_kcpu_cqs_set_process(kbdev, queue,
 				&cmd->info.cqs_set);
 
+			if (budget)
+				budget->signalled = true;
 			break;
 		case BASE_KCPU_COMMAND_TYPE_CQS_WAIT_OPERATION:
 			status = kbase_kcpu_cqs_wait_operation_process(kbdev, queue,
@@ -1640,6 +1675,8 @@ static void kcpu_queue_process(struct kbase_kcpu_command_queue *queue,
 			kbase_kcpu_cqs_set_operation_process(kbdev, queue,
 				&cmd->info.cqs_set_operation);
 
+			if (budget)
+				budget->signalled = true;
 			break;
 		case BASE_KCPU_COMMAND_TYPE_ERROR_BARRIER:
 			/* Clear the queue's error state */
@@ -1822,6 +1859,80 @@ static void kcpu_queue_process(struct kbase_kcpu_command_queue *queue,
 	}
 }
 
+/**
+ * kcpu_queue_blocked_on_wait - Check whether a KCPU queue is blocked on a
+ *                              CQS or fence wait
+ *
+ * @queue: The queue to check.
+ *
+ * Return: true if the command at the front of @queue is a wait.
+ */
+static bool kcpu_queue_blocked_on_wait(struct kbase_kcpu_command_queue *queue)
+{
+	if (!queue->num_pending_cmds)
+		return false;
+
+	switch (queue->commands[queue->start_offset].type) {
+	case BASE_KCPU_COMMAND_TYPE_FENCE_WAIT:
+	case BASE_KCPU_COMMAND_TYPE_CQS_WAIT:
+	case BASE_KCPU_COMMAND_TYPE_CQS_WAIT_OPERATION:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * kcpu_queue_process_inline - Execute commands from an enqueue call
+ *
+ * @queue: The queue to which commands were just enqueued.
+ *
+ * Commands whose dependencies are already met are executed directly instead
+ * of going through the queue's work item. When they signal a CQS object or a
+ * fence, the other queues of the context blocked on a wait are processed
+ * too, so that a chain of queues doesn't take a workqueue round trip per
+ * link. The amount of work is bounded by the context's inline budget; what
+ * is left over is handled by the work items, which the CQS event and fence
+ * callbacks have queued anyway. A zero budget keeps the old behaviour: the
+ * queue itself is processed without a limit and other queues are left to
+ * their work items.
+ */
+static void kcpu_queue_process_inline(struct kbase_kcpu_command_queue *queue)
+{
+	struct kbase_csf_kcpu_queue_context *const kcpu_queues =
+		&queue->kctx->csf.kcpu_queues;
+	struct kcpu_inline_budget budget = {
+		.cmds_left = kcpu_queues->inline_budget,
+	};
+	unsigned long id;
+
+	lockdep_assert_held(&kcpu_queues->lock);
+
+	if (!budget.cmds_left) {
+		kcpu_queue_process(queue, false, NULL);
+		return;
+	}
+
+	kcpu_queue_process(queue, false, &budget);
+
+	while (budget.signalled && budget.cmds_left) {
+		budget.signalled = false;
+
+		for_each_set_bit(id, kcpu_queues->in_use,
+				KBASEP_MAX_KCPU_QUEUES) {
+			struct kbase_kcpu_command_queue *waiter =
+				kcpu_queues->array[id];
+
+			if (!budget.cmds_left)
+				break;
+
+			if (waiter != queue &&
+			    kcpu_queue_blocked_on_wait(waiter))
+				kcpu_queue_process(waiter, false, &budget);
+		}
+	}
+}
+
 static size_t kcpu_queue_get_space(struct kbase_kcpu_command_queue *queue)
 {
 	return KBASEP_KCPU_QUEUE_SIZE - queue->num_pending_cmds;
@@ -2134,7 +2245,7 @@ int kbase_csf_kcpu_queue_enqueue(struct kbase_context *kctx,
 		}
 
 		queue->num_pending_cmds += enq->nr_commands;
-		kcpu_queue_process(queue, false);
+		kcpu_queue_process_inline(queue);
 	} else {
 		/* Roll back the number of enqueued commands */
 		kctx->csf.kcpu_queues.num_cmds -= i;
@@ -2146,6 +2257,8 @@ out:
 	return ret;
 }
 
+KBASE_EXPORT_TEST_API(kbase_csf_kcpu_queue_enqueue);
+
 int kbase_csf_kcpu_queue_context_init(struct kbase_context *kctx)
 {
 	int idx;
@@ -2163,6 +2276,7 @@ int kbase_csf_kcpu_queue_context_init(struct kbase_context *kctx)
 	mutex_init(&kctx->csf.kcpu_queues.lock);
 
 	kctx->csf.kcpu_queues.num_cmds = 0;
+	kctx->csf.kcpu_queues.inline_budget = KBASEP_KCPU_INLINE_BUDGET;
 
 	return 0;
 }
@@ -2190,6 +2304,8 @@ int kbase_csf_kcpu_queue_delete(struct kbase_context *kctx,
 	return delete_queue(kctx, (u32)del->id);
 }
 
+KBASE_EXPORT_TEST_API(kbase_csf_kcpu_queue_delete);
+
 int kbase_csf_kcpu_queue_new(struct kbase_context *kctx,
 			struct kbase_ioctl_kcpu_queue_new *newq)
 {
@@ -2256,3 +2372,5 @@ out:
 
 	return ret;
 }
+
+KBASE_EXPORT_TEST_API(kbase_csf_kcpu_queue_new);
@@ -33,6 +33,12 @@
  */
 #define KBASEP_KCPU_QUEUE_SIZE ((size_t)256)
 
+/* The maximum number of KCPU commands executed directly from one enqueue
+ * call, across all the queues of the context, before the rest is left to
+ * the queues' work items.
+ */
+#define KBASEP_KCPU_INLINE_BUDGET ((u32)32)
+
 /**
  * struct kbase_kcpu_command_import_info - Structure which holds information
  *				about the buffer to be imported
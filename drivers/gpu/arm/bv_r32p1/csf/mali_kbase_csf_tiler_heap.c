@@ -118,25 +118,21 @@ static int link_chunk(struct kbase_csf_tiler_heap *const heap,
 }
 
 /**
- * init_chunk - Initialize and link a tiler heap chunk
+ * clear_chunk_hdr - Zero-initialize the header of a tiler heap chunk
  *
- * Zero-initialize a new chunk's header (including its pointer to the next
- * chunk, which doesn't exist yet) and then update the previous chunk's
- * header to link the new chunk into the chunk list.
+ * Zero-initialize a new chunk's header, including its pointer to the next
+ * chunk, which doesn't exist yet.
  *
- * @heap:  Pointer to the tiler heap.
- * @chunk: Pointer to the heap chunk to be initialized and linked.
- * @link_with_prev: Flag to indicate if the new chunk needs to be linked with
- *                  the previously allocated chunk.
+ * @kctx:  Pointer to the kbase context in which the chunk was allocated.
+ * @chunk: Pointer to the heap chunk to be initialized.
  *
  * Return: 0 if successful or a negative error code on failure.
  */
-static int init_chunk(struct kbase_csf_tiler_heap *const heap,
-	struct kbase_csf_tiler_heap_chunk *const chunk, bool link_with_prev)
+static int clear_chunk_hdr(struct kbase_context *const kctx,
+	struct kbase_csf_tiler_heap_chunk *const chunk)
 {
 	struct kbase_vmap_struct map;
 	struct u64 *chunk_hdr = NULL;
-	struct kbase_context *const kctx = heap->kctx;
 
 	if (unlikely(chunk->gpu_va & ~CHUNK_ADDR_MASK)) {
 		dev_err(kctx->kbdev->dev,
@@ -156,31 +152,43 @@ static int init_chunk(struct kbase_csf_tiler_heap *const heap,
 	memset(chunk_hdr, 0, CHUNK_HDR_SIZE);
 	kbase_vunmap(kctx, &map);
 
-	if (link_with_prev)
-		return link_chunk(heap, chunk);
-	else
-		return 0;
+	return 0;
 }
 
 /**
- * create_chunk - Create a tiler heap chunk
+ * free_chunk - Free the memory of a tiler heap chunk
  *
- * This function allocates a chunk of memory for a tiler heap and adds it to
- * the end of the list of chunks associated with that heap. The size of the
- * chunk is not a parameter because it is configured per-heap not per-chunk.
+ * The chunk must not be on any list when this function is called.
  *
- * @heap: Pointer to the tiler heap for which to allocate memory.
- * @link_with_prev: Flag to indicate if the chunk to be allocated needs to be
- *                  linked with the previously allocated chunk.
+ * @kctx:  Pointer to the kbase context in which the chunk was allocated.
+ * @chunk: Pointer to the heap chunk to be freed.
+ */
+static void free_chunk(struct kbase_context *const kctx,
+	struct kbase_csf_tiler_heap_chunk *const chunk)
+{
+	kbase_gpu_vm_lock(kctx);
+	chunk->region->flags &= ~KBASE_REG_NO_USER_FREE;
+	kbase_mem_free_region(kctx, chunk->region);
+	kbase_gpu_vm_unlock(kctx);
+	kfree(chunk);
+}
+
+/**
+ * alloc_chunk - Allocate a tiler heap chunk
  *
- * Return: 0 if successful or a negative error code on failure.
+ * This function allocates and maps the GPU memory for a chunk and zeroes its
+ * header, without adding it to any heap. It doesn't require the tiler heaps
+ * lock, so it can also be used to refill the chunk pools in the background.
+ *
+ * @kctx:       Pointer to the kbase context in which to allocate the chunk.
+ * @chunk_size: Size of the chunk, in bytes.
+ *
+ * Return: Pointer to the new chunk, or NULL on failure.
  */
-static int create_chunk(struct kbase_csf_tiler_heap *const heap,
-		bool link_with_prev)
+static struct kbase_csf_tiler_heap_chunk *alloc_chunk(
+	struct kbase_context *const kctx, u32 const chunk_size)
 {
-	int err = 0;
-	struct kbase_context *const kctx = heap->kctx;
-	u64 nr_pages = PFN_UP(heap->chunk_size);
+	u64 nr_pages = PFN_UP(chunk_size);
 	u64 flags = BASE_MEM_PROT_GPU_RD | BASE_MEM_PROT_GPU_WR |
 		BASE_MEM_PROT_CPU_WR | BASEP_MEM_NO_USER_FREE |
 		BASE_MEM_COHERENT_LOCAL;
@@ -192,13 +200,11 @@ static int create_chunk(struct kbase_csf_tiler_heap *const heap,
 	flags |= BASE_MEM_PROT_CPU_RD;
 #endif
 
-	lockdep_assert_held(&kctx->csf.tiler_heaps.lock);
-
 	chunk = kzalloc(sizeof(*chunk), GFP_KERNEL);
 	if (unlikely(!chunk)) {
 		dev_err(kctx->kbdev->dev,
 			"No kernel memory for a new tiler heap chunk\n");
-		return -ENOMEM;
+		return NULL;
 	}
 
 	/* Allocate GPU memory for the new chunk. */
@@ -209,28 +215,143 @@ static int create_chunk(struct kbase_csf_tiler_heap *const heap,
 	if (unlikely(!chunk->region)) {
 		dev_err(kctx->kbdev->dev,
 			"Failed to allocate a tiler heap chunk\n");
-		err = -ENOMEM;
-	} else {
-		err = init_chunk(heap, chunk, link_with_prev);
+		kfree(chunk);
+		return NULL;
+	}
+
+	if (unlikely(clear_chunk_hdr(kctx, chunk))) {
+		free_chunk(kctx, chunk);
+		return NULL;
+	}
+
+	return chunk;
+}
+
+/**
+ * pool_take_chunk - Take a ready chunk from the pool of a tiler heap
+ *
+ * @heap: Pointer to the tiler heap.
+ *
+ * Return: Pointer to a chunk removed from the pool, or NULL if the pool is
+ *         empty or disabled.
+ */
+static struct kbase_csf_tiler_heap_chunk *pool_take_chunk(
+	struct kbase_csf_tiler_heap *const heap)
+{
+	struct kbase_csf_tiler_heap_pool *const pool = &heap->pool;
+	struct kbase_csf_tiler_heap_chunk *chunk;
+
+	lockdep_assert_held(&heap->kctx->csf.tiler_heaps.lock);
+
+	if (!heap->kctx->csf.tiler_heaps.pool_enabled ||
+	    list_empty(&pool->chunks))
+		return NULL;
+
+	chunk = list_first_entry(&pool->chunks,
+		struct kbase_csf_tiler_heap_chunk, link);
+	list_del_init(&chunk->link);
+	pool->nr_chunks--;
+
+	return chunk;
+}
+
+/**
+ * pool_deficit - Number of chunks missing from the pool of a tiler heap
+ *
+ * The pool never holds more chunks than the heap could still take without
+ * exceeding its maximum number of chunks.
+ *
+ * @heap: Pointer to the tiler heap.
+ *
+ * Return: Number of chunks the background refill should add to the pool.
+ */
+static u32 pool_deficit(struct kbase_csf_tiler_heap *const heap)
+{
+	struct kbase_csf_tiler_heap_pool *const pool = &heap->pool;
+	u32 target;
+
+	lockdep_assert_held(&heap->kctx->csf.tiler_heaps.lock);
+
+	if (!heap->kctx->csf.tiler_heaps.pool_enabled)
+		return 0;
+
+	target = min(pool->watermark, heap->max_chunks - heap->chunk_count);
+
+	return target > pool->nr_chunks ? target - pool->nr_chunks : 0;
+}
+
+/**
+ * pool_account_grow - Learn the pool watermark from an out-of-memory event
+ *
+ * The watermark is raised immediately to the number of chunks requested in
+ * the current render pass and decays by half for every render pass that
+ * needs fewer chunks than that.
+ *
+ * @heap: Pointer to the tiler heap that was grown.
+ */
+static void pool_account_grow(struct kbase_csf_tiler_heap *const heap)
+{
+	struct kbase_csf_tiler_heap_pool *const pool = &heap->pool;
+	u64 const now = ktime_get_raw_ns();
+
+	lockdep_assert_held(&heap->kctx->csf.tiler_heaps.lock);
+
+	if (now - pool->burst_start > TILER_HEAP_POOL_BURST_WINDOW_NS) {
+		pool->watermark = max(pool->burst, pool->watermark / 2);
+		pool->burst = 0;
+		pool->burst_start = now;
+	}
+
+	pool->burst++;
+	pool->watermark = min(max(pool->watermark, pool->burst),
+		TILER_HEAP_POOL_MAX_CHUNKS);
+}
+
+/**
+ * create_chunk - Create a tiler heap chunk
+ *
+ * This function takes a chunk from the heap's pool, or allocates one if the
+ * pool is empty, and adds it to the end of the list of chunks associated with
+ * that heap. The size of the chunk is not a parameter because it is configured
+ * per-heap not per-chunk.
+ *
+ * @heap: Pointer to the tiler heap for which to allocate memory.
+ * @link_with_prev: Flag to indicate if the chunk to be allocated needs to be
+ *                  linked with the previously allocated chunk.
+ *
+ * Return: 0 if successful or a negative error code on failure.
+ */
+static int create_chunk(struct kbase_csf_tiler_heap *const heap,
+		bool link_with_prev)
+{
+	int err = 0;
+	struct kbase_context *const kctx = heap->kctx;
+	struct kbase_csf_tiler_heap_chunk *chunk = NULL;
+
+	lockdep_assert_held(&kctx->csf.tiler_heaps.lock);
+
+	chunk = pool_take_chunk(heap);
+	if (!chunk)
+		chunk = alloc_chunk(kctx, heap->chunk_size);
+
+	if (unlikely(!chunk))
+		return -ENOMEM;
+
+	if (link_with_prev) {
+		err = link_chunk(heap, chunk);
 		if (unlikely(err)) {
-			kbase_gpu_vm_lock(kctx);
-			chunk->region->flags &= ~KBASE_REG_NO_USER_FREE;
-			kbase_mem_free_region(kctx, chunk->region);
-			kbase_gpu_vm_unlock(kctx);
+			free_chunk(kctx, chunk);
+			return err;
 		}
 	}
 
-	if (unlikely(err)) {
-		kfree(chunk);
-	} else {
-		list_add_tail(&chunk->link, &heap->chunks_list);
-		heap->chunk_count++;
+	list_add_tail(&chunk->link, &heap->chunks_list);
+	heap->chunk_count++;
 
-		dev_dbg(kctx->kbdev->dev, "Created tiler heap chunk 0x%llX\n",
-			chunk->gpu_va);
-	}
+	dev_dbg(kctx->kbdev->dev, "Created tiler heap chunk 0x%llX\n",
+		chunk->gpu_va);
 
-	return err;
+	return 0;
 }
 
 /**
@@ -253,20 +374,17 @@ static void delete_chunk(struct kbase_csf_tiler_heap *const heap,
 
 	lockdep_assert_held(&kctx->csf.tiler_heaps.lock);
 
-	kbase_gpu_vm_lock(kctx);
-	chunk->region->flags &= ~KBASE_REG_NO_USER_FREE;
-	kbase_mem_free_region(kctx, chunk->region);
-	kbase_gpu_vm_unlock(kctx);
 	list_del(&chunk->link);
 	heap->chunk_count--;
-	kfree(chunk);
+	free_chunk(kctx, chunk);
 }
 
 /**
  * delete_all_chunks - Delete all chunks belonging to a tiler heap
  *
  * This function empties the list of chunks associated with a tiler heap by
- * freeing all chunks previously allocated by @create_chunk.
+ * freeing all chunks previously allocated by @create_chunk, together with
+ * any chunks left in the heap's pool.
  *
  * @heap: Pointer to a tiler heap.
  */
@@ -283,6 +401,15 @@ static void delete_all_chunks(struct kbase_csf_tiler_heap *heap)
 
 		delete_chunk(heap, chunk);
 	}
+
+	list_for_each_safe(entry, tmp, &heap->pool.chunks) {
+		struct kbase_csf_tiler_heap_chunk *chunk = list_entry(
+			entry, struct kbase_csf_tiler_heap_chunk, link);
+
+		list_del(&chunk->link);
+		free_chunk(kctx, chunk);
+	}
+	heap->pool.nr_chunks = 0;
 }
 
 /**
@@ -379,6 +506,62 @@ static struct kbase_csf_tiler_heap *find_tiler_heap(
 	return NULL;
 }
 
+/**
+ * pool_refill_worker - Refill the chunk pools of the tiler heaps of a context
+ *
+ * GPU memory is allocated without holding the tiler heaps lock, so that
+ * out-of-memory events are never blocked behind a refill. A chunk that is
+ * no longer wanted by the time it is ready, for instance because its heap
+ * was terminated meanwhile, is simply freed again.
+ *
+ * @work: Pointer to the pool_work member of the tiler heaps context.
+ */
+static void pool_refill_worker(struct work_struct *work)
+{
+	struct kbase_context *const kctx = container_of(work,
+		struct kbase_context, csf.tiler_heaps.pool_work);
+	struct kbase_csf_tiler_heap_context *const ctx = &kctx->csf.tiler_heaps;
+
+	for (;;) {
+		struct kbase_csf_tiler_heap *heap;
+		struct kbase_csf_tiler_heap_chunk *chunk;
+		u64 heap_gpu_va = 0;
+		u32 chunk_size = 0;
+
+		mutex_lock(&ctx->lock);
+		list_for_each_entry(heap, &ctx->list, link) {
+			if (pool_deficit(heap)) {
+				heap_gpu_va = heap->gpu_va;
+				chunk_size = heap->chunk_size;
+				break;
+			}
+		}
+		mutex_unlock(&ctx->lock);
+
+		if (!heap_gpu_va)
+			break;
+
+		chunk = alloc_chunk(kctx, chunk_size);
+		if (unlikely(!chunk))
+			break;
+
+		mutex_lock(&ctx->lock);
+		heap = find_tiler_heap(kctx, heap_gpu_va);
+		if (likely(heap) && heap->chunk_size == chunk_size &&
+		    pool_deficit(heap)) {
+			list_add_tail(&chunk->link, &heap->pool.chunks);
+			heap->pool.nr_chunks++;
+			chunk = NULL;
+		}
+		mutex_unlock(&ctx->lock);
+
+		if (unlikely(chunk)) {
+			free_chunk(kctx, chunk);
+			break;
+		}
+	}
+}
+
 int kbase_csf_tiler_heap_context_init(struct kbase_context *const kctx)
 {
 	int err = kbase_csf_heap_context_allocator_init(
@@ -389,6 +572,8 @@ int kbase_csf_tiler_heap_context_init(struct kbase_context *const kctx)
 
 	INIT_LIST_HEAD(&kctx->csf.tiler_heaps.list);
 	mutex_init(&kctx->csf.tiler_heaps.lock);
+	INIT_WORK(&kctx->csf.tiler_heaps.pool_work, pool_refill_worker);
+	kctx->csf.tiler_heaps.pool_enabled = true;
 
 	dev_dbg(kctx->kbdev->dev, "Initialized a context for tiler heaps\n");
 
@@ -401,6 +586,8 @@ void kbase_csf_tiler_heap_context_term(struct kbase_context *const kctx)
 
 	dev_dbg(kctx->kbdev->dev, "Terminating a context for tiler heaps\n");
 
+	cancel_work_sync(&kctx->csf.tiler_heaps.pool_work);
+
 	mutex_lock(&kctx->csf.tiler_heaps.lock);
 
 	list_for_each_safe(entry, tmp, &kctx->csf.tiler_heaps.list) {
@@ -456,6 +643,7 @@ int kbase_csf_tiler_heap_init(struct kbase_context *const kctx,
 	heap->max_chunks = max_chunks;
 	heap->target_in_flight = target_in_flight;
 	INIT_LIST_HEAD(&heap->chunks_list);
+	INIT_LIST_HEAD(&heap->pool.chunks);
 
 	heap->gpu_va = kbase_csf_heap_context_allocator_alloc(ctx_alloc);
 
@@ -503,6 +691,8 @@ int kbase_csf_tiler_heap_init(struct kbase_context *const kctx,
 	return err;
 }
 
+KBASE_EXPORT_TEST_API(kbase_csf_tiler_heap_init);
+
 int kbase_csf_tiler_heap_term(struct kbase_context *const kctx,
 	u64 const heap_gpu_va)
 {
@@ -522,6 +712,8 @@ int kbase_csf_tiler_heap_term(struct kbase_context *const kctx,
 	return err;
 }
 
+KBASE_EXPORT_TEST_API(kbase_csf_tiler_heap_term);
+
 /**
  * alloc_new_chunk - Allocate a new chunk for the tiler heap.
  *
@@ -544,8 +736,10 @@ static int alloc_new_chunk(struct kbase_csf_tiler_heap *heap,
 		u32 nr_in_flight, u32 pending_frag_count, u64 *new_chunk_ptr)
 {
 	int err = -ENOMEM;
+	struct kbase_csf_tiler_heap_context *const ctx =
+		&heap->kctx->csf.tiler_heaps;
 
-	lockdep_assert_held(&heap->kctx->csf.tiler_heaps.lock);
+	lockdep_assert_held(&ctx->lock);
 
 	if (WARN_ON(!nr_in_flight) ||
 		WARN_ON(pending_frag_count > nr_in_flight))
@@ -553,6 +747,9 @@ static int alloc_new_chunk(struct kbase_csf_tiler_heap *heap,
 
 	if (nr_in_flight <= heap->target_in_flight) {
 		if (heap->chunk_count < heap->max_chunks) {
+			bool const from_pool = ctx->pool_enabled &&
+				heap->pool.nr_chunks;
+
 			/* Not exceeded the target number of render passes yet so be
 			 * generous with memory.
 			 */
@@ -561,6 +758,19 @@ static int alloc_new_chunk(struct kbase_csf_tiler_heap *heap,
 			if (likely(!err)) {
 				struct kbase_csf_tiler_heap_chunk *new_chunk =
 								get_last_chunk(heap);
+
+				if (from_pool)
+					heap->pool.nr_hits++;
+				else
+					heap->pool.nr_misses++;
+
+				if (ctx->pool_enabled) {
+					pool_account_grow(heap);
+					if (pool_deficit(heap))
+						queue_work(system_unbound_wq,
+							&ctx->pool_work);
+				}
+
 				if (!WARN_ON(!new_chunk)) {
 					*new_chunk_ptr =
 						encode_chunk_ptr(heap->chunk_size,
@@ -609,3 +819,5 @@ int kbase_csf_tiler_heap_alloc_new_chunk(struct kbase_context *kctx,
 
 	return err;
 }
+
+KBASE_EXPORT_TEST_API(kbase_csf_tiler_heap_alloc_new_chunk);
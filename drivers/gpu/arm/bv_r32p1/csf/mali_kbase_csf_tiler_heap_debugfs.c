@@ -54,6 +54,10 @@ static int kbasep_csf_tiler_heap_debugfs_show(struct seq_file *file, void *data)
 		seq_printf(file, "\tchunk_count = %u\n", heap->chunk_count);
 		seq_printf(file, "\tmax_chunks = %u\n", heap->max_chunks);
 		seq_printf(file, "\ttarget_in_flight = %u\n", heap->target_in_flight);
+		seq_printf(file, "\tpool_chunks = %u\n", heap->pool.nr_chunks);
+		seq_printf(file, "\tpool_watermark = %u\n", heap->pool.watermark);
+		seq_printf(file, "\tpool_hits = %llu\n", heap->pool.nr_hits);
+		seq_printf(file, "\tpool_misses = %llu\n", heap->pool.nr_misses);
 
 		list_for_each_entry(chunk, &heap->chunks_list, link)
 			seq_printf(file, "\t\tchunk gpu_va = 0x%llx\n",
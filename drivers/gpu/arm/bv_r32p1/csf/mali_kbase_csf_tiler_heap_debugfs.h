@@ -25,7 +25,7 @@
 /* Forward declaration */
 struct kbase_context;
 
-#define MALI_CSF_TILER_HEAP_DEBUGFS_VERSION 0
+#define MALI_CSF_TILER_HEAP_DEBUGFS_VERSION 1
 
 /**
  * kbase_csf_tiler_heap_debugfs_init() - Create a debugfs entry for per context tiler heap
@@ -56,6 +56,14 @@
 	((CHUNK_HDR_NEXT_ADDR_MASK >> CHUNK_HDR_NEXT_ADDR_POS) << \
 	 CHUNK_HDR_NEXT_ADDR_ENCODE_SHIFT)
 
+/* Upper limit on the number of chunks kept ready in the pool of a heap. */
+#define TILER_HEAP_POOL_MAX_CHUNKS (8u)
+
+/* Chunk allocations closer together than this, in nanoseconds, are counted
+ * as part of the same render pass when learning the pool watermark.
+ */
+#define TILER_HEAP_POOL_BURST_WINDOW_NS ((u64)16 * NSEC_PER_MSEC)
+
 /**
  * struct kbase_csf_tiler_heap_chunk - A tiler heap chunk managed by the kernel
  *
@@ -78,6 +86,35 @@ struct kbase_csf_tiler_heap_chunk {
 	u64 gpu_va;
 };
 
+/**
+ * struct kbase_csf_tiler_heap_pool - Chunks allocated ahead of out-of-memory
+ *                                    events for a tiler heap
+ *
+ * Chunks in the pool are fully backed, mapped on the GPU and have a zeroed
+ * header, but are not yet linked into the heap or counted in its chunk_count.
+ * The pool is refilled in the background up to @watermark, which follows the
+ * largest number of chunks recently requested within one render pass.
+ *
+ * @chunks:      List of chunks ready to be handed to the heap.
+ * @nr_chunks:   Number of chunks in @chunks.
+ * @watermark:   Number of chunks the background refill aims to keep ready.
+ * @burst:       Number of chunks allocated in the current render pass.
+ * @burst_start: Time of the first allocation of the current render pass,
+ *               in nanoseconds.
+ * @nr_hits:     Number of out-of-memory allocations served from the pool.
+ * @nr_misses:   Number of out-of-memory allocations that had to allocate
+ *               GPU memory synchronously.
+ */
+struct kbase_csf_tiler_heap_pool {
+	struct list_head chunks;
+	u32 nr_chunks;
+	u32 watermark;
+	u32 burst;
+	u64 burst_start;
+	u64 nr_hits;
+	u64 nr_misses;
+};
+
 /**
  * struct kbase_csf_tiler_heap - A tiler heap managed by the kernel
  *
@@ -99,6 +136,7 @@ struct kbase_csf_tiler_heap_chunk {
  * @heap_id:         Unique id representing the heap, assigned during heap
  *                   initialization.
  * @chunks_list:     Linked list of allocated chunks.
+ * @pool:            Chunks allocated ahead of out-of-memory events.
  */
 struct kbase_csf_tiler_heap {
 	struct kbase_context *kctx;
@@ -110,5 +148,6 @@ struct kbase_csf_tiler_heap {
 	u64 gpu_va;
 	u64 heap_id;
 	struct list_head chunks_list;
+	struct kbase_csf_tiler_heap_pool pool;
 };
 #endif /* !_KBASE_CSF_TILER_HEAP_DEF_H_ */
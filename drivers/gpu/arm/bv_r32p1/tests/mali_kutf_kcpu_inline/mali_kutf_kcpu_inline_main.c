@@ -0,0 +1,464 @@
+// SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note
+/*
+ *
+ * (C) COPYRIGHT 2021 ARM Limited. All rights reserved.
+ *
+ * This program is free software and is provided to you under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation, and any use by you of this program is subject to the terms
+ * of such GNU license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/syscalls.h>
+#include <linux/uaccess.h>
+
+#include "mali_kbase.h"
+#include <context/mali_kbase_context.h>
+#include <csf/mali_kbase_csf_kcpu.h>
+
+#include <kutf/kutf_suite.h>
+#include <kutf/kutf_utils.h>
+
+/*
+ * This file contains the code which is used for measuring the latency from
+ * enqueueing the KCPU command that resolves a chain of KCPU queues to the
+ * completion of the last queue in the chain, with the inline execution of
+ * KCPU commands from the enqueue call enabled and disabled. Two chains are
+ * measured:
+ *
+ * - CQS set chain:      A sets a CQS object that B waits on, then B sets the
+ *                       "done" object.
+ * - Fence signal chain: C sets a CQS object that A waits on, A then signals
+ *                       a fence that B waits on, then B sets "done".
+ *
+ * The commands are passed to kbase_csf_kcpu_queue_enqueue() as if they came
+ * from the enqueue ioctl, so the test runs with the kernel address limit.
+ */
+
+/* KUTF test application pointer for this test */
+struct kutf_application *kcpu_inline_app;
+
+/**
+ * struct kutf_kcpu_inline_fixture_data - test fixture used by the test
+ *                                        functions.
+ * @kbdev:	kbase device for the GPU.
+ * @kctx:	kbase context in which the KCPU queues are created.
+ * @evt_va:	GPU virtual address of the page holding the CQS objects.
+ * @evt:	Kernel mapping of the page holding the CQS objects.
+ * @mapping:	Reference on the kernel mapping of @evt.
+ * @queue_ids:	IDs of the KCPU queues used by the chains.
+ */
+struct kutf_kcpu_inline_fixture_data {
+	struct kbase_device *kbdev;
+	struct kbase_context *kctx;
+	u64 evt_va;
+	u32 *evt;
+	struct kbase_vmap_struct *mapping;
+	u8 queue_ids[3];
+};
+
+/* Number of chains resolved per test */
+#define NR_TEST_CHAINS ((u32)10000)
+
+/* CQS objects used by the chains */
+#define CQS_TRIGGER (0)
+#define CQS_DONE (1)
+
+/* Time allowed for a chain to complete */
+#define CHAIN_TIMEOUT_NS ((u64)NSEC_PER_SEC)
+
+static u64 cqs_addr(struct kutf_kcpu_inline_fixture_data *data, int obj)
+{
+	return data->evt_va + obj * 2 * sizeof(u32);
+}
+
+static u32 *cqs_val(struct kutf_kcpu_inline_fixture_data *data, int obj)
+{
+	return &data->evt[obj * 2 + BASEP_EVENT_VAL_INDEX];
+}
+
+static int enqueue(struct kutf_kcpu_inline_fixture_data *data, u8 id,
+		struct base_kcpu_command *cmd)
+{
+	struct kbase_ioctl_kcpu_queue_enqueue enq = {
+		.addr = (u64)(uintptr_t)cmd,
+		.nr_commands = 1,
+		.id = id,
+	};
+
+	return kbase_csf_kcpu_queue_enqueue(data->kctx, &enq);
+}
+
+static int enqueue_cqs_wait(struct kutf_kcpu_inline_fixture_data *data,
+		u8 id, int obj)
+{
+	struct base_cqs_wait_info wait = {
+		.addr = cqs_addr(data, obj),
+		.val = READ_ONCE(*cqs_val(data, obj)),
+	};
+	struct base_kcpu_command cmd = {
+		.type = BASE_KCPU_COMMAND_TYPE_CQS_WAIT,
+		.info.cqs_wait = {
+			.objs = (u64)(uintptr_t)&wait,
+			.nr_objs = 1,
+		},
+	};
+
+	return enqueue(data, id, &cmd);
+}
+
+static int enqueue_cqs_set(struct kutf_kcpu_inline_fixture_data *data,
+		u8 id, int obj)
+{
+	struct base_cqs_set set = {
+		.addr = cqs_addr(data, obj),
+	};
+	struct base_kcpu_command cmd = {
+		.type = BASE_KCPU_COMMAND_TYPE_CQS_SET,
+		.info.cqs_set = {
+			.objs = (u64)(uintptr_t)&set,
+			.nr_objs = 1,
+		},
+	};
+
+	return enqueue(data, id, &cmd);
+}
+
+static int enqueue_fence(struct kutf_kcpu_inline_fixture_data *data,
+		u8 id, u8 type, struct base_fence *fence)
+{
+	struct base_kcpu_command cmd = {
+		.type = type,
+		.info.fence.fence = (u64)(uintptr_t)fence,
+	};
+
+	return enqueue(data, id, &cmd);
+}
+
+/**
+ * wait_done() - busy-wait for the "done" CQS object to be set
+ * @data:	fixture data
+ * @old:	value of the "done" object before the chain was resolved
+ * @end_time:	where to store the time at which the object was set
+ *
+ * Return: 0 on success or -ETIMEDOUT.
+ */
+static int wait_done(struct kutf_kcpu_inline_fixture_data *data, u32 old,
+		u64 *end_time)
+{
+	u64 const deadline = ktime_get_raw_ns() + CHAIN_TIMEOUT_NS;
+
+	while (READ_ONCE(*cqs_val(data, CQS_DONE)) == old) {
+		if (ktime_get_raw_ns() > deadline)
+			return -ETIMEDOUT;
+		cpu_relax();
+	}
+
+	*end_time = ktime_get_raw_ns();
+
+	return 0;
+}
+
+/**
+ * run_chain() - build and resolve one chain of KCPU queues
+ * @data:	fixture data
+ * @fence:	whether to build the fence signal chain or the CQS set chain
+ * @latency:	where to store the enqueue-to-completion latency
+ *
+ * Return: 0 on success or a negative error code.
+ */
+static int run_chain(struct kutf_kcpu_inline_fixture_data *data, bool fence,
+		u64 *latency)
+{
+	u8 const a = data->queue_ids[0], b = data->queue_ids[1];
+	u8 const c = data->queue_ids[2];
+	u32 const old = READ_ONCE(*cqs_val(data, CQS_DONE));
+	struct base_fence out_fence = { .basep.fd = -1 };
+	u64 start_time, end_time;
+	int err;
+
+	if (fence) {
+		err = enqueue_cqs_wait(data, a, CQS_TRIGGER);
+		if (!err)
+			err = enqueue_fence(data, a,
+				BASE_KCPU_COMMAND_TYPE_FENCE_SIGNAL,
+				&out_fence);
+		if (!err)
+			err = enqueue_fence(data, b,
+				BASE_KCPU_COMMAND_TYPE_FENCE_WAIT,
+				&out_fence);
+	} else {
+		err = enqueue_cqs_wait(data, b, CQS_TRIGGER);
+	}
+
+	if (!err)
+		err = enqueue_cqs_set(data, b, CQS_DONE);
+
+	if (!err) {
+		start_time = ktime_get_raw_ns();
+		err = enqueue_cqs_set(data, fence ? c : a, CQS_TRIGGER);
+	}
+
+	if (!err)
+		err = wait_done(data, old, &end_time);
+
+	if (out_fence.basep.fd >= 0)
+		sys_close(out_fence.basep.fd);
+
+	if (!err)
+		*latency = end_time - start_time;
+
+	return err;
+}
+
+/**
+ * mali_kutf_kcpu_inline_create_fixture() - Creates the fixture data required
+ *                          for all the tests in the suite.
+ * @context:             KUTF context.
+ *
+ * Return: Fixture data created on success or NULL on failure
+ */
+static void *mali_kutf_kcpu_inline_create_fixture(
+		struct kutf_context *context)
+{
+	struct kutf_kcpu_inline_fixture_data *data;
+	u64 flags = BASE_MEM_PROT_CPU_RD | BASE_MEM_PROT_CPU_WR |
+		BASE_MEM_PROT_GPU_RD | BASE_MEM_PROT_GPU_WR |
+		BASE_MEM_CSF_EVENT;
+	struct kbase_va_region *reg;
+	int i;
+
+	data = kutf_mempool_alloc(&context->fixture_pool,
+			sizeof(struct kutf_kcpu_inline_fixture_data));
+
+	if (!data)
+		return NULL;
+
+	/* Acquire the kbase device */
+	data->kbdev = kbase_find_device(-1);
+	if (data->kbdev == NULL) {
+		kutf_test_fail(context, "Failed to find kbase device");
+		return NULL;
+	}
+
+	data->kctx = kbase_create_context(data->kbdev, false,
+			BASE_CONTEXT_CREATE_FLAG_NONE,
+			KBASE_API_VERSION(BASE_UK_VERSION_MAJOR,
+				BASE_UK_VERSION_MINOR),
+			NULL);
+	if (data->kctx == NULL) {
+		kutf_test_fail(context, "Failed to create kbase context");
+		goto fail_ctx;
+	}
+
+	reg = kbase_mem_alloc(data->kctx, 1, 1, 0, &flags, &data->evt_va);
+	if (!reg) {
+		kutf_test_fail(context, "Failed to allocate sync objects");
+		goto fail_mem;
+	}
+
+	data->evt = kbase_phy_alloc_mapping_get(data->kctx, data->evt_va,
+			&data->mapping);
+	if (!data->evt) {
+		kutf_test_fail(context, "Failed to map sync objects");
+		goto fail_mem;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(data->queue_ids); i++) {
+		struct kbase_ioctl_kcpu_queue_new newq = { 0 };
+
+		if (kbase_csf_kcpu_queue_new(data->kctx, &newq)) {
+			kutf_test_fail(context, "Failed to create KCPU queue");
+			goto fail_queue;
+		}
+		data->queue_ids[i] = newq.id;
+	}
+
+	return data;
+
+fail_queue:
+	while (--i >= 0) {
+		struct kbase_ioctl_kcpu_queue_delete del = {
+			.id = data->queue_ids[i],
+		};
+
+		kbase_csf_kcpu_queue_delete(data->kctx, &del);
+	}
+	kbase_phy_alloc_mapping_put(data->kctx, data->mapping);
+fail_mem:
+	kbase_destroy_context(data->kctx);
+fail_ctx:
+	kbase_release_device(data->kbdev);
+	return NULL;
+}
+
+/**
+ * mali_kutf_kcpu_inline_remove_fixture() - Destroy fixture data previously
+ *                          created by mali_kutf_kcpu_inline_create_fixture.
+ *
+ * @context:             KUTF context.
+ */
+static void mali_kutf_kcpu_inline_remove_fixture(
+		struct kutf_context *context)
+{
+	struct kutf_kcpu_inline_fixture_data *data = context->fixture;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(data->queue_ids); i++) {
+		struct kbase_ioctl_kcpu_queue_delete del = {
+			.id = data->queue_ids[i],
+		};
+
+		kbase_csf_kcpu_queue_delete(data->kctx, &del);
+	}
+
+	kbase_phy_alloc_mapping_put(data->kctx, data->mapping);
+	kbase_destroy_context(data->kctx);
+	kbase_release_device(data->kbdev);
+}
+
+/**
+ * mali_kutf_kcpu_chain_latency() - measure enqueue-to-completion latency
+ * @context:		kutf context within which to perform the test
+ * @fence:		measure the fence signal chain instead of the CQS set
+ *			chain
+ * @inline_exec:	whether the chained queues may be executed from the enqueue
+ *			call
+ *
+ * As for the IRQ latency test, the pass/fail status only tells whether every
+ * chain completed; the latencies are provided for manual analysis.
+ */
+static void mali_kutf_kcpu_chain_latency(struct kutf_context *context,
+		bool fence, bool inline_exec)
+{
+	struct kutf_kcpu_inline_fixture_data *data = context->fixture;
+	struct kbase_context *kctx = data->kctx;
+	u64 min_time = U64_MAX, max_time = 0, average_time = 0;
+	mm_segment_t old_fs;
+	const char *results;
+	u32 i;
+	int err = 0;
+
+	mutex_lock(&kctx->csf.kcpu_queues.lock);
+	kctx->csf.kcpu_queues.inline_budget =
+		inline_exec ? KBASEP_KCPU_INLINE_BUDGET : 0;
+	mutex_unlock(&kctx->csf.kcpu_queues.lock);
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+
+	for (i = 0; i < NR_TEST_CHAINS; i++) {
+		u64 latency;
+
+		err = run_chain(data, fence, &latency);
+		if (err)
+			break;
+
+		if (latency < min_time)
+			min_time = latency;
+		if (latency > max_time)
+			max_time = latency;
+		average_time += latency;
+	}
+
+	set_fs(old_fs);
+
+	mutex_lock(&kctx->csf.kcpu_queues.lock);
+	kctx->csf.kcpu_queues.inline_budget = KBASEP_KCPU_INLINE_BUDGET;
+	mutex_unlock(&kctx->csf.kcpu_queues.lock);
+
+	if (!err) {
+		do_div(average_time, NR_TEST_CHAINS);
+		results = kutf_dsprintf(&context->fixture_pool,
+				"%s chain, inline %s: Min latency = %lldns, Max latency = %lldns, Average latency = %lldns\n",
+				fence ? "Fence signal" : "CQS set",
+				inline_exec ? "on" : "off",
+				min_time, max_time, average_time);
+		kutf_test_pass(context, results);
+	} else {
+		results = kutf_dsprintf(&context->fixture_pool,
+				"Chain %u failed: %d\n", i, err);
+		kutf_test_fail(context, results);
+	}
+}
+
+static void mali_kutf_kcpu_cqs_chain_worker(struct kutf_context *context)
+{
+	mali_kutf_kcpu_chain_latency(context, false, false);
+}
+
+static void mali_kutf_kcpu_cqs_chain_inline(struct kutf_context *context)
+{
+	mali_kutf_kcpu_chain_latency(context, false, true);
+}
+
+static void mali_kutf_kcpu_fence_chain_worker(struct kutf_context *context)
+{
+	mali_kutf_kcpu_chain_latency(context, true, false);
+}
+
+static void mali_kutf_kcpu_fence_chain_inline(struct kutf_context *context)
+{
+	mali_kutf_kcpu_chain_latency(context, true, true);
+}
+
+/**
+ * Module entry point for this test.
+ */
+static int __init mali_kutf_kcpu_inline_main_init(void)
+{
+	struct kutf_suite *suite;
+
+	kcpu_inline_app = kutf_create_application("kcpu_inline");
+
+	if (kcpu_inline_app == NULL) {
+		pr_warn("Creation of test application failed!\n");
+		return -ENOMEM;
+	}
+
+	suite = kutf_create_suite(kcpu_inline_app, "kcpu_inline_default",
+			1, mali_kutf_kcpu_inline_create_fixture,
+			mali_kutf_kcpu_inline_remove_fixture);
+
+	if (suite == NULL) {
+		pr_warn("Creation of test suite failed!\n");
+		kutf_destroy_application(kcpu_inline_app);
+		return -ENOMEM;
+	}
+
+	kutf_add_test(suite, 0x0, "cqs_set_chain_worker",
+			mali_kutf_kcpu_cqs_chain_worker);
+	kutf_add_test(suite, 0x1, "cqs_set_chain_inline",
+			mali_kutf_kcpu_cqs_chain_inline);
+	kutf_add_test(suite, 0x2, "fence_signal_chain_worker",
+			mali_kutf_kcpu_fence_chain_worker);
+	kutf_add_test(suite, 0x3, "fence_signal_chain_inline",
+			mali_kutf_kcpu_fence_chain_inline);
+	return 0;
+}
+
+/**
+ * Module exit point for this test.
+ */
+static void __exit mali_kutf_kcpu_inline_main_exit(void)
+{
+	kutf_destroy_application(kcpu_inline_app);
+}
+
+module_init(mali_kutf_kcpu_inline_main_init);
+module_exit(mali_kutf_kcpu_inline_main_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("ARM Ltd.");
+MODULE_VERSION("1.0");
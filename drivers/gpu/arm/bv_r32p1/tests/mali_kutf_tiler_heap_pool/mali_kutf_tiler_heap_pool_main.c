@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note
+/*
+ *
+ * (C) COPYRIGHT 2021 ARM Limited. All rights reserved.
+ *
+ * This program is free software and is provided to you under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation, and any use by you of this program is subject to the terms
+ * of such GNU license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/delay.h>
+
+#include "mali_kbase.h"
+#include <context/mali_kbase_context.h>
+#include <csf/mali_kbase_csf_tiler_heap.h>
+
+#include <kutf/kutf_suite.h>
+#include <kutf/kutf_utils.h>
+
+/*
+ * This file contains the code which is used for measuring how long it takes
+ * to grow a chunked tiler heap in response to an out-of-memory event, with
+ * and without the per-heap pool of pre-allocated chunks. It is meant to be
+ * run on the no_mali backend, where the cost of the grow is purely the cost
+ * of the kernel side allocation.
+ */
+
+/* KUTF test application pointer for this test */
+struct kutf_application *tiler_heap_pool_app;
+
+/**
+ * struct kutf_tiler_heap_pool_fixture_data - test fixture used by the test
+ *                                            functions.
+ * @kbdev:	kbase device for the GPU.
+ * @kctx:	kbase context in which the tiler heaps are created.
+ */
+struct kutf_tiler_heap_pool_fixture_data {
+	struct kbase_device *kbdev;
+	struct kbase_context *kctx;
+};
+
+/* Size of each tiler heap chunk, in bytes */
+#define TEST_CHUNK_SIZE ((u32)SZ_256K)
+
+/* Number of render passes to simulate */
+#define NR_TEST_FRAMES ((u32)16)
+
+/* Number of out-of-memory events raised within each render pass */
+#define NR_GROWS_PER_FRAME ((u32)4)
+
+/* Time between two render passes, longer than the pool's burst window */
+#define FRAME_GAP_US (20000)
+
+/**
+ * mali_kutf_tiler_heap_pool_create_fixture() - Creates the fixture data
+ *                          required for all the tests in the suite.
+ * @context:             KUTF context.
+ *
+ * Return: Fixture data created on success or NULL on failure
+ */
+static void *mali_kutf_tiler_heap_pool_create_fixture(
+		struct kutf_context *context)
+{
+	struct kutf_tiler_heap_pool_fixture_data *data;
+
+	data = kutf_mempool_alloc(&context->fixture_pool,
+			sizeof(struct kutf_tiler_heap_pool_fixture_data));
+
+	if (!data)
+		return NULL;
+
+	/* Acquire the kbase device */
+	data->kbdev = kbase_find_device(-1);
+	if (data->kbdev == NULL) {
+		kutf_test_fail(context, "Failed to find kbase device");
+		return NULL;
+	}
+
+	data->kctx = kbase_create_context(data->kbdev, false,
+			BASE_CONTEXT_CREATE_FLAG_NONE,
+			KBASE_API_VERSION(BASE_UK_VERSION_MAJOR,
+				BASE_UK_VERSION_MINOR),
+			NULL);
+	if (data->kctx == NULL) {
+		kutf_test_fail(context, "Failed to create kbase context");
+		kbase_release_device(data->kbdev);
+		return NULL;
+	}
+
+	return data;
+}
+
+/**
+ * mali_kutf_tiler_heap_pool_remove_fixture() - Destroy fixture data previously
+ *                          created by mali_kutf_tiler_heap_pool_create_fixture.
+ *
+ * @context:             KUTF context.
+ */
+static void mali_kutf_tiler_heap_pool_remove_fixture(
+		struct kutf_context *context)
+{
+	struct kutf_tiler_heap_pool_fixture_data *data = context->fixture;
+
+	kbase_destroy_context(data->kctx);
+	kbase_release_device(data->kbdev);
+}
+
+/**
+ * mali_kutf_tiler_heap_grow() - measure the tiler heap chunk-grow latency
+ * @context:		kutf context within which to perform the test
+ * @use_pool:		whether out-of-memory events may be served from the pool
+ *
+ * The test creates a tiler heap and then raises bursts of out-of-memory
+ * events, one burst per simulated render pass, timing each call to
+ * kbase_csf_tiler_heap_alloc_new_chunk(). Between two render passes the
+ * background refill is allowed to complete, as it would while the GPU is
+ * busy with the rest of the frame.
+ *
+ * As for the IRQ latency test, the pass/fail status only tells whether every
+ * grow succeeded; the latencies are provided for manual analysis.
+ */
+static void mali_kutf_tiler_heap_grow(struct kutf_context *context,
+		bool use_pool)
+{
+	struct kutf_tiler_heap_pool_fixture_data *data = context->fixture;
+	struct kbase_context *kctx = data->kctx;
+	u64 min_time = U64_MAX, max_time = 0, average_time = 0;
+	u32 const nr_grows = NR_TEST_FRAMES * NR_GROWS_PER_FRAME;
+	u64 heap_gpu_va, first_chunk_va;
+	const char *results;
+	u32 frame, i;
+	int err;
+
+	mutex_lock(&kctx->csf.tiler_heaps.lock);
+	kctx->csf.tiler_heaps.pool_enabled = use_pool;
+	mutex_unlock(&kctx->csf.tiler_heaps.lock);
+
+	err = kbase_csf_tiler_heap_init(kctx, TEST_CHUNK_SIZE, 1,
+			nr_grows + 1, 1, &heap_gpu_va, &first_chunk_va);
+	if (err) {
+		results = kutf_dsprintf(&context->fixture_pool,
+				"Failed to create a tiler heap: %d\n", err);
+		kutf_test_fail(context, results);
+		return;
+	}
+
+	for (frame = 0; frame < NR_TEST_FRAMES && !err; frame++) {
+		for (i = 0; i < NR_GROWS_PER_FRAME; i++) {
+			u64 new_chunk_ptr;
+			u64 start_time = ktime_get_raw_ns();
+			u64 elapsed;
+
+			err = kbase_csf_tiler_heap_alloc_new_chunk(kctx,
+					heap_gpu_va, 1, 0, &new_chunk_ptr);
+			elapsed = ktime_get_raw_ns() - start_time;
+			if (err)
+				break;
+
+			if (elapsed < min_time)
+				min_time = elapsed;
+			if (elapsed > max_time)
+				max_time = elapsed;
+			average_time += elapsed;
+		}
+
+		flush_work(&kctx->csf.tiler_heaps.pool_work);
+		usleep_range(FRAME_GAP_US, FRAME_GAP_US * 2);
+	}
+
+	kbase_csf_tiler_heap_term(kctx, heap_gpu_va);
+
+	if (!err) {
+		do_div(average_time, nr_grows);
+		results = kutf_dsprintf(&context->fixture_pool,
+				"Pool %s: Min latency = %lldns, Max latency = %lldns, Average latency = %lldns\n",
+				use_pool ? "on" : "off",
+				min_time, max_time, average_time);
+		kutf_test_pass(context, results);
+	} else {
+		results = kutf_dsprintf(&context->fixture_pool,
+				"Grow failed in render pass %u: %d\n",
+				frame, err);
+		kutf_test_fail(context, results);
+	}
+}
+
+static void mali_kutf_tiler_heap_grow_no_pool(struct kutf_context *context)
+{
+	mali_kutf_tiler_heap_grow(context, false);
+}
+
+static void mali_kutf_tiler_heap_grow_pool(struct kutf_context *context)
+{
+	mali_kutf_tiler_heap_grow(context, true);
+}
+
+/**
+ * Module entry point for this test.
+ */
+static int __init mali_kutf_tiler_heap_pool_main_init(void)
+{
+	struct kutf_suite *suite;
+
+	tiler_heap_pool_app = kutf_create_application("tiler_heap_pool");
+
+	if (tiler_heap_pool_app == NULL) {
+		pr_warn("Creation of test application failed!\n");
+		return -ENOMEM;
+	}
+
+	suite = kutf_create_suite(tiler_heap_pool_app, "tiler_heap_pool_default",
+			1, mali_kutf_tiler_heap_pool_create_fixture,
+			mali_kutf_tiler_heap_pool_remove_fixture);
+
+	if (suite == NULL) {
+		pr_warn("Creation of test suite failed!\n");
+		kutf_destroy_application(tiler_heap_pool_app);
+		return -ENOMEM;
+	}
+
+	kutf_add_test(suite, 0x0, "grow_latency_no_pool",
+			mali_kutf_tiler_heap_grow_no_pool);
+	kutf_add_test(suite, 0x1, "grow_latency_pool",
+			mali_kutf_tiler_heap_grow_pool);
+	return 0;
+}
+
+/**
+ * Module exit point for this test.
+ */
+static void __exit mali_kutf_tiler_heap_pool_main_exit(void)
+{
+	kutf_destroy_application(tiler_heap_pool_app);
+}
+
+module_init(mali_kutf_tiler_heap_pool_main_init);
+module_exit(mali_kutf_tiler_heap_pool_main_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("ARM Ltd.");
+MODULE_VERSION("1.0");
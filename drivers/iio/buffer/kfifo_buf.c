@@ -97,6 +97,30 @@ static int iio_store_to_kfifo(struct iio_buffer *r,
 	return 0;
 }
 
+/**
+ * iio_kfifo_push_batch() - store several scans with a single wakeup
+ * @r:		buffer allocated by iio_kfifo_allocate()
+ * @data:	@n consecutive scans of r->bytes_per_datum bytes each
+ * @n:		number of scans
+ *
+ * Unlike iio_push_to_buffers() this skips the demux, so callers must
+ * only use it when the active scan mask covers all channels.
+ *
+ * Returns the number of scans stored.
+ */
+unsigned int iio_kfifo_push_batch(struct iio_buffer *r, const void *data,
+				  unsigned int n)
+{
+	struct iio_kfifo *kf = iio_to_kfifo(r);
+	unsigned int ret;
+
+	ret = kfifo_in(&kf->kf, data, n);
+	if (ret)
+		wake_up_interruptible_poll(&r->pollq, POLLIN | POLLRDNORM);
+	return ret;
+}
+EXPORT_SYMBOL(iio_kfifo_push_batch);
+
 static int iio_read_first_n_kfifo(struct iio_buffer *r,
 			   size_t n, char __user *buf)
 {
@@ -23,11 +23,46 @@
 
 #ifdef CONFIG_SEC_DEBUG_TSP_LOG
 #include <linux/input/sec_tsp_log.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <asm/sections.h>
 
-static int sec_tsp_log_index;
-static int sec_tsp_log_index_fix;
+/*
+ * tsp_msg is kept as per-CPU rings of binary records rather than as text.
+ * A writer only touches the ring of its own CPU with interrupts off, so
+ * writers never contend with each other and the ring lock is only taken
+ * by a reader copying a snapshot. Arguments are packed with vbin_printf()
+ * and formatted when /proc/tsp_msg is read.
+ */
+#define TSP_LOG_REC_TEXT	0x01	/* payload is preformatted text */
+#define TSP_LOG_REC_NEWLINE	0x02	/* terminate the line when read */
+
+struct sec_tsp_log_rec {
+	u64 ts_nsec;
+	const char *fmt;
+	u16 len;		/* record size, 0 marks a wrap to the ring base */
+	u16 text_len;
+	u8 msg_len;
+	u8 flags;
+	u8 reserved[2];
+};
+
+struct sec_tsp_log_ring {
+	raw_spinlock_t lock;
+	char *buf;
+	u32 base;		/* records below base were pinned by a fix */
+	u32 first_idx;
+	u32 next_idx;
+	u64 first_seq;
+	u64 next_seq;
+	bool overwritten;
+	unsigned long dropped;
+};
+
+static DEFINE_PER_CPU(struct sec_tsp_log_ring, sec_tsp_log_ring);
 static char *sec_tsp_log_buf;
-static unsigned int sec_tsp_log_size;
+static unsigned int sec_tsp_log_size;	/* per-CPU ring size */
 
 #ifdef CONFIG_TOUCHSCREEN_DUAL_FOLDABLE
 #define MAIN_TOUCH	0
@@ -46,35 +81,6 @@ static int sec_tsp_command_history_index;
 static char *sec_tsp_command_history_buf;
 static unsigned int sec_tsp_command_history_size;
 
-static int sec_tsp_log_timestamp(unsigned long idx)
-{
-	/* Add the current time stamp */
-	char tbuf[50];
-	unsigned int tlen;
-	unsigned long long t;
-	unsigned long nanosec_rem;
-
-	t = local_clock();
-	nanosec_rem = do_div(t, 1000000000);
-	tlen = snprintf(tbuf, sizeof(tbuf), "[%5lu.%06lu] ",
-			(unsigned long)t,
-			nanosec_rem / 1000);
-
-	/* Overflow buffer size */
-	if (idx + tlen > sec_tsp_log_size - 1) {
-		if (sec_tsp_log_index_fix + tlen > sec_tsp_log_size - 1)
-			return sec_tsp_log_index;
-		tlen = scnprintf(&sec_tsp_log_buf[sec_tsp_log_index_fix],
-				tlen + 1, "%s", tbuf);
-		sec_tsp_log_index = sec_tsp_log_index_fix + tlen;
-	} else {
-		tlen = scnprintf(&sec_tsp_log_buf[idx], tlen + 1, "%s", tbuf);
-		sec_tsp_log_index += tlen;
-	}
-
-	return sec_tsp_log_index;
-}
-
 #ifdef CONFIG_TOUCHSCREEN_DUAL_FOLDABLE
 static int sec_tsp_raw_data_timestamp(char mode, unsigned long idx)
 {
@@ -151,37 +157,156 @@ static int sec_tsp_raw_data_timestamp(unsigned long idx)
 #endif
 
 #define TSP_BUF_SIZE 512
+
+static bool sec_tsp_log_fmt_is_static(const char *fmt)
+{
+#ifndef MODULE
+	/* a module may be gone by the time tsp_msg is read */
+	if (fmt < __start_rodata || fmt >= __end_rodata)
+		return false;
+
+	/* %p extensions dereference their argument when formatted */
+	return !strstr(fmt, "%p");
+#else
+	return false;
+#endif
+}
+
+static u32 sec_tsp_log_next(const char *buf, u32 base, u32 idx)
+{
+	const struct sec_tsp_log_rec *rec = (const void *)(buf + idx);
+
+	if (!rec->len) {
+		rec = (const void *)(buf + base);
+		return base + rec->len;
+	}
+
+	return idx + rec->len;
+}
+
+static bool sec_tsp_log_has_space(struct sec_tsp_log_ring *ring, u32 size)
+{
+	u32 free;
+
+	if (ring->next_idx > ring->first_idx ||
+			ring->first_seq == ring->next_seq)
+		free = max(sec_tsp_log_size - ring->next_idx,
+				ring->first_idx - ring->base);
+	else
+		free = ring->first_idx - ring->next_idx;
+
+	/* always keep room for a wrap marker behind the record */
+	return free >= size + sizeof(struct sec_tsp_log_rec);
+}
+
+static struct sec_tsp_log_rec *sec_tsp_log_reserve(struct sec_tsp_log_ring *ring,
+		u32 size)
+{
+	struct sec_tsp_log_rec *rec;
+
+	while (ring->first_seq < ring->next_seq &&
+			!sec_tsp_log_has_space(ring, size)) {
+		ring->first_idx = sec_tsp_log_next(ring->buf, ring->base,
+				ring->first_idx);
+		ring->first_seq++;
+		ring->dropped++;
+		ring->overwritten = true;
+	}
+
+	if (!sec_tsp_log_has_space(ring, size))
+		return NULL;
+
+	if (ring->next_idx + size + sizeof(*rec) > sec_tsp_log_size) {
+		memset(ring->buf + ring->next_idx, 0, sizeof(*rec));
+		ring->next_idx = ring->base;
+		ring->overwritten = true;
+	}
+
+	rec = (struct sec_tsp_log_rec *)(ring->buf + ring->next_idx);
+	rec->len = size;
+	ring->next_idx += size;
+	ring->next_seq++;
+
+	return rec;
+}
+
+static void sec_tsp_log_store(const char *msg, u8 flags, const char *fmt,
+		va_list args)
+{
+	struct sec_tsp_log_ring *ring;
+	struct sec_tsp_log_rec *rec;
+	u32 data[TSP_BUF_SIZE / sizeof(u32)];
+	size_t msg_len = 0, data_len = 0;
+	unsigned long irqflags;
+	u64 ts = local_clock();
+	u32 size;
+
+	if (msg)
+		msg_len = min_t(size_t, strlen(msg), U8_MAX);
+
+	if (sec_tsp_log_fmt_is_static(fmt)) {
+		va_list ap;
+		int words;
+
+		va_copy(ap, args);
+		words = vbin_printf(data, ARRAY_SIZE(data), fmt, ap);
+		va_end(ap);
+		if (words <= ARRAY_SIZE(data))
+			data_len = words * sizeof(u32);
+		else
+			flags |= TSP_LOG_REC_TEXT;
+	} else {
+		flags |= TSP_LOG_REC_TEXT;
+	}
+
+	if (flags & TSP_LOG_REC_TEXT)
+		data_len = vscnprintf((char *)data, sizeof(data), fmt, args);
+
+	size = ALIGN(sizeof(*rec) + ALIGN(msg_len, sizeof(u32)) + data_len,
+			sizeof(u64));
+
+	local_irq_save(irqflags);
+	ring = this_cpu_ptr(&sec_tsp_log_ring);
+	raw_spin_lock(&ring->lock);
+
+	rec = sec_tsp_log_reserve(ring, size);
+	if (rec) {
+		rec->ts_nsec = ts;
+		rec->fmt = (flags & TSP_LOG_REC_TEXT) ? NULL : fmt;
+		rec->text_len = (flags & TSP_LOG_REC_TEXT) ? data_len : 0;
+		rec->msg_len = msg_len;
+		rec->flags = flags;
+		memcpy(rec + 1, msg, msg_len);
+		memcpy((char *)(rec + 1) + ALIGN(msg_len, sizeof(u32)),
+				data, data_len);
+	} else {
+		ring->dropped++;
+	}
+
+	raw_spin_unlock(&ring->lock);
+	local_irq_restore(irqflags);
+}
+
+static void sec_tsp_log_printf(const char *msg, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	sec_tsp_log_store(msg, 0, fmt, args);
+	va_end(args);
+}
+
 void sec_debug_tsp_log(char *fmt, ...)
 {
 	va_list args;
-	char buf[TSP_BUF_SIZE];
-	int len = 0;
-	unsigned int idx;
-	unsigned long size;
 
 	/* In case of sec_tsp_log_setup is failed */
 	if (!sec_tsp_log_size)
 		return;
+
 	va_start(args, fmt);
-	vsnprintf(buf, sizeof(buf), fmt, args);
+	sec_tsp_log_store(NULL, TSP_LOG_REC_NEWLINE, fmt, args);
 	va_end(args);
-
-	idx = sec_tsp_log_index;
-	size = strlen(buf);
-
-	idx = sec_tsp_log_timestamp(idx);
-
-	/* Overflow buffer size */
-	if (idx + size > sec_tsp_log_size - 1) {
-		if (sec_tsp_log_index_fix + size > sec_tsp_log_size - 1)
-			return;
-		len = scnprintf(&sec_tsp_log_buf[sec_tsp_log_index_fix],
-				size + 1, "%s\n", buf);
-		sec_tsp_log_index = sec_tsp_log_index_fix + len;
-	} else {
-		len = scnprintf(&sec_tsp_log_buf[idx], size + 1, "%s\n", buf);
-		sec_tsp_log_index += len;
-	}
 }
 EXPORT_SYMBOL(sec_debug_tsp_log);
 
@@ -227,38 +352,14 @@ EXPORT_SYMBOL(sec_debug_tsp_raw_data);
 void sec_debug_tsp_log_msg(char *msg, char *fmt, ...)
 {
 	va_list args;
-	char buf[TSP_BUF_SIZE];
-	int len = 0;
-	unsigned int idx;
-	size_t size;
-	size_t size_dev_name;
 
 	/* In case of sec_tsp_log_setup is failed */
 	if (!sec_tsp_log_size)
 		return;
+
 	va_start(args, fmt);
-	vsnprintf(buf, sizeof(buf), fmt, args);
+	sec_tsp_log_store(msg, 0, fmt, args);
 	va_end(args);
-
-	idx = sec_tsp_log_index;
-	size = strlen(buf);
-	size_dev_name = strlen(msg);
-
-	idx = sec_tsp_log_timestamp(idx);
-
-	/* Overflow buffer size */
-	if (idx + size + size_dev_name + 3 + 1 > sec_tsp_log_size) {
-		if (sec_tsp_log_index_fix + size + size_dev_name
-				> sec_tsp_log_size - 1)
-			return;
-		len = scnprintf(&sec_tsp_log_buf[sec_tsp_log_index_fix],
-			size + size_dev_name + 3 + 1, "%s : %s", msg, buf);
-		sec_tsp_log_index = sec_tsp_log_index_fix + len;
-	} else {
-		len = scnprintf(&sec_tsp_log_buf[idx],
-			size + size_dev_name + 3 + 1, "%s : %s", msg, buf);
-		sec_tsp_log_index += len;
-	}
 }
 EXPORT_SYMBOL(sec_debug_tsp_log_msg);
 
@@ -406,32 +507,32 @@ EXPORT_SYMBOL(sec_tsp_raw_data_clear);
 
 void sec_tsp_log_fix(void)
 {
-	char *buf = "FIX LOG!\n";
-	int len = 0;
-	unsigned int idx;
-	size_t size;
+	struct sec_tsp_log_ring *ring;
+	unsigned long flags;
+	int cpu;
 
 	/* In case of sec_tsp_log_setup is failed */
 	if (!sec_tsp_log_size)
 		return;
 
-	idx = sec_tsp_log_index;
-	size = strlen(buf);
-
-	idx = sec_tsp_log_timestamp(idx);
-
-	/* Overflow buffer size */
-	if (idx + size > sec_tsp_log_size - 1) {
-		if (sec_tsp_log_index_fix + size > sec_tsp_log_size - 1)
-			return;
-		len = scnprintf(&sec_tsp_log_buf[sec_tsp_log_index_fix],
-				size + 1, "%s", buf);
-		sec_tsp_log_index = sec_tsp_log_index_fix + len;
-	} else {
-		len = scnprintf(&sec_tsp_log_buf[idx], size + 1, "%s", buf);
-		sec_tsp_log_index += len;
+	sec_tsp_log_printf(NULL, "FIX LOG!\n");
+
+	/*
+	 * Pin what every ring holds so far below its base. A ring that has
+	 * already overwritten records or has less than half of it left
+	 * stays as it is, so later logs are never starved.
+	 */
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(&sec_tsp_log_ring, cpu);
+		raw_spin_lock_irqsave(&ring->lock, flags);
+		if (!ring->overwritten &&
+				sec_tsp_log_size - ring->next_idx >= sec_tsp_log_size / 2) {
+			ring->base = ring->next_idx;
+			ring->first_idx = ring->next_idx;
+			ring->first_seq = ring->next_seq;
+		}
+		raw_spin_unlock_irqrestore(&ring->lock, flags);
 	}
-	sec_tsp_log_index_fix = sec_tsp_log_index;
 }
 EXPORT_SYMBOL(sec_tsp_log_fix);
 
@@ -506,23 +607,230 @@ out:
 	return ret;
 }
 
-static ssize_t sec_tsp_log_read(struct file *file, char __user *buf,
-					size_t len, loff_t *offset)
+struct sec_tsp_log_cursor {
+	u32 idx;
+	u32 base;
+	u32 first_idx;
+	u64 left;		/* ring records still to be shown */
+	bool pinned;		/* still walking the pinned records */
+};
+
+struct sec_tsp_log_snapshot {
+	char *buf;
+	struct sec_tsp_log_cursor *start;
+	struct sec_tsp_log_cursor *cur;
+	loff_t pos;
+	unsigned long dropped;
+	char line[TSP_BUF_SIZE];
+};
+
+static char *sec_tsp_log_snap_ring(struct sec_tsp_log_snapshot *snap, int cpu)
 {
-	loff_t pos = *offset;
-	ssize_t count;
+	return snap->buf + (size_t)cpu * sec_tsp_log_size;
+}
 
-	if (!sec_tsp_log_buf)
-		return 0;
+static struct sec_tsp_log_rec *sec_tsp_log_cursor_rec(struct sec_tsp_log_snapshot *snap,
+		int cpu)
+{
+	struct sec_tsp_log_cursor *c = &snap->cur[cpu];
+	char *buf = sec_tsp_log_snap_ring(snap, cpu);
+	struct sec_tsp_log_rec *rec;
+
+	if (c->pinned) {
+		if (c->idx < c->base)
+			return (struct sec_tsp_log_rec *)(buf + c->idx);
+		c->pinned = false;
+		c->idx = c->first_idx;
+	}
+
+	if (!c->left)
+		return NULL;
+
+	rec = (struct sec_tsp_log_rec *)(buf + c->idx);
+	if (!rec->len) {
+		c->idx = c->base;
+		rec = (struct sec_tsp_log_rec *)(buf + c->idx);
+	}
 
-	if (pos >= sec_tsp_log_index)
+	return rec;
+}
+
+/* Oldest record over all CPUs, or -1 once every ring is exhausted */
+static int sec_tsp_log_oldest(struct sec_tsp_log_snapshot *snap)
+{
+	struct sec_tsp_log_rec *rec, *oldest = NULL;
+	int cpu, oldest_cpu = -1;
+
+	for_each_possible_cpu(cpu) {
+		rec = sec_tsp_log_cursor_rec(snap, cpu);
+		if (rec && (!oldest || rec->ts_nsec < oldest->ts_nsec)) {
+			oldest = rec;
+			oldest_cpu = cpu;
+		}
+	}
+
+	return oldest_cpu;
+}
+
+static void sec_tsp_log_advance(struct sec_tsp_log_snapshot *snap, int cpu)
+{
+	struct sec_tsp_log_cursor *c = &snap->cur[cpu];
+	struct sec_tsp_log_rec *rec = sec_tsp_log_cursor_rec(snap, cpu);
+
+	c->idx += rec->len;
+	if (!c->pinned)
+		c->left--;
+}
+
+static void *sec_tsp_log_seq_start(struct seq_file *m, loff_t *pos)
+{
+	struct sec_tsp_log_snapshot *snap = m->private;
+	int cpu;
+
+	if (!*pos)
+		return SEQ_START_TOKEN;
+
+	/* seq_file restarts at the record it could not fit last time */
+	if (*pos < snap->pos) {
+		memcpy(snap->cur, snap->start, nr_cpu_ids * sizeof(*snap->cur));
+		snap->pos = 1;
+	}
+
+	for (; snap->pos < *pos; snap->pos++) {
+		cpu = sec_tsp_log_oldest(snap);
+		if (cpu < 0)
+			return NULL;
+		sec_tsp_log_advance(snap, cpu);
+	}
+
+	cpu = sec_tsp_log_oldest(snap);
+
+	return cpu < 0 ? NULL : sec_tsp_log_cursor_rec(snap, cpu);
+}
+
+static void *sec_tsp_log_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct sec_tsp_log_snapshot *snap = m->private;
+	int cpu;
+
+	if (v != SEQ_START_TOKEN) {
+		sec_tsp_log_advance(snap, sec_tsp_log_oldest(snap));
+		snap->pos++;
+	}
+	++*pos;
+
+	cpu = sec_tsp_log_oldest(snap);
+
+	return cpu < 0 ? NULL : sec_tsp_log_cursor_rec(snap, cpu);
+}
+
+static void sec_tsp_log_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static int sec_tsp_log_seq_show(struct seq_file *m, void *v)
+{
+	struct sec_tsp_log_snapshot *snap = m->private;
+	struct sec_tsp_log_rec *rec = v;
+	char *payload;
+	unsigned long long t;
+	unsigned long nanosec_rem;
+
+	if (v == SEQ_START_TOKEN) {
+		if (snap->dropped)
+			seq_printf(m, "[sec_input] %lu tsp logs overwritten\n",
+					snap->dropped);
 		return 0;
+	}
 
-	count = min(len, (size_t)(sec_tsp_log_index - pos));
-	if (copy_to_user(buf, sec_tsp_log_buf + pos, count))
-		return -EFAULT;
-	*offset += count;
-	return count;
+	t = rec->ts_nsec;
+	nanosec_rem = do_div(t, 1000000000);
+	seq_printf(m, "[%5lu.%06lu] ", (unsigned long)t, nanosec_rem / 1000);
+
+	payload = (char *)(rec + 1);
+	if (rec->msg_len)
+		seq_printf(m, "%.*s : ", rec->msg_len, payload);
+	payload += ALIGN(rec->msg_len, sizeof(u32));
+
+	if (rec->flags & TSP_LOG_REC_TEXT) {
+		seq_write(m, payload, rec->text_len);
+	} else {
+		bstr_printf(snap->line, sizeof(snap->line), rec->fmt,
+				(const u32 *)payload);
+		seq_puts(m, snap->line);
+	}
+
+	/* sec_debug_tsp_log() has always terminated its lines itself */
+	if (rec->flags & TSP_LOG_REC_NEWLINE)
+		seq_putc(m, '\n');
+
+	return 0;
+}
+
+static const struct seq_operations sec_tsp_log_seq_ops = {
+	.start = sec_tsp_log_seq_start,
+	.next = sec_tsp_log_seq_next,
+	.stop = sec_tsp_log_seq_stop,
+	.show = sec_tsp_log_seq_show,
+};
+
+static int sec_tsp_log_open(struct inode *inode, struct file *file)
+{
+	struct sec_tsp_log_snapshot *snap;
+	struct sec_tsp_log_ring *ring;
+	struct sec_tsp_log_cursor *c;
+	unsigned long flags;
+	int cpu;
+
+	if (!sec_tsp_log_buf)
+		return -ENOENT;
+
+	snap = __seq_open_private(file, &sec_tsp_log_seq_ops, sizeof(*snap));
+	if (!snap)
+		return -ENOMEM;
+
+	snap->buf = vmalloc((size_t)nr_cpu_ids * sec_tsp_log_size);
+	snap->start = kcalloc(nr_cpu_ids, sizeof(*snap->start), GFP_KERNEL);
+	snap->cur = kcalloc(nr_cpu_ids, sizeof(*snap->cur), GFP_KERNEL);
+	if (!snap->buf || !snap->start || !snap->cur) {
+		vfree(snap->buf);
+		kfree(snap->start);
+		kfree(snap->cur);
+		seq_release_private(inode, file);
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(&sec_tsp_log_ring, cpu);
+		c = &snap->start[cpu];
+
+		raw_spin_lock_irqsave(&ring->lock, flags);
+		memcpy(sec_tsp_log_snap_ring(snap, cpu), ring->buf,
+				sec_tsp_log_size);
+		c->base = ring->base;
+		c->first_idx = ring->first_idx;
+		c->left = ring->next_seq - ring->first_seq;
+		snap->dropped += ring->dropped;
+		raw_spin_unlock_irqrestore(&ring->lock, flags);
+
+		c->pinned = true;
+	}
+	memcpy(snap->cur, snap->start, nr_cpu_ids * sizeof(*snap->cur));
+	snap->pos = 1;
+
+	return 0;
+}
+
+static int sec_tsp_log_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+	struct sec_tsp_log_snapshot *snap = m->private;
+
+	vfree(snap->buf);
+	kfree(snap->start);
+	kfree(snap->cur);
+
+	return seq_release_private(inode, file);
 }
 
 #ifdef CONFIG_TOUCHSCREEN_DUAL_FOLDABLE
@@ -599,9 +907,11 @@ static ssize_t sec_tsp_command_history_read(struct file *file, char __user *buf,
 
 static const struct file_operations tsp_msg_file_ops = {
 	.owner = THIS_MODULE,
-	.read = sec_tsp_log_read,
+	.open = sec_tsp_log_open,
+	.read = seq_read,
 	.write = sec_tsp_log_write,
-	.llseek = generic_file_llseek,
+	.llseek = seq_lseek,
+	.release = sec_tsp_log_release,
 };
 
 static const struct file_operations tsp_raw_data_file_ops = {
@@ -631,7 +941,7 @@ static int __init sec_tsp_log_late_init(void)
 		return 0;
 	}
 
-	proc_set_size(entry, sec_tsp_log_size);
+	proc_set_size(entry, SEC_TSP_LOG_BUF_SIZE);
 	return 0;
 }
 late_initcall(sec_tsp_log_late_init);
@@ -678,17 +988,29 @@ late_initcall(sec_tsp_command_history_late_init);
 
 static int __init __init_sec_tsp_log(void)
 {
+	struct sec_tsp_log_ring *ring;
+	unsigned int size;
 	char *vaddr;
+	int cpu;
 
-	sec_tsp_log_size = SEC_TSP_LOG_BUF_SIZE;
-	vaddr = kmalloc(sec_tsp_log_size, GFP_KERNEL);
+	/* the budget is split between the CPUs, records are never split */
+	size = round_down(SEC_TSP_LOG_BUF_SIZE / num_possible_cpus(),
+			sizeof(u64));
+	vaddr = kzalloc((size_t)size * nr_cpu_ids, GFP_KERNEL);
 
 	if (!vaddr) {
 		pr_info("%s: ERROR! init failed!\n", __func__);
 		return -ENOMEM;
 	}
 
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(&sec_tsp_log_ring, cpu);
+		raw_spin_lock_init(&ring->lock);
+		ring->buf = vaddr + (size_t)cpu * size;
+	}
+
 	sec_tsp_log_buf = vaddr;
+	sec_tsp_log_size = size;
 
 	pr_info("%s: init done\n", __func__);
 
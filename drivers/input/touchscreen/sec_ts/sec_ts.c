@@ -88,6 +88,14 @@ static ssize_t sec_ts_regread_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
 static ssize_t sec_ts_gesture_status_show(struct device *dev,
 		struct device_attribute *attr, char *buf);
+static ssize_t sec_ts_latency_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+static ssize_t sec_ts_latency_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size);
+static ssize_t sec_ts_burst_read_show(struct device *dev,
+		struct device_attribute *attr, char *buf);
+static ssize_t sec_ts_burst_read_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t size);
 static inline ssize_t sec_ts_show_error(struct device *dev,
 		struct device_attribute *attr, char *buf);
 
@@ -96,6 +104,8 @@ static DEVICE_ATTR(sec_ts_regreadsize, (S_IWUSR | S_IWGRP), NULL, sec_ts_regread
 static DEVICE_ATTR(sec_ts_enter_recovery, (S_IWUSR | S_IWGRP), NULL, sec_ts_enter_recovery_store);
 static DEVICE_ATTR(sec_ts_regread, S_IRUGO, sec_ts_regread_show, NULL);
 static DEVICE_ATTR(sec_ts_gesture_status, S_IRUGO, sec_ts_gesture_status_show, NULL);
+static DEVICE_ATTR(sec_ts_latency, (S_IRUGO | S_IWUSR | S_IWGRP), sec_ts_latency_show, sec_ts_latency_store);
+static DEVICE_ATTR(sec_ts_burst_read, (S_IRUGO | S_IWUSR | S_IWGRP), sec_ts_burst_read_show, sec_ts_burst_read_store);
 
 static struct attribute *cmd_attributes[] = {
 	&dev_attr_sec_ts_reg.attr,
@@ -103,6 +113,8 @@ static struct attribute *cmd_attributes[] = {
 	&dev_attr_sec_ts_enter_recovery.attr,
 	&dev_attr_sec_ts_regread.attr,
 	&dev_attr_sec_ts_gesture_status.attr,
+	&dev_attr_sec_ts_latency.attr,
+	&dev_attr_sec_ts_burst_read.attr,
 	NULL,
 };
 
@@ -870,6 +882,36 @@ int sec_ts_read_calibration_report(struct sec_ts_data *ts)
 }
 
 #define MAX_EVENT_COUNT 32
+
+/* events read at once in burst mode: all fingers plus one status event */
+#define SEC_TS_BURST_EVENT_COUNT	(MAX_SUPPORT_TOUCH_COUNT + 1)
+
+static irqreturn_t sec_ts_irq_hardirq(int irq, void *ptr)
+{
+	struct sec_ts_data *ts = (struct sec_ts_data *)ptr;
+
+	ts->latency.irq_ns = ktime_get_ns();
+
+	return IRQ_WAKE_THREAD;
+}
+
+static void sec_ts_latency_mark(struct sec_ts_data *ts, enum sec_ts_lat_stage stage)
+{
+	struct sec_ts_latency *lat = &ts->latency;
+	u64 delta_us;
+	int bucket;
+
+	if (!lat->irq_ns)
+		return;
+
+	delta_us = div_u64(ktime_get_ns() - lat->irq_ns, NSEC_PER_USEC);
+	bucket = delta_us ? min_t(int, ilog2(delta_us) + 1, SEC_TS_LAT_BUCKETS - 1) : 0;
+
+	lat->hist[stage][bucket]++;
+	lat->total_us[stage] += delta_us;
+	lat->count[stage]++;
+}
+
 static void sec_ts_read_event(struct sec_ts_data *ts)
 {
 	int ret;
@@ -884,6 +926,7 @@ static void sec_ts_read_event(struct sec_ts_data *ts)
 	struct sec_ts_event_status *p_event_status;
 	int curr_pos;
 	int remain_event_count = 0;
+	int read_count;
 	struct sec_ts_plat_data *pdata = ts->plat_data;
 
 	/* in LPM, waiting blsp block resume */
@@ -907,8 +950,15 @@ static void sec_ts_read_event(struct sec_ts_data *ts)
 	}
 
 	ret = t_id = event_id = curr_pos = remain_event_count = 0;
+	/*
+	 * In burst mode, the first event and as many following events as a
+	 * full multi touch frame can carry come in a single transaction.
+	 * Only events beyond that need the READ_ALL_EVENT transaction.
+	 */
+	read_count = ts->burst_read ? SEC_TS_BURST_EVENT_COUNT : 1;
 	/* repeat READ_ONE_EVENT until buffer is empty(No event) */
-	ret = sec_ts_i2c_read(ts, SEC_TS_READ_ONE_EVENT, (u8*)read_event_buff[0], SEC_TS_EVENT_BUFF_SIZE);
+	ret = sec_ts_i2c_read(ts, SEC_TS_READ_ONE_EVENT, (u8*)read_event_buff[0],
+			SEC_TS_EVENT_BUFF_SIZE * read_count);
 	if (ret < 0) {
 		input_err(true, &ts->client->dev, "%s: i2c read one event failed\n", __func__);
 		return;
@@ -932,15 +982,17 @@ static void sec_ts_read_event(struct sec_ts_data *ts)
 		return;
 	}
 
-	if (left_event_count > 0) {
-		ret = sec_ts_i2c_read(ts, SEC_TS_READ_ALL_EVENT, (u8*)read_event_buff[1],
-				sizeof(u8) * (SEC_TS_EVENT_BUFF_SIZE) * (left_event_count));
+	if (left_event_count > read_count - 1) {
+		ret = sec_ts_i2c_read(ts, SEC_TS_READ_ALL_EVENT, (u8*)read_event_buff[read_count],
+				sizeof(u8) * (SEC_TS_EVENT_BUFF_SIZE) * (left_event_count - read_count + 1));
 		if (ret < 0) {
 			input_err(true, &ts->client->dev, "%s: i2c read one event failed\n", __func__);
 			return;
 		}
 	}
 
+	sec_ts_latency_mark(ts, SEC_TS_LAT_BUS);
+
 	do {
 		event_buff = read_event_buff[curr_pos];
 		event_id = event_buff[0] & 0x3;
@@ -1239,6 +1291,7 @@ static void sec_ts_read_event(struct sec_ts_data *ts)
 	} while (remain_event_count >= 0);
 
 	input_sync(ts->input_dev);
+	sec_ts_latency_mark(ts, SEC_TS_LAT_SYNC);
 }
 
 static irqreturn_t sec_ts_irq_thread(int irq, void *ptr)
@@ -1259,7 +1312,9 @@ static irqreturn_t sec_ts_irq_thread(int irq, void *ptr)
 
 	mutex_lock(&ts->eventlock);
 
+	sec_ts_latency_mark(ts, SEC_TS_LAT_THREAD);
 	sec_ts_read_event(ts);
+	ts->latency.irq_ns = 0;
 
 	mutex_unlock(&ts->eventlock);
 
@@ -1514,6 +1569,63 @@ static ssize_t sec_ts_gesture_status_show(struct device *dev, struct device_attr
 	return sizeof(ts->gesture_status);
 }
 
+static ssize_t sec_ts_latency_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	static const char * const stage_names[SEC_TS_LAT_MAX] = { "thread", "bus", "sync" };
+	struct sec_ts_data *ts = dev_get_drvdata(dev);
+	struct sec_ts_latency *lat = &ts->latency;
+	int stage, bucket;
+	int len = 0;
+
+	for (stage = 0; stage < SEC_TS_LAT_MAX; stage++) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s count %u avg_us %llu:",
+				stage_names[stage], lat->count[stage],
+				lat->count[stage] ? div_u64(lat->total_us[stage], lat->count[stage]) : 0);
+		for (bucket = 0; bucket < SEC_TS_LAT_BUCKETS; bucket++)
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %u", lat->hist[stage][bucket]);
+		len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+
+	return len;
+}
+
+static ssize_t sec_ts_latency_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct sec_ts_data *ts = dev_get_drvdata(dev);
+
+	/* any write clears the histograms */
+	mutex_lock(&ts->eventlock);
+	memset(ts->latency.hist, 0, sizeof(ts->latency.hist));
+	memset(ts->latency.total_us, 0, sizeof(ts->latency.total_us));
+	memset(ts->latency.count, 0, sizeof(ts->latency.count));
+	mutex_unlock(&ts->eventlock);
+
+	return size;
+}
+
+static ssize_t sec_ts_burst_read_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct sec_ts_data *ts = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%d\n", ts->burst_read);
+}
+
+static ssize_t sec_ts_burst_read_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+	struct sec_ts_data *ts = dev_get_drvdata(dev);
+	bool enable;
+
+	if (strtobool(buf, &enable))
+		return -EINVAL;
+
+	mutex_lock(&ts->eventlock);
+	ts->burst_read = enable;
+	mutex_unlock(&ts->eventlock);
+
+	input_info(true, &ts->client->dev, "%s: %d\n", __func__, enable);
+	return size;
+}
+
 static ssize_t sec_ts_regreadsize_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
 {
 	lv1cmd = buf[0];
@@ -1771,6 +1883,7 @@ static int sec_ts_parse_dt(struct i2c_client *client)
 	pdata->max_y = coords[1] - 1;
 
 	of_property_read_u32(np, "sec,grip_area", &pdata->grip_area);
+	of_property_read_u32(np, "sec,burst_read", &pdata->burst_read);
 
 #ifdef PAT_CONTROL
 	if (of_property_read_u32(np, "sec,pat_function", &pdata->pat_function) < 0) {
@@ -2097,6 +2210,7 @@ static int sec_ts_probe(struct i2c_client *client, const struct i2c_device_id *i
 	ts->sec_ts_i2c_write_burst = sec_ts_i2c_write_burst;
 	ts->sec_ts_i2c_read_bulk = sec_ts_i2c_read_bulk;
 	ts->i2c_burstmax = pdata->i2c_burstmax;
+	ts->burst_read = !!pdata->burst_read;
 #ifdef USE_RESET_DURING_POWER_ON
 	INIT_DELAYED_WORK(&ts->reset_work, sec_ts_reset_work);
 #endif
@@ -2286,7 +2400,7 @@ static int sec_ts_probe(struct i2c_client *client, const struct i2c_device_id *i
 
 	input_info(true, &ts->client->dev, "sec_ts_probe request_irq = %d\n" , client->irq);
 
-	ret = request_threaded_irq(client->irq, NULL, sec_ts_irq_thread,
+	ret = request_threaded_irq(client->irq, sec_ts_irq_hardirq, sec_ts_irq_thread,
 			ts->plat_data->irq_type, SEC_TS_I2C_NAME, ts);
 	if (ret < 0) {
 		input_err(true, &ts->client->dev, "sec_ts_probe: Unable to request threaded irq\n");
@@ -510,6 +510,26 @@ struct sec_ts_coordinate {
 };
 
 
+/*
+ * Touch latency, measured from the hard irq to each later stage of the
+ * event handling. Bucket 0 is < 1us, bucket n is [2^(n-1), 2^n) us.
+ */
+#define SEC_TS_LAT_BUCKETS	16
+
+enum sec_ts_lat_stage {
+	SEC_TS_LAT_THREAD,	/* irq thread started */
+	SEC_TS_LAT_BUS,		/* events read from the IC */
+	SEC_TS_LAT_SYNC,	/* input_sync() done */
+	SEC_TS_LAT_MAX,
+};
+
+struct sec_ts_latency {
+	u64 irq_ns;
+	u32 hist[SEC_TS_LAT_MAX][SEC_TS_LAT_BUCKETS];
+	u64 total_us[SEC_TS_LAT_MAX];
+	u32 count[SEC_TS_LAT_MAX];
+};
+
 struct sec_ts_data {
 	u32 isr_pin;
 
@@ -548,6 +568,9 @@ struct sec_ts_data {
 	struct mutex i2c_mutex;
 	struct mutex eventlock;
 
+	struct sec_ts_latency latency;
+	bool burst_read;
+
 	struct delayed_work work_read_nv;
 #ifdef USE_RESET_DURING_POWER_ON
 	struct delayed_work reset_work;
@@ -623,6 +646,7 @@ struct sec_ts_plat_data {
 	unsigned gpio;
 	int irq_type;
 	int i2c_burstmax;
+	int burst_read;
 	int always_lpmode;
 	int bringup;
 	int grip_concept;
@@ -11,6 +11,8 @@
 #include <linux/random.h>
 #include <linux/firmware.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sizes.h>
 #include <linux/kallsyms.h>
 #include <linux/stacktrace.h>
 
@@ -316,22 +318,130 @@ static void free_tracks(void)
 
 /*
  * Memory alloc, free
+ *
+ * A memory block hands out buffers from the bottom up. Freed buffers become
+ * holes that are merged with their free neighbours and kept in size class
+ * lists, so that they can be reused without resetting the whole block; a
+ * hole that reaches the top of the used area is given back to it instead.
+ */
+static struct kmem_cache *lib_buf_cache;
+
+/*
+ * The cache is created on first use and may be missing, so every descriptor
+ * remembers where it came from and is freed to the same place.
  */
+static struct lib_buf *lib_buf_alloc(void)
+{
+	struct lib_buf *buf;
+
+	if (lib_buf_cache) {
+		buf = kmem_cache_zalloc(lib_buf_cache, GFP_KERNEL);
+		if (buf)
+			buf->cached = true;
+		return buf;
+	}
+
+	return kzalloc(sizeof(struct lib_buf), GFP_KERNEL);
+}
+
+static void lib_buf_free(struct lib_buf *buf)
+{
+	if (buf->cached)
+		kmem_cache_free(lib_buf_cache, buf);
+	else
+		kfree(buf);
+}
+
+static int mblk_class(u32 size)
+{
+	return min_t(int, fls(size >> MEM_BLOCK_CLASS_SHIFT), MEM_BLOCK_NR_CLASSES - 1);
+}
+
+static void mblk_put_hole(struct lib_mem_block *mblk, struct lib_buf *hole)
+{
+	hole->hole = true;
+	list_add(&hole->list, &mblk->holes[mblk_class(hole->size)]);
+	mblk->hole_size += hole->size;
+}
+
+static void mblk_del_hole(struct lib_mem_block *mblk, struct lib_buf *hole)
+{
+	list_del(&hole->list);
+	mblk->hole_size -= hole->size;
+}
+
+static struct lib_buf *mblk_take_hole(struct lib_mem_block *mblk, u32 size)
+{
+	struct lib_buf *hole;
+	int class;
+
+	/* any hole of a higher class is big enough, so only the first can miss */
+	for (class = mblk_class(size); class < MEM_BLOCK_NR_CLASSES; class++) {
+		list_for_each_entry(hole, &mblk->holes[class], list) {
+			if (hole->size >= size) {
+				mblk_del_hole(mblk, hole);
+				return hole;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static u32 mblk_largest_hole(struct lib_mem_block *mblk)
+{
+	struct lib_buf *hole;
+	u32 largest = 0;
+	int class;
+
+	for (class = MEM_BLOCK_NR_CLASSES - 1; class >= 0 && !largest; class--)
+		list_for_each_entry(hole, &mblk->holes[class], list)
+			largest = max(largest, hole->size);
+
+	return largest;
+}
+
+static void mblk_drain(struct lib_mem_block *mblk)
+{
+	struct lib_buf *buf, *temp;
+
+	list_for_each_entry_safe(buf, temp, &mblk->extents, extent) {
+		list_del(&buf->extent);
+		lib_buf_free(buf);
+	}
+}
+
 static void mblk_init(struct lib_mem_block *mblk, struct fimc_is_priv_buf *pb,
 	u32 type, const char *name)
 {
+	int i;
+
 	if (!mblk || !pb) {
 		warn_lib("Invalid argument. mblk %p pb %p\n", mblk, pb);
 		return;
 	}
 
+	if (!lib_buf_cache) {
+		lib_buf_cache = KMEM_CACHE(lib_buf, 0);
+		if (!lib_buf_cache)
+			warn_lib("failed to create a library buffer cache");
+	}
+
+	/* descriptors left over from the previous use of this block */
+	if (mblk->extents.next)
+		mblk_drain(mblk);
+
 	spin_lock_init(&mblk->lock);
 	INIT_LIST_HEAD(&mblk->list);
+	INIT_LIST_HEAD(&mblk->extents);
+	for (i = 0; i < MEM_BLOCK_NR_CLASSES; i++)
+		INIT_LIST_HEAD(&mblk->holes[i]);
 	mblk->align = pb->align;
 	mblk->kva_base = CALL_BUFOP(pb, kvaddr, pb);
 	mblk->dva_base = CALL_BUFOP(pb, dvaddr, pb);
 	mblk->pb = pb;
 	mblk->end = 0;
+	mblk->hole_size = 0;
 	strlcpy(mblk->name, name, sizeof(mblk->name));
 	mblk->type = type;
 
@@ -348,7 +458,7 @@ static void mblk_init(struct lib_mem_block *mblk, struct fimc_is_priv_buf *pb,
 
 static void *alloc_from_mblk(struct lib_mem_block *mblk, u32 size)
 {
-	struct lib_buf *buf;
+	struct lib_buf *buf, *spare;
 	unsigned long flag;
 
 	if (!size) {
@@ -356,36 +466,61 @@ static void *alloc_from_mblk(struct lib_mem_block *mblk, u32 size)
 		return NULL;
 	}
 
-	buf = kzalloc(sizeof(struct lib_buf), GFP_KERNEL);
-	if (!buf) {
+	/* a descriptor for either a new buffer or the rest of a split hole */
+	spare = lib_buf_alloc();
+	if (!spare) {
 		err_lib("failed to allocate a library buffer");
 		return NULL;
 	}
 
+	size = mblk->align ? ALIGN(size, mblk->align) : size;
+
 	spin_lock_irqsave(&mblk->lock, flag);
-	if ((mblk->end + size) > mblk->pb->size) {
+	buf = mblk_take_hole(mblk, size);
+	if (buf) {
+		if (buf->size > size) {
+			spare->kva = buf->kva + size;
+			spare->dva = buf->dva + size;
+			spare->size = buf->size - size;
+			spare->priv = mblk;
+			list_add(&spare->extent, &buf->extent);
+			mblk_put_hole(mblk, spare);
+			spare = NULL;
+
+			buf->size = size;
+		}
+	} else if ((mblk->end + size) > mblk->pb->size) {
+		u32 hole_size = mblk->hole_size;
+		u32 largest = mblk_largest_hole(mblk);
+
 		spin_unlock_irqrestore(&mblk->lock, flag);
-		kfree(buf);
+		lib_buf_free(spare);
 
-		err_lib("out of (%s) memory block, available: %zu, request: %d",
-			mblk->name, mblk->pb->size - mblk->end, size);
+		err_lib("out of (%s) memory block, available: %zu, request: %d, holes: %d (largest %d)",
+			mblk->name, mblk->pb->size - mblk->end, size,
+			hole_size, largest);
 		return NULL;
 	} else {
+		buf = spare;
+		spare = NULL;
+
 		buf->kva = mblk->kva_base + mblk->end;
 		buf->dva = mblk->dva_base + mblk->end;
-		buf->size = mblk->align ? ALIGN(size, mblk->align) : size;
+		buf->size = size;
 		buf->priv = mblk;
+		list_add_tail(&buf->extent, &mblk->extents);
 
-		mblk->used += buf->size;
 		mblk->end += buf->size;
-
-		spin_unlock_irqrestore(&mblk->lock, flag);
 	}
 
-	spin_lock_irqsave(&mblk->lock, flag);
+	buf->hole = false;
 	list_add(&buf->list, &mblk->list);
+	mblk->used += buf->size;
 	spin_unlock_irqrestore(&mblk->lock, flag);
 
+	if (spare)
+		lib_buf_free(spare);
+
 	dbg_lib(3, "allocated memory info (%s)\n", mblk->name);
 	dbg_lib(3, "\tkva: 0x%lx, dva: %pad, size: %d\n",
 			buf->kva, &buf->dva, buf->size);
@@ -410,7 +545,7 @@ static void *alloc_from_mblk(struct lib_mem_block *mblk, u32 size)
 
 static void free_to_mblk(struct lib_mem_block *mblk, void *kva)
 {
-	struct lib_buf *buf, *temp;
+	struct lib_buf *buf, *temp, *next, *prev;
 	unsigned long flag;
 
 	if (!kva)
@@ -420,7 +555,6 @@ static void free_to_mblk(struct lib_mem_block *mblk, void *kva)
 	list_for_each_entry_safe(buf, temp, &mblk->list, list) {
 		if ((void *)buf->kva == kva) {
 			mblk->used -= buf->size;
-			mblk->end -= buf->size;
 #ifdef LIB_MEM_TRACK
 			add_free_track(mblk->type, buf->kva);
 #endif
@@ -440,7 +574,35 @@ static void free_to_mblk(struct lib_mem_block *mblk, void *kva)
 					buf->kva, &buf->dva, buf->size);
 
 			list_del(&buf->list);
-			kfree(buf);
+
+			if (!list_is_last(&buf->extent, &mblk->extents)) {
+				next = list_next_entry(buf, extent);
+				if (next->hole) {
+					mblk_del_hole(mblk, next);
+					buf->size += next->size;
+					list_del(&next->extent);
+					lib_buf_free(next);
+				}
+			}
+
+			if (buf->extent.prev != &mblk->extents) {
+				prev = list_prev_entry(buf, extent);
+				if (prev->hole) {
+					mblk_del_hole(mblk, prev);
+					prev->size += buf->size;
+					list_del(&buf->extent);
+					lib_buf_free(buf);
+					buf = prev;
+				}
+			}
+
+			if (list_is_last(&buf->extent, &mblk->extents)) {
+				mblk->end -= buf->size;
+				list_del(&buf->extent);
+				lib_buf_free(buf);
+			} else {
+				mblk_put_hole(mblk, buf);
+			}
 
 			break;
 		}
@@ -448,6 +610,96 @@ static void free_to_mblk(struct lib_mem_block *mblk, void *kva)
 	spin_unlock_irqrestore(&mblk->lock, flag);
 }
 
+#ifdef LIB_MEM_SELFTEST
+/*
+ * Drives a simulated memory block through a series of sensor mode switches
+ * and reports how fragmented it gets. Every mode frees the buffers of the
+ * previous one and allocates its own set of sizes, the way the library does
+ * on stream off and on. Each mode also leaves a buffer above its own ones
+ * that lives for MBLK_SELFTEST_LIFETIME switches, which pins the holes below.
+ */
+#define MBLK_SELFTEST_SIZE	(8 * SZ_1M)
+#define MBLK_SELFTEST_SWITCHES	32
+#define MBLK_SELFTEST_BUFS	24
+#define MBLK_SELFTEST_LIFETIME	3
+
+static void mblk_selftest(void)
+{
+	static const u32 mode_sizes[][4] = {
+		{ SZ_256K, SZ_64K, 3 * SZ_4K, 200 },	/* preview */
+		{ SZ_512K, SZ_128K, SZ_16K, 1000 },	/* capture */
+		{ 3 * SZ_64K, SZ_32K, 5 * SZ_4K, 500 },	/* video */
+		{ SZ_128K, 48 * SZ_1K, SZ_8K, 64 },	/* fast AE */
+	};
+	struct fimc_is_priv_buf pb = { .size = MBLK_SELFTEST_SIZE };
+	struct lib_mem_block *mblk;
+	void *pinned[MBLK_SELFTEST_LIFETIME] = { NULL };
+	void **bufs;
+	u32 seed = 1, size, hole_size, largest;
+	unsigned long flag;
+	int i, n, mode;
+
+	mblk = kzalloc(sizeof(*mblk), GFP_KERNEL);
+	bufs = kcalloc(MBLK_SELFTEST_BUFS, sizeof(*bufs), GFP_KERNEL);
+	if (!mblk || !bufs)
+		goto out;
+
+	spin_lock_init(&mblk->lock);
+	INIT_LIST_HEAD(&mblk->list);
+	INIT_LIST_HEAD(&mblk->extents);
+	for (i = 0; i < MEM_BLOCK_NR_CLASSES; i++)
+		INIT_LIST_HEAD(&mblk->holes[i]);
+	/* nothing is written to the buffers, the addresses only need to be unique */
+	mblk->kva_base = PAGE_SIZE;
+	mblk->dva_base = PAGE_SIZE;
+	mblk->pb = &pb;
+	strlcpy(mblk->name, "SELFTEST", sizeof(mblk->name));
+
+	for (n = 0; n < MBLK_SELFTEST_SWITCHES; n++) {
+		mode = n % ARRAY_SIZE(mode_sizes);
+
+		for (i = 0; i < MBLK_SELFTEST_BUFS; i++) {
+			free_to_mblk(mblk, bufs[i]);
+			bufs[i] = NULL;
+		}
+
+		for (i = 0; i < MBLK_SELFTEST_BUFS; i++) {
+			seed = seed * 1103515245 + 12345;
+			size = mode_sizes[mode][i % 4];
+			/* vary the sizes by up to 1/8 like tuning dependent buffers */
+			size += (seed >> 16) % (size / 8 + 1);
+			bufs[i] = alloc_from_mblk(mblk, size);
+		}
+
+		free_to_mblk(mblk, pinned[n % MBLK_SELFTEST_LIFETIME]);
+		pinned[n % MBLK_SELFTEST_LIFETIME] =
+			alloc_from_mblk(mblk, SZ_16K << mode);
+
+		spin_lock_irqsave(&mblk->lock, flag);
+		hole_size = mblk->hole_size;
+		largest = mblk_largest_hole(mblk);
+		spin_unlock_irqrestore(&mblk->lock, flag);
+
+		info_lib("mblk selftest switch %d mode %d: used %u end %u hole_size %u largest hole %u\n",
+			n, mode, mblk->used, mblk->end, hole_size, largest);
+	}
+
+	for (i = 0; i < MBLK_SELFTEST_BUFS; i++)
+		free_to_mblk(mblk, bufs[i]);
+	for (i = 0; i < MBLK_SELFTEST_LIFETIME; i++)
+		free_to_mblk(mblk, pinned[i]);
+
+	if (mblk->used || mblk->end || mblk->hole_size)
+		err_lib("mblk selftest leaked: used %u end %u hole_size %u",
+			mblk->used, mblk->end, mblk->hole_size);
+
+	mblk_drain(mblk);
+out:
+	kfree(bufs);
+	kfree(mblk);
+}
+#endif
+
 void *fimc_is_alloc_dma_taaisp(u32 size)
 {
 	struct fimc_is_lib_support *lib = &gPtr_lib_support;
@@ -2822,6 +3074,10 @@ int fimc_is_load_bin(void)
 #endif
 	mblk_init(&lib->mb_vra, lib->minfo->pb_vra, MT_TYPE_MB_VRA, "VRA");
 
+#ifdef LIB_MEM_SELFTEST
+	mblk_selftest();
+#endif
+
 	spin_lock_init(&lib->slock_nmb);
 	INIT_LIST_HEAD(&lib->list_of_nmb);
 
@@ -26,6 +26,9 @@
 /* #define LIB_MEM_TRACK */
 #endif
 
+/* reports memory block fragmentation over simulated mode switches on load */
+/* #define LIB_MEM_SELFTEST */
+
 #if defined(CONFIG_STACKTRACE) && defined(LIB_MEM_TRACK)
 #define LIB_MEM_TRACK_CALLSTACK
 #endif
@@ -176,11 +179,17 @@ struct lib_mem_tracks {
 #endif
 
 #define MEM_BLOCK_NAME_LEN	16
+/* free holes are kept in power-of-two size classes from 64 bytes */
+#define MEM_BLOCK_CLASS_SHIFT	6
+#define MEM_BLOCK_NR_CLASSES	16
 struct lib_mem_block {
 	spinlock_t		lock;
-	struct list_head	list;
+	struct list_head	list;	/* allocated buffers */
+	struct list_head	extents; /* buffers and holes below end, by address */
+	struct list_head	holes[MEM_BLOCK_NR_CLASSES];
 	u32			used;	/* size was allocated totally */
 	u32			end;	/* last allocation position */
+	u32			hole_size; /* size of freed holes below end */
 
 	size_t			align;
 	ulong			kva_base;
@@ -198,6 +207,10 @@ struct lib_buf {
 	dma_addr_t		dva;
 	struct list_head	list;
 	void			*priv;
+	/* memory block only */
+	struct list_head	extent;
+	bool			hole;
+	bool			cached;
 };
 
 struct general_intr_handler {
@@ -153,6 +153,8 @@ void smfc_hwconfigure_tables(struct smfc_ctx *ctx,
 	size_t i;
 	void __iomem *base = ctx->smfc->reg;
 
+	smfc_invalidate_tables(ctx->smfc);
+
 	if (qfactor > 0) {
 		qfactor = (qfactor < 50) ? 5000 / qfactor : 200 - qfactor * 2;
 		smfc_hwconfigure_qtable(base + REG_QTBL_BASE,
@@ -211,11 +213,20 @@ void smfc_hwconfigure_2nd_tables(struct smfc_ctx *ctx, unsigned int qfactor)
 
 void smfc_hwconfigure_tables_for_decompression(struct smfc_ctx *ctx)
 {
-	void __iomem *base = ctx->smfc->reg;
-	void __iomem *qtbl_base = ctx->smfc->reg + REG_QTBL_BASE;
+	struct smfc_dev *smfc = ctx->smfc;
+	void __iomem *base = smfc->reg;
+	void __iomem *qtbl_base = smfc->reg + REG_QTBL_BASE;
 	u32 tblsel = ctx->num_components << 16;
+	u32 qmask = 0;
+	bool programmed;
 	int i;
 
+	/* decompressing a series of JPEGs with the same tables */
+	programmed = (smfc->tables_owner == ctx) &&
+			(smfc->tables_gen == ctx->tables_gen);
+	if (!programmed)
+		smfc->tables_qmask = 0;
+
 	/* Huffman table selector configuration */
 	for (i = 0; i < ctx->num_components; i++) {
 		u32 val = (ctx->huffman_tables->compsel[i].idx_dc |
@@ -232,6 +243,10 @@ void smfc_hwconfigure_tables_for_decompression(struct smfc_ctx *ctx)
 			for (j = 0; j < SMFC_MCU_SIZE; j += 4) {
 				u32 quants;
 
+				/* already in the slot with the same tables */
+				if (smfc->tables_qmask & (1 << i))
+					break;
+
 				quants  = table[j + 0] << 0;
 				quants |= table[j + 1] << 8;
 				quants |= table[j + 2] << 16;
@@ -239,13 +254,14 @@ void smfc_hwconfigure_tables_for_decompression(struct smfc_ctx *ctx)
 				__raw_writel(quants,
 					qtbl_base + SMFC_MCU_SIZE * i + j);
 			}
+			qmask |= 1 << i;
 			/* quantization table selector */
 			tblsel |= ctx->quantizer_tables->compsel[i] << (i * 2);
 		}
 	}
 
 	/* Huffman table configuration */
-	for (i = 0; i < 4; i++) {
+	for (i = 0; !programmed && (i < 4); i++) {
 		__raw_writel(ctx->huffman_tables->dc[0].code32[i],
 				base + REG_HTBL_LUMA_DCLEN + i * sizeof(u32));
 		__raw_writel(ctx->huffman_tables->dc[0].value32[i],
@@ -260,7 +276,7 @@ void smfc_hwconfigure_tables_for_decompression(struct smfc_ctx *ctx)
 				base + REG_HTBL_CHROMA_ACLEN + i * sizeof(u32));
 	}
 
-	for (i = 0; i < (SMFC_NUM_AC_HVAL / 4); i++) {
+	for (i = 0; !programmed && (i < (SMFC_NUM_AC_HVAL / 4)); i++) {
 		__raw_writel(ctx->huffman_tables->ac[0].value32[i],
 				base + REG_HTBL_LUMA_ACVAL + i * sizeof(u32));
 		__raw_writel(ctx->huffman_tables->ac[1].value32[i],
@@ -268,6 +284,10 @@ void smfc_hwconfigure_tables_for_decompression(struct smfc_ctx *ctx)
 	}
 
 	__raw_writel(tblsel, base + REG_MAIN_TABLE_SELECT);
+
+	smfc->tables_owner = ctx;
+	smfc->tables_gen = ctx->tables_gen;
+	smfc->tables_qmask |= qmask;
 }
 
 static void smfc_hwconfigure_image_base(struct smfc_ctx *ctx,
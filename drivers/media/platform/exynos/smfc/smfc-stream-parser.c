@@ -22,23 +22,35 @@ static bool smfc_alloc_tables(struct smfc_ctx *ctx)
 {
 	int i;
 
+	/*
+	 * The tables are kept across the streams. They are cleared by
+	 * smfc_parse_tables() if the stream has different tables.
+	 */
 	if (!ctx->quantizer_tables) {
-		ctx->quantizer_tables = kmalloc(
+		ctx->quantizer_tables = kzalloc(
 				sizeof(*ctx->quantizer_tables), GFP_KERNEL);
 		if (!ctx->quantizer_tables)
 			return false;
 	}
-	memset(ctx->quantizer_tables, 0, sizeof(*ctx->quantizer_tables));
 	for (i = 0; i < SMFC_MAX_QTBL_COUNT; i++)
 		ctx->quantizer_tables->compsel[i] = INVALID_QTBLIDX;
 
 	if (!ctx->huffman_tables) {
-		ctx->huffman_tables = kmalloc(
+		ctx->huffman_tables = kzalloc(
 				sizeof(*ctx->huffman_tables), GFP_KERNEL);
 		if (!ctx->huffman_tables)
 			return false;
 	}
-	memset(ctx->huffman_tables, 0, sizeof(*ctx->huffman_tables));
+	memset(ctx->huffman_tables->compsel, 0,
+	       sizeof(ctx->huffman_tables->compsel));
+
+	if (!ctx->table_cache) {
+		ctx->table_cache = kzalloc(sizeof(*ctx->table_cache),
+					   GFP_KERNEL);
+		if (!ctx->table_cache)
+			return false;
+	}
+	ctx->table_cache->stage_len = 0;
 
 	return true;
 }
@@ -72,148 +84,70 @@ static int smfc_get_segment_length(struct smfc_ctx *ctx,
 	return 0;
 }
 
-#define __get_u16(pos)				\
-({						\
-	__typeof__(*(pos)) *__p = (pos);	\
-	u16 __v = (*__p++ << 8) & 0xFF00;	\
-	__v |= *__p++ & 0xFF;			\
-	pos = __p;				\
-	__v;					\
-})
-
-#define __halfbytes_larger_than(val, maxval) \
-			(max((val) & 0xF, ((val) >> 4) & 0xF) > (maxval))
-
-unsigned int smfc_get_num_huffval(u8 *hufflen)
-{
-	int i;
-	unsigned int num = 0;
-
-	for (i = 0; i < SMFC_NUM_HCODE; i++)
-		num += hufflen[i];
-
-	return num;
-}
-
-static int smfc_parse_dht(struct smfc_ctx *ctx, unsigned long *cursor)
+static int smfc_stage_table_segment(struct smfc_ctx *ctx,
+				    unsigned long *cursor, u8 marker)
 {
-	u8 __user *pcursor = (u8 __user *)*cursor;
-	unsigned long segend;
+	struct smfc_table_cache *cache = ctx->table_cache;
+	u8 *segment;
 	int ret;
 	u16 len;
 
-	ret = smfc_get_segment_length(ctx, *cursor, 0xc4, &len);
+	ret = smfc_get_segment_length(ctx, *cursor, marker, &len);
 	if (ret)
 		return ret;
 
-	segend = *cursor + len;
-	pcursor += 2;
-
-	/* 17 : TcTh, L1...L16 */
-	while (((unsigned long)pcursor) < (segend - 17)) {
-		u8 *table;
-		unsigned int num_values;
-		u8 tcth;
-		bool dc;
-
-		ret = get_user(tcth, pcursor++);
-		if (ret) {
-			dev_err(ctx->smfc->dev, "Failed to read TcTh in DHT\n");
-			return ret;
-		} else if (__halfbytes_larger_than(tcth, 1)) {
-			dev_err(ctx->smfc->dev,
-					"Unsupported TcTh %#x in DHT\n", tcth);
-			return -EINVAL;
-		}
-
-		/* HUFFLEN */
-		dc = (((tcth >> 4) & 0xF) == 0);
-		table = dc ? ctx->huffman_tables->dc[tcth & 1].code
-			   : ctx->huffman_tables->ac[tcth & 1].code;
-		ret = copy_from_user(table, pcursor, SMFC_NUM_HCODE);
-		pcursor += SMFC_NUM_HCODE;
-		if (ret) {
-			dev_err(ctx->smfc->dev,
-					"Failed to read HUFFLEN of %d,%d\n",
-					tcth >> 4, tcth & 1);
-			return ret;
-		}
-
-		num_values = smfc_get_num_huffval(table);
-		if ((dc && (num_values > SMFC_NUM_DC_HVAL)) ||
-				(!dc && (num_values > SMFC_NUM_AC_HVAL))) {
-			dev_err(ctx->smfc->dev,
-				"Too many values %u in huffman table %d,%d\n",
-				num_values, tcth >> 4, tcth & 1);
-			return -EINVAL;
-		}
-
-		if (((unsigned long)pcursor + num_values) > segend)
-			break;
-
-		/* HUFFVAL */
-		table = dc ? ctx->huffman_tables->dc[tcth & 1].value
-			   : ctx->huffman_tables->ac[tcth & 1].value;
-		ret = copy_from_user(table, pcursor, num_values);
-		pcursor += (unsigned long)num_values;
-		if (ret) {
-			dev_err(ctx->smfc->dev,
-				"Failed to read huffval of %d,%d\n",
-				tcth >> 4, tcth & 1);
-			return -EINVAL;
-		}
+	if (len < 2) {
+		dev_err(ctx->smfc->dev,
+			"Invalid length %u of 0xFF%02X\n", len, marker);
+		return -EINVAL;
 	}
 
-	if ((*cursor + len) != (unsigned long)pcursor) {
-		dev_err(ctx->smfc->dev, "Incorrect DHT length %d\n", len);
+	if ((cache->stage_len + len + 1) > sizeof(cache->stage)) {
+		dev_err(ctx->smfc->dev,
+			"Too large table segments with 0xFF%02X\n", marker);
 		return -EINVAL;
 	}
 
+	/* the marker is kept to distinguish DHT from DQT */
+	segment = cache->stage + cache->stage_len;
+	*segment++ = marker;
+	if (copy_from_user(segment, (void __user *)*cursor, len)) {
+		dev_err(ctx->smfc->dev,
+			"Failed to read segment 0xFF%02X\n", marker);
+		return -EFAULT;
+	}
+
+	cache->stage_len += len + 1;
 	*cursor += len;
 
 	return 0;
 }
 
-static int smfc_parse_dqt(struct smfc_ctx *ctx, unsigned long *cursor)
+/*
+ * Parses the DHT and DQT segments staged while scanning the JPEG header. A
+ * series of JPEG streams from the same encoder has the same tables. Then the
+ * tables parsed from the previous stream are reused and its generation is
+ * kept to let smfc_hwconfigure_tables_for_decompression() skip programming.
+ */
+static int smfc_parse_tables(struct smfc_ctx *ctx)
 {
-	u8 __user *pcursor = (u8 __user *)*cursor;
-	unsigned long segend;
+	struct smfc_table_cache *cache = ctx->table_cache;
 	int ret;
-	u16 len;
-
-	ret = smfc_get_segment_length(ctx, *cursor, 0xdb, &len);
-	if (ret)
-		return ret;
-
-	segend = *cursor + len;
-	pcursor += 2;
 
-	/* 17 : TcTh, L1...L16 */
-	while ((unsigned long)pcursor < segend) {
-		u8 pqtq;
+	if (smfc_table_cache_hit(cache))
+		return 0;
 
-		ret = get_user(pqtq, pcursor++);
-		if (ret) {
-			dev_err(ctx->smfc->dev, "Failed to read PqTq in DQT\n");
-			return ret;
-		} else if (pqtq >= SMFC_MAX_QTBL_COUNT) {
-			/* Pq should be 0, Tq should be < 4 */
-			dev_err(ctx->smfc->dev,
-					"Invalid PqTq %02xin DQT\n", pqtq);
-			return -EINVAL;
-		}
+	cache->valid = false;
+	ctx->tables_gen++;
 
-		ret = copy_from_user(ctx->quantizer_tables->table[pqtq],
-							pcursor, SMFC_MCU_SIZE);
-		pcursor += (unsigned long)SMFC_MCU_SIZE;
-		if (ret) {
-			dev_err(ctx->smfc->dev,
-				"Failed to read %dth Q-Table\n", pqtq);
-			return ret;
-		}
-	}
+	ret = smfc_parse_table_segments(ctx->smfc->dev, cache->stage,
+					cache->stage_len,
+					ctx->quantizer_tables,
+					ctx->huffman_tables);
+	if (ret)
+		return ret;
 
-	*cursor += len;
+	smfc_table_cache_update(cache);
 
 	return 0;
 }
@@ -400,12 +334,9 @@ int smfc_parse_jpeg_header(struct smfc_ctx *ctx, struct vb2_buffer *vb)
 
 		switch (marker.byte[1]) {
 		case 0xC4: /* DHT */
-			ret = smfc_parse_dht(ctx, &cursor);
-			if (ret)
-				return ret;
-			break;
 		case 0xDB: /* DQT */
-			ret = smfc_parse_dqt(ctx, &cursor);
+			ret = smfc_stage_table_segment(ctx, &cursor,
+						       marker.byte[1]);
 			if (ret)
 				return ret;
 			break;
@@ -415,6 +346,9 @@ int smfc_parse_jpeg_header(struct smfc_ctx *ctx, struct vb2_buffer *vb)
 				return ret;
 			break;
 		case 0xDA: /**** SOS - THE END OF HEADER PARSING ****/
+			ret = smfc_parse_tables(ctx);
+			if (ret)
+				return ret;
 			return smfc_parse_scanheader(ctx, streambase, &cursor);
 		case 0xD9: /* EOI */
 			dev_err(ctx->smfc->dev,
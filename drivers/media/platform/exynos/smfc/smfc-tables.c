@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2015 Samsung Electronics Co., Ltd.
+ *		http://www.samsung.com
+ *
+ * The JPEG table parser of Samsung Exynos SMFC Driver
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/device.h>
+
+#include "smfc-tables.h"
+
+unsigned int smfc_get_num_huffval(const u8 *hufflen)
+{
+	int i;
+	unsigned int num = 0;
+
+	for (i = 0; i < SMFC_NUM_HCODE; i++)
+		num += hufflen[i];
+
+	return num;
+}
+
+static int smfc_parse_dht(struct device *dev, const u8 *segment,
+			  struct smfc_decomp_htable *htbl)
+{
+	const u8 *pos = segment;
+	const u8 *segend;
+	u16 len;
+
+	len = __get_u16(pos);
+	segend = segment + len;
+
+	/* 17 : TcTh, L1...L16 */
+	while ((pos + 17) < segend) {
+		u8 *table;
+		unsigned int num_values;
+		u8 tcth = *pos++;
+		bool dc;
+
+		if (__halfbytes_larger_than(tcth, 1)) {
+			dev_err(dev, "Unsupported TcTh %#x in DHT\n", tcth);
+			return -EINVAL;
+		}
+
+		/* HUFFLEN */
+		dc = (((tcth >> 4) & 0xF) == 0);
+		table = dc ? htbl->dc[tcth & 1].code : htbl->ac[tcth & 1].code;
+		memcpy(table, pos, SMFC_NUM_HCODE);
+		pos += SMFC_NUM_HCODE;
+
+		num_values = smfc_get_num_huffval(table);
+		if ((dc && (num_values > SMFC_NUM_DC_HVAL)) ||
+				(!dc && (num_values > SMFC_NUM_AC_HVAL))) {
+			dev_err(dev,
+				"Too many values %u in huffman table %d,%d\n",
+				num_values, tcth >> 4, tcth & 1);
+			return -EINVAL;
+		}
+
+		if ((pos + num_values) > segend)
+			break;
+
+		/* HUFFVAL */
+		table = dc ? htbl->dc[tcth & 1].value
+			   : htbl->ac[tcth & 1].value;
+		memcpy(table, pos, num_values);
+		pos += num_values;
+	}
+
+	if (pos != segend) {
+		dev_err(dev, "Incorrect DHT length %d\n", len);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int smfc_parse_dqt(struct device *dev, const u8 *segment,
+			  struct smfc_decomp_qtable *qtbl)
+{
+	const u8 *pos = segment;
+	const u8 *segend;
+	u16 len;
+
+	len = __get_u16(pos);
+	segend = segment + len;
+
+	/* 65 : PqTq, Q0...Q63 */
+	while (pos < segend) {
+		u8 pqtq = *pos++;
+
+		if (pqtq >= SMFC_MAX_QTBL_COUNT) {
+			/* Pq should be 0, Tq should be < 4 */
+			dev_err(dev, "Invalid PqTq %02xin DQT\n", pqtq);
+			return -EINVAL;
+		}
+
+		if ((pos + SMFC_MCU_SIZE) > segend) {
+			dev_err(dev, "Incorrect DQT length %d\n", len);
+			return -EINVAL;
+		}
+
+		memcpy(qtbl->table[pqtq], pos, SMFC_MCU_SIZE);
+		pos += SMFC_MCU_SIZE;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns true if the staged segments are the same as the segments that the
+ * current tables are parsed from. Segments of different tables mostly differ
+ * in their first bytes and memcmp() returns early then. Hashing the segments
+ * first costs more than parsing them.
+ */
+bool smfc_table_cache_hit(const struct smfc_table_cache *cache)
+{
+	return cache->valid && (cache->len == cache->stage_len) &&
+			!memcmp(cache->segments, cache->stage, cache->len);
+}
+
+void smfc_table_cache_update(struct smfc_table_cache *cache)
+{
+	memcpy(cache->segments, cache->stage, cache->stage_len);
+	cache->len = cache->stage_len;
+	cache->valid = true;
+}
+
+/*
+ * Parses the DHT and DQT segments stored back to back in @segments, each led
+ * by its marker byte. The tables not found in @segments are cleared.
+ */
+int smfc_parse_table_segments(struct device *dev,
+			      const u8 *segments, unsigned int len,
+			      struct smfc_decomp_qtable *qtbl,
+			      struct smfc_decomp_htable *htbl)
+{
+	const u8 *segment = segments;
+	const u8 *end = segments + len;
+	int ret;
+
+	memset(qtbl->table, 0, sizeof(qtbl->table));
+	memset(htbl->dc, 0, sizeof(htbl->dc));
+	memset(htbl->ac, 0, sizeof(htbl->ac));
+
+	while (segment < end) {
+		u8 marker = *segment++;
+		u16 seglen = (segment[0] << 8) | segment[1];
+
+		if (marker == 0xC4)
+			ret = smfc_parse_dht(dev, segment, htbl);
+		else
+			ret = smfc_parse_dqt(dev, segment, qtbl);
+		if (ret)
+			return ret;
+
+		segment += seglen;
+	}
+
+	return 0;
+}
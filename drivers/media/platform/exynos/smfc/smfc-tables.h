@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015 Samsung Electronics Co., Ltd.
+ *		http://www.samsung.com
+ *
+ * The JPEG table parser of Samsung Exynos SMFC Driver
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _MEDIA_EXYNOS_SMFC_TABLES_H_
+#define _MEDIA_EXYNOS_SMFC_TABLES_H_
+
+#include <linux/types.h>
+
+#include "smfc-regs.h"
+
+struct device;
+
+#define __get_u16(pos)				\
+({						\
+	__typeof__(*(pos)) *__p = (pos);	\
+	u16 __v = (*__p++ << 8) & 0xFF00;	\
+	__v |= *__p++ & 0xFF;			\
+	pos = __p;				\
+	__v;					\
+})
+
+#define __halfbytes_larger_than(val, maxval) \
+			(max((val) & 0xF, ((val) >> 4) & 0xF) > (maxval))
+
+struct smfc_decomp_htable {
+	struct {
+		union {
+			u8 code[SMFC_NUM_HCODE];
+			u32 code32[SMFC_NUM_HCODE / 4];
+		};
+		union {
+			u8 value[SMFC_NUM_DC_HVAL];
+			u32 value32[SMFC_NUM_DC_HVAL / 4];
+		};
+	} dc[2];
+	struct {
+		union {
+			u8 code[SMFC_NUM_HCODE];
+			u32 code32[SMFC_NUM_HCODE / 4];
+		};
+		union {
+			u8 value[SMFC_NUM_AC_HVAL];
+			u32 value32[SMFC_NUM_AC_HVAL / 4];
+		};
+	} ac[2];
+
+	struct {
+		unsigned char idx_dc;
+		unsigned char idx_ac;
+	} compsel[SMFC_MAX_NUM_COMP]; /* compsel[0] for component 1 */
+};
+
+#define INVALID_QTBLIDX 0xFF
+struct smfc_decomp_qtable {
+	/* quantizers are *NOT* stored in the zig-zag scan order */
+	u8 table[SMFC_MAX_QTBL_COUNT][SMFC_MCU_SIZE];
+	char compsel[SMFC_MAX_QTBL_COUNT];
+};
+
+/*
+ * DHT and DQT segments of a JPEG header stored back to back, each led by its
+ * marker byte and followed by its length field. 2KiB is much larger than four
+ * Huffman tables and four 8-bit quantization tables.
+ */
+#define SMFC_MAX_TABLE_SEGMENTS_LEN	2048
+struct smfc_table_cache {
+	/* segments that the tables of the context are parsed from */
+	bool valid;
+	unsigned int len;
+	u8 segments[SMFC_MAX_TABLE_SEGMENTS_LEN];
+	/* segments of the JPEG header being parsed */
+	unsigned int stage_len;
+	u8 stage[SMFC_MAX_TABLE_SEGMENTS_LEN];
+};
+
+/*
+ * The functions below do not depend on struct smfc_ctx to let them be built
+ * in userspace by tools/testing/smfc.
+ */
+unsigned int smfc_get_num_huffval(const u8 *hufflen);
+bool smfc_table_cache_hit(const struct smfc_table_cache *cache);
+void smfc_table_cache_update(struct smfc_table_cache *cache);
+int smfc_parse_table_segments(struct device *dev,
+			      const u8 *segments, unsigned int len,
+			      struct smfc_decomp_qtable *qtbl,
+			      struct smfc_decomp_htable *htbl);
+
+#endif /* _MEDIA_EXYNOS_SMFC_TABLES_H_ */
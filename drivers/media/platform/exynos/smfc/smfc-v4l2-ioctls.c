@@ -17,6 +17,7 @@
 #define V4L2_CID_JPEG_SEC_COMP_QUALITY	(V4L2_CID_JPEG_CLASS_BASE + 20)
 #define V4L2_CID_JPEG_QTABLES2		(V4L2_CID_JPEG_CLASS_BASE + 22)
 #define V4L2_CID_JPEG_HWFC_ENABLE	(V4L2_CID_JPEG_CLASS_BASE + 25)
+#define V4L2_CID_JPEG_BATCH_SIZE	(V4L2_CID_JPEG_CLASS_BASE + 26)
 
 #define SMFC_FMT_MAIN_SIZE(val) ((val) & 0xFFFF)
 #define SMFC_FMT_SEC_SIZE(val) (((val) >> 16) & 0xFFFF)
@@ -284,6 +285,9 @@ static int smfc_s_ctrl(struct v4l2_ctrl *ctrl)
 	case V4L2_CID_JPEG_RESTART_INTERVAL:
 		ctx->restart_interval = (unsigned char)ctrl->val;
 		break;
+	case V4L2_CID_JPEG_BATCH_SIZE:
+		ctx->batch_size = (unsigned char)ctrl->val;
+		break;
 	case V4L2_CID_JPEG_CHROMA_SUBSAMPLING:
 		switch (ctrl->val) {
 		case V4L2_JPEG_CHROMA_SUBSAMPLING_444:
@@ -393,6 +397,24 @@ int smfc_init_controls(struct smfc_dev *smfc,
 		goto err;
 	}
 
+	/*
+	 * The number of queued images compressed back to back in a m2m job
+	 * without releasing the clocks and the power between them
+	 */
+	memset(&ctrlcfg, 0, sizeof(ctrlcfg));
+	ctrlcfg.ops = &smfc_ctrl_ops;
+	ctrlcfg.id = V4L2_CID_JPEG_BATCH_SIZE;
+	ctrlcfg.name = "Images compressed in a job";
+	ctrlcfg.type = V4L2_CTRL_TYPE_INTEGER;
+	ctrlcfg.min = 1;
+	ctrlcfg.max = SMFC_MAX_BATCH_SIZE;
+	ctrlcfg.step = 1;
+	ctrlcfg.def = 1;
+	if (!v4l2_ctrl_new_custom(hdlr, &ctrlcfg, NULL)) {
+		msg = "batch size";
+		goto err;
+	}
+
 	memset(&ctrlcfg, 0, sizeof(ctrlcfg));
 	ctrlcfg.ops = &smfc_ctrl_ops;
 	ctrlcfg.id = V4L2_CID_JPEG_QTABLES2;
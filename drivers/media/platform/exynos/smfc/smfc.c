@@ -62,6 +62,29 @@ static void __exynos_smfc_wakeup_done_waiters(struct smfc_ctx *ctx)
 	}
 }
 
+static int smfc_m2m_run_image(struct smfc_ctx *ctx);
+static void smfc_m2m_abort_image(struct smfc_ctx *ctx);
+
+/*
+ * Returns true if the next image of the current job is started without
+ * releasing the clocks and the power. Only compression is batched because
+ * the stream information of decompression is parsed in buf_prepare() and
+ * belongs to the last queued stream rather than the next one.
+ */
+static bool smfc_m2m_batch_next(struct smfc_ctx *ctx)
+{
+	if (!ctx || !(ctx->flags & SMFC_CTX_COMPRESS) || ctx->enable_hwfc)
+		return false;
+
+	if (READ_ONCE(ctx->batch_abort) ||
+			((ctx->batch_count + 1) >= ctx->batch_size))
+		return false;
+
+	/* the current source and destination are not removed yet */
+	return (v4l2_m2m_num_src_bufs_ready(ctx->fh.m2m_ctx) > 1) &&
+		(v4l2_m2m_num_dst_bufs_ready(ctx->fh.m2m_ctx) > 1);
+}
+
 static irqreturn_t exynos_smfc_irq_handler(int irq, void *priv)
 {
 	struct smfc_dev *smfc = priv;
@@ -71,6 +94,7 @@ static irqreturn_t exynos_smfc_irq_handler(int irq, void *priv)
 	u32 streamsize = smfc_get_streamsize(smfc);
 	u32 thumb_streamsize = smfc_get_2nd_streamsize(smfc);
 	bool suspending = false;
+	bool batch;
 
 	spin_lock(&smfc->flag_lock);
 
@@ -89,7 +113,14 @@ static irqreturn_t exynos_smfc_irq_handler(int irq, void *priv)
 	suspending = !!(smfc->flags & SMFC_DEV_SUSPENDING);
 	if (!!(smfc->flags & SMFC_DEV_OTF_EMUMODE))
 		del_timer(&smfc->timer);
-	smfc->flags &= ~(SMFC_DEV_RUNNING | SMFC_DEV_OTF_EMUMODE);
+	/*
+	 * SMFC_DEV_RUNNING is kept during a batch to let smfc_suspend() wait
+	 * for the next image.
+	 */
+	batch = !suspending && smfc_m2m_batch_next(ctx);
+	smfc->flags &= ~SMFC_DEV_OTF_EMUMODE;
+	if (!batch)
+		smfc->flags &= ~SMFC_DEV_RUNNING;
 
 	spin_unlock(&smfc->flag_lock);
 
@@ -97,15 +128,26 @@ static irqreturn_t exynos_smfc_irq_handler(int irq, void *priv)
 		smfc_dump_registers(smfc);
 		state = VB2_BUF_STATE_ERROR;
 		smfc_hwconfigure_reset(smfc);
-	}
+		smfc_invalidate_tables(smfc);
 
-	if (!IS_ERR(smfc->clk_gate)) {
-		clk_disable(smfc->clk_gate);
-		if (!IS_ERR(smfc->clk_gate2))
-			clk_disable(smfc->clk_gate2);
+		if (batch) {
+			batch = false;
+			spin_lock(&smfc->flag_lock);
+			suspending = !!(smfc->flags & SMFC_DEV_SUSPENDING);
+			smfc->flags &= ~SMFC_DEV_RUNNING;
+			spin_unlock(&smfc->flag_lock);
+		}
 	}
 
-	pm_runtime_put(smfc->dev);
+	if (!batch) {
+		if (!IS_ERR(smfc->clk_gate)) {
+			clk_disable(smfc->clk_gate);
+			if (!IS_ERR(smfc->clk_gate2))
+				clk_disable(smfc->clk_gate2);
+		}
+
+		pm_runtime_put(smfc->dev);
+	}
 
 	/* ctx is NULL if streamoff is called before (de)compression finishes */
 	if (ctx) {
@@ -132,6 +174,19 @@ static irqreturn_t exynos_smfc_irq_handler(int irq, void *priv)
 
 		__exynos_smfc_wakeup_done_waiters(ctx);
 
+		if (batch) {
+			ctx->batch_count++;
+			if (!smfc_m2m_run_image(ctx))
+				return IRQ_HANDLED;
+
+			spin_lock(&smfc->flag_lock);
+			suspending = !!(smfc->flags & SMFC_DEV_SUSPENDING);
+			smfc->flags &= ~SMFC_DEV_RUNNING;
+			spin_unlock(&smfc->flag_lock);
+
+			smfc_m2m_abort_image(ctx);
+		}
+
 		if (!suspending) {
 			v4l2_m2m_job_finish(smfc->m2mdev, ctx->fh.m2m_ctx);
 		} else {
@@ -177,6 +232,7 @@ static void smfc_timedout_handler(unsigned long arg)
 	dev_err(smfc->dev, "=== TIMED-OUT! (1 sec.) =========================");
 	smfc_dump_registers(smfc);
 	smfc_hwconfigure_reset(smfc);
+	smfc_invalidate_tables(smfc);
 
 	if (!IS_ERR(smfc->clk_gate)) {
 		clk_disable(smfc->clk_gate);
@@ -367,8 +423,10 @@ static void smfc_vb2_buf_cleanup(struct vb2_buffer *vb)
 static void smfc_vb2_buf_queue(struct vb2_buffer *vb)
 {
 	struct smfc_ctx *ctx = vb2_get_drv_priv(vb->vb2_queue);
+	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
 
-	v4l2_m2m_buf_queue(ctx->fh.m2m_ctx, to_vb2_v4l2_buffer(vb));
+	to_smfc_buffer(vbuf)->ktime_queued = ktime_get();
+	v4l2_m2m_buf_queue(ctx->fh.m2m_ctx, vbuf);
 }
 
 static void smfc_vb2_stop_streaming(struct vb2_queue *vq)
@@ -410,7 +468,7 @@ static int smfc_queue_init(void *priv, struct vb2_queue *src_vq,
 	src_vq->ops = &smfc_vb2_ops;
 	src_vq->mem_ops = &vb2_dma_sg_memops;
 	src_vq->drv_priv = ctx;
-	src_vq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
+	src_vq->buf_struct_size = sizeof(struct smfc_buffer);
 	src_vq->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
 	src_vq->lock = &ctx->smfc->video_device_mutex;
 
@@ -424,7 +482,7 @@ static int smfc_queue_init(void *priv, struct vb2_queue *src_vq,
 	dst_vq->ops = &smfc_vb2_ops;
 	dst_vq->mem_ops = &vb2_dma_sg_memops;
 	dst_vq->drv_priv = ctx;
-	dst_vq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
+	dst_vq->buf_struct_size = sizeof(struct smfc_buffer);
 	dst_vq->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
 	dst_vq->lock = &ctx->smfc->video_device_mutex;
 
@@ -523,8 +581,15 @@ static int exynos_smfc_release(struct file *filp)
 			clk_unprepare(ctx->smfc->clk_gate2);
 	}
 
+	/*
+	 * A new context may be allocated at the same address. Other contexts
+	 * may run meanwhile but they never leave ctx in tables_owner.
+	 */
+	cmpxchg(&ctx->smfc->tables_owner, ctx, NULL);
+
 	kfree(ctx->quantizer_tables);
 	kfree(ctx->huffman_tables);
+	kfree(ctx->table_cache);
 
 	kfree(ctx);
 
@@ -561,41 +626,24 @@ static bool smfc_check_hwfc_configuration(struct smfc_ctx *ctx, bool hwfc_en)
 	return false;
 }
 
-static void smfc_m2m_device_run(void *priv)
+/*
+ * Configures and starts H/W for the next source and destination buffers of
+ * ctx. The clocks and the power should be enabled.
+ */
+static int smfc_m2m_run_image(struct smfc_ctx *ctx)
 {
-	struct smfc_ctx *ctx = priv;
 	unsigned long flags;
-	int ret;
 	unsigned char chroma_hfactor = ctx->chroma_hfactor;
 	unsigned char chroma_vfactor = ctx->chroma_vfactor;
 	unsigned char restart_interval = ctx->restart_interval;
 	unsigned char quality_factor = ctx->quality_factor;
 	unsigned char thumb_quality_factor = ctx->thumb_quality_factor;
 	unsigned char enable_hwfc = ctx->enable_hwfc;
-
-	ret = in_irq() ? pm_runtime_get(ctx->smfc->dev) :
-			 pm_runtime_get_sync(ctx->smfc->dev);
-	if (ret < 0) {
-		pr_err("Failed to enable power\n");
-		goto err_pm;
-	}
-
-	if (!IS_ERR(ctx->smfc->clk_gate)) {
-		ret = clk_enable(ctx->smfc->clk_gate);
-		if (!ret && !IS_ERR(ctx->smfc->clk_gate2)) {
-			ret = clk_enable(ctx->smfc->clk_gate2);
-			if (ret)
-				clk_disable(ctx->smfc->clk_gate);
-		}
-	}
-
-	if (ret < 0) {
-		dev_err(ctx->smfc->dev, "Failed to enable clocks\n");
-		goto err_clk;
-	}
+	struct vb2_v4l2_buffer *src, *dst;
+	ktime_t ktime_queued;
 
 	if (!smfc_check_hwfc_configuration(ctx, !!enable_hwfc))
-		goto err_hwfc;
+		return -EINVAL;
 
 	smfc_hwconfigure_reset(ctx->smfc);
 
@@ -613,7 +661,7 @@ static void smfc_m2m_device_run(void *priv)
 			dev_err(ctx->smfc->dev,
 				"Downscaling on decompression not allowed\n");
 			/* It is okay to abort after reset */
-			goto err_invalid_size;
+			return -EINVAL;
 		}
 
 		smfc_hwconfigure_image(ctx,
@@ -638,16 +686,72 @@ static void smfc_m2m_device_run(void *priv)
 
 	ctx->ktime_beg = ktime_get();
 
+	/* the image is ready to run when both of its buffers are queued */
+	src = v4l2_m2m_next_src_buf(ctx->fh.m2m_ctx);
+	dst = v4l2_m2m_next_dst_buf(ctx->fh.m2m_ctx);
+	ktime_queued = ktime_after(to_smfc_buffer(src)->ktime_queued,
+				   to_smfc_buffer(dst)->ktime_queued) ?
+			to_smfc_buffer(src)->ktime_queued :
+			to_smfc_buffer(dst)->ktime_queued;
+	src->reserved2 = (__u32)ktime_us_delta(ctx->ktime_beg, ktime_queued);
+
 	smfc_hwconfigure_start(ctx, restart_interval, !!enable_hwfc);
 
-	return;
-err_invalid_size:
-err_hwfc:
+	return 0;
+}
+
+/* releases the clocks and the power, and fails the next buffers of ctx */
+static void smfc_m2m_abort_image(struct smfc_ctx *ctx)
+{
 	if (!IS_ERR(ctx->smfc->clk_gate)) {
 		clk_disable(ctx->smfc->clk_gate);
 		if (!IS_ERR(ctx->smfc->clk_gate2))
 			clk_disable(ctx->smfc->clk_gate2);
 	}
+
+	pm_runtime_put(ctx->smfc->dev);
+
+	v4l2_m2m_buf_done(
+		v4l2_m2m_src_buf_remove(ctx->fh.m2m_ctx), VB2_BUF_STATE_ERROR);
+	v4l2_m2m_buf_done(
+		v4l2_m2m_dst_buf_remove(ctx->fh.m2m_ctx), VB2_BUF_STATE_ERROR);
+}
+
+static void smfc_m2m_device_run(void *priv)
+{
+	struct smfc_ctx *ctx = priv;
+	int ret;
+
+	ctx->batch_count = 0;
+	WRITE_ONCE(ctx->batch_abort, false);
+
+	ret = in_irq() ? pm_runtime_get(ctx->smfc->dev) :
+			 pm_runtime_get_sync(ctx->smfc->dev);
+	if (ret < 0) {
+		pr_err("Failed to enable power\n");
+		goto err_pm;
+	}
+
+	if (!IS_ERR(ctx->smfc->clk_gate)) {
+		ret = clk_enable(ctx->smfc->clk_gate);
+		if (!ret && !IS_ERR(ctx->smfc->clk_gate2)) {
+			ret = clk_enable(ctx->smfc->clk_gate2);
+			if (ret)
+				clk_disable(ctx->smfc->clk_gate);
+		}
+	}
+
+	if (ret < 0) {
+		dev_err(ctx->smfc->dev, "Failed to enable clocks\n");
+		goto err_clk;
+	}
+
+	if (smfc_m2m_run_image(ctx)) {
+		smfc_m2m_abort_image(ctx);
+		v4l2_m2m_job_finish(ctx->smfc->m2mdev, ctx->fh.m2m_ctx);
+	}
+
+	return;
 err_clk:
 	pm_runtime_put(ctx->smfc->dev);
 err_pm:
@@ -664,7 +768,10 @@ err_pm:
 
 static void smfc_m2m_job_abort(void *priv)
 {
-	/* nothing to do */
+	struct smfc_ctx *ctx = priv;
+
+	/* the running image completes but the rest of the batch does not run */
+	WRITE_ONCE(ctx->batch_abort, true);
 }
 
 static struct v4l2_m2m_ops smfc_m2m_ops = {
@@ -1049,6 +1156,9 @@ static int smfc_runtime_suspend(struct device *dev)
 	if (smfc->qosreq_int_level > 0)
 		pm_qos_update_request(&smfc->qosreq_int, 0);
 
+	/* the tables do not survive power gating */
+	smfc_invalidate_tables(smfc);
+
 	return 0;
 }
 #endif
@@ -20,6 +20,7 @@
 #include <media/v4l2-ctrls.h>
 
 #include "smfc-regs.h"
+#include "smfc-tables.h"
 
 #define MODULE_NAME	"exynos-jpeg"
 
@@ -111,8 +112,22 @@ struct smfc_dev {
 	struct pm_qos_request qosreq_int;
 	s32 qosreq_int_level;
 
+	/*
+	 * Decompression tables in the H/W are programmed from tables_owner at
+	 * its table generation tables_gen. tables_qmask has the bit of every
+	 * quantization table slot that holds the table of that generation.
+	 */
+	const struct smfc_ctx *tables_owner;
+	u32 tables_gen;
+	u32 tables_qmask;
 };
 
+/* forget the tables in the H/W if they are overwritten or lost */
+static inline void smfc_invalidate_tables(struct smfc_dev *smfc)
+{
+	smfc->tables_owner = NULL;
+}
+
 #define SMFC_CTX_COMPRESS	(1 << 0)
 #define SMFC_CTX_B2B_COMPRESS	(1 << 1) /* valid if SMFC_CTX_COMPRESS is set */
 
@@ -121,40 +136,23 @@ static inline bool smfc_is_capable(const struct smfc_dev *smfc, u32 capability)
 	return (smfc->devdata->device_caps & capability) == capability;
 }
 
-struct smfc_decomp_htable {
-	struct {
-		union {
-			u8 code[SMFC_NUM_HCODE];
-			u32 code32[SMFC_NUM_HCODE / 4];
-		};
-		union {
-			u8 value[SMFC_NUM_DC_HVAL];
-			u32 value32[SMFC_NUM_DC_HVAL / 4];
-		};
-	} dc[2];
-	struct {
-		union {
-			u8 code[SMFC_NUM_HCODE];
-			u32 code32[SMFC_NUM_HCODE / 4];
-		};
-		union {
-			u8 value[SMFC_NUM_AC_HVAL];
-			u32 value32[SMFC_NUM_AC_HVAL / 4];
-		};
-	} ac[2];
-
-	struct {
-		unsigned char idx_dc;
-		unsigned char idx_ac;
-	} compsel[SMFC_MAX_NUM_COMP]; /* compsel[0] for component 1 */
+/*
+ * The buffers report the times of the image in reserved2 of v4l2_buffer:
+ * - capture: time spent by H/W in microseconds
+ * - output: time from queueing both of the buffers to starting H/W
+ */
+struct smfc_buffer {
+	struct v4l2_m2m_buffer m2mbuf;
+	ktime_t ktime_queued;
 };
 
-#define INVALID_QTBLIDX 0xFF
-struct smfc_decomp_qtable {
-	/* quantizers are *NOT* stored in the zig-zag scan order */
-	u8 table[SMFC_MAX_QTBL_COUNT][SMFC_MCU_SIZE];
-	char compsel[SMFC_MAX_QTBL_COUNT];
-};
+static inline struct smfc_buffer *to_smfc_buffer(struct vb2_v4l2_buffer *vb)
+{
+	return container_of(vb, struct smfc_buffer, m2mbuf.vb);
+}
+
+/* the number of images compressed in a m2m job without power transitions */
+#define SMFC_MAX_BATCH_SIZE	16
 
 struct smfc_crop {
 	u32 width;
@@ -192,10 +190,15 @@ struct smfc_ctx {
 	__u32 thumb_height;
 	unsigned char thumb_quality_factor;
 	unsigned char enable_hwfc;
+	unsigned char batch_size;
+	unsigned char batch_count; /* images completed in the current job */
+	bool batch_abort;
 
 	/* Decompression settings */
 	struct smfc_decomp_qtable *quantizer_tables;
 	struct smfc_decomp_htable *huffman_tables;
+	struct smfc_table_cache *table_cache;
+	u32 tables_gen; /* increased whenever the tables above are reparsed */
 	unsigned char stream_hfactor;
 	unsigned char stream_vfactor;
 	unsigned char num_components;
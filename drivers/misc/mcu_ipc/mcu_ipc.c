@@ -46,9 +46,77 @@ void mcu_ipc_reg_dump(enum mcu_ipc_region id)
 }
 EXPORT_SYMBOL(mcu_ipc_reg_dump);
 
+#ifdef CONFIG_MCU_IPC_STATS
+static unsigned int mcu_ipc_hist_bucket(u64 ns)
+{
+	return min_t(unsigned int, fls64(div_u64(ns, NSEC_PER_USEC)),
+			MCU_IPC_HIST_BUCKETS - 1);
+}
+
+/* called in hard irq with the interrupts raised by a mailbox irq */
+static void mcu_ipc_stats_arrival(u32 id, u32 irq_stat)
+{
+	unsigned long bits = irq_stat >> 16;
+	bool coalesced = hweight32(irq_stat) > 1;
+	u64 now = ktime_get_ns();
+	int i;
+
+	mcu_dat[id].nr_irqs++;
+	if (coalesced)
+		mcu_dat[id].nr_coalesced++;
+
+	for_each_set_bit(i, &bits, 16) {
+		struct mcu_ipc_irq_stats *stats = &mcu_dat[id].stats[i];
+
+		stats->count++;
+		if (coalesced)
+			stats->coalesced++;
+		if (stats->last_ns)
+			stats->gap_hist[mcu_ipc_hist_bucket(now - stats->last_ns)]++;
+		stats->last_ns = now;
+	}
+}
+
+static void mcu_ipc_stats_run(u32 id, u32 int_num, u64 begin)
+{
+	struct mcu_ipc_irq_stats *stats = &mcu_dat[id].stats[int_num];
+	u64 ns = ktime_get_ns() - begin;
+
+	stats->total_ns += ns;
+	if (ns > stats->max_ns)
+		stats->max_ns = ns;
+	stats->run_hist[mcu_ipc_hist_bucket(ns)]++;
+}
+
+static inline u64 mcu_ipc_stats_clock(void)
+{
+	return ktime_get_ns();
+}
+#else
+static inline void mcu_ipc_stats_arrival(u32 id, u32 irq_stat) {}
+static inline void mcu_ipc_stats_run(u32 id, u32 int_num, u64 begin) {}
+static inline u64 mcu_ipc_stats_clock(void)
+{
+	return 0;
+}
+#endif
+
+static void mcu_ipc_dispatch(u32 id, u32 int_num,
+		void (*handler)(void *), void *data)
+{
+	u64 begin = mcu_ipc_stats_clock();
+
+	if (handler)
+		handler(data);
+	else
+		dev_err(mcu_dat[id].mcu_ipc_dev, "Unregistered INT received.\n");
+
+	mcu_ipc_stats_run(id, int_num, begin);
+}
+
 static irqreturn_t mcu_ipc_handler(int irq, void *data)
 {
-	u32 irq_stat, i;
+	u32 irq_stat, threaded, i;
 	u32 id;
 
 	id = ((struct mcu_ipc_drv_data *)data)->id;
@@ -65,15 +133,22 @@ static irqreturn_t mcu_ipc_handler(int irq, void *data)
 
 	/* Interrupt Clear */
 	mcu_ipc_writel(id, irq_stat, EXYNOS_MCU_IPC_INTCR0);
+
+	/* Slow handlers are left to mcu_ipc_thread_handler() */
+	threaded = irq_stat & (mcu_dat[id].threaded_irq << 16);
+	mcu_dat[id].pending_irq |= threaded >> 16;
 	spin_unlock(&mcu_dat[id].reg_lock);
 
+	mcu_ipc_stats_arrival(id, irq_stat);
+	irq_stat &= ~threaded;
+
 	for (i = 0; i < 16; i++) {
 		if (irq_stat & (1 << (i + 16))) {
 			if ((1 << (i + 16)) & mcu_dat[id].registered_irq)
-				mcu_dat[id].hd[i].handler(mcu_dat[id].hd[i].data);
+				mcu_ipc_dispatch(id, i, mcu_dat[id].hd[i].handler,
+						mcu_dat[id].hd[i].data);
 			else
-				dev_err(mcu_dat[id].mcu_ipc_dev,
-					"Unregistered INT received.\n");
+				mcu_ipc_dispatch(id, i, NULL, NULL);
 
 			irq_stat &= ~(1 << (i + 16));
 		}
@@ -82,6 +157,28 @@ static irqreturn_t mcu_ipc_handler(int irq, void *data)
 			break;
 	}
 
+	return threaded ? IRQ_WAKE_THREAD : IRQ_HANDLED;
+}
+
+static irqreturn_t mcu_ipc_thread_handler(int irq, void *data)
+{
+	struct mcu_ipc_ipc_handler hd[16];
+	unsigned long flags, pending;
+	u32 id, i;
+
+	id = ((struct mcu_ipc_drv_data *)data)->id;
+
+	/* A handler may be unregistered after the hard irq */
+	spin_lock_irqsave(&mcu_dat[id].reg_lock, flags);
+	pending = mcu_dat[id].pending_irq;
+	mcu_dat[id].pending_irq = 0;
+	for_each_set_bit(i, &pending, 16)
+		hd[i] = mcu_dat[id].hd[i];
+	spin_unlock_irqrestore(&mcu_dat[id].reg_lock, flags);
+
+	for_each_set_bit(i, &pending, 16)
+		mcu_ipc_dispatch(id, i, hd[i].handler, hd[i].data);
+
 	return IRQ_HANDLED;
 }
 
@@ -106,6 +203,34 @@ int mbox_request_irq(enum mcu_ipc_region id, u32 int_num,
 }
 EXPORT_SYMBOL(mbox_request_irq);
 
+/*
+ * mbox_set_irq_threaded
+ *
+ * This function moves the handler of a mailbox interrupt from hard irq to
+ * the irq thread of the mailbox. It is for slow handlers which would delay
+ * the handlers of the other interrupts. The handler should not assume that
+ * local interrupts are disabled while it runs.
+ */
+int mbox_set_irq_threaded(enum mcu_ipc_region id, u32 int_num, bool threaded)
+{
+	unsigned long flags;
+
+	if (int_num > 15)
+		return -EINVAL;
+
+	spin_lock_irqsave(&mcu_dat[id].reg_lock, flags);
+
+	if (threaded)
+		set_bit(int_num, &mcu_dat[id].threaded_irq);
+	else
+		clear_bit(int_num, &mcu_dat[id].threaded_irq);
+
+	spin_unlock_irqrestore(&mcu_dat[id].reg_lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(mbox_set_irq_threaded);
+
 /*
  * mbox_enable_irq
  *
@@ -228,6 +353,8 @@ int mcu_ipc_unregister_handler(enum mcu_ipc_region id, u32 int_num,
 	mcu_dat[id].hd[int_num].handler = NULL;
 	mcu_dat[id].registered_irq &= ~(1 << (int_num + 16));
 	clear_bit(int_num, &mcu_dat[id].unmasked_irq);
+	clear_bit(int_num, &mcu_dat[id].threaded_irq);
+	clear_bit(int_num, &mcu_dat[id].pending_irq);
 
 	spin_unlock_irqrestore(&mcu_dat[id].reg_lock, flags);
 
@@ -396,6 +523,87 @@ static int mcu_ipc_set_affinity(enum mcu_ipc_region id, struct device *dev, int
 }
 #endif
 
+#ifdef CONFIG_MCU_IPC_STATS
+static int mcu_ipc_show_hist(char *buf, size_t size, const char *name,
+		const u32 *hist)
+{
+	int last, i, n;
+
+	for (last = MCU_IPC_HIST_BUCKETS - 1; last > 0; last--)
+		if (hist[last])
+			break;
+
+	n = scnprintf(buf, size, "  %s:", name);
+	for (i = 0; i <= last; i++)
+		n += scnprintf(buf + n, size - n, " %u", hist[i]);
+	n += scnprintf(buf + n, size - n, "\n");
+
+	return n;
+}
+
+static ssize_t irq_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct mcu_ipc_irq_stats *stats;
+	u32 id, i;
+	int n;
+
+	for (id = 0; id < MCU_MAX; id++)
+		if (mcu_dat[id].mcu_ipc_dev == dev)
+			break;
+	if (id == MCU_MAX)
+		return -ENODEV;
+
+	n = scnprintf(buf, PAGE_SIZE, "irqs %llu coalesced %llu threaded %#lx\n",
+			mcu_dat[id].nr_irqs, mcu_dat[id].nr_coalesced,
+			mcu_dat[id].threaded_irq);
+	n += scnprintf(buf + n, PAGE_SIZE - n,
+			"histogram bucket n counts [2^(n-1), 2^n) usec\n");
+
+	for (i = 0; i < 16; i++) {
+		stats = &mcu_dat[id].stats[i];
+		if (!stats->count)
+			continue;
+
+		n += scnprintf(buf + n, PAGE_SIZE - n,
+			"int%u: count %llu coalesced %llu avg %lluns max %lluns\n",
+			i, stats->count, stats->coalesced,
+			div64_u64(stats->total_ns, stats->count),
+			stats->max_ns);
+		n += mcu_ipc_show_hist(buf + n, PAGE_SIZE - n, "run",
+				stats->run_hist);
+		n += mcu_ipc_show_hist(buf + n, PAGE_SIZE - n, "gap",
+				stats->gap_hist);
+	}
+
+	return n;
+}
+
+/* writing anything clears the statistics */
+static ssize_t irq_stats_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	unsigned long flags;
+	u32 id;
+
+	for (id = 0; id < MCU_MAX; id++)
+		if (mcu_dat[id].mcu_ipc_dev == dev)
+			break;
+	if (id == MCU_MAX)
+		return -ENODEV;
+
+	spin_lock_irqsave(&mcu_dat[id].reg_lock, flags);
+	mcu_dat[id].nr_irqs = 0;
+	mcu_dat[id].nr_coalesced = 0;
+	memset(mcu_dat[id].stats, 0, sizeof(mcu_dat[id].stats));
+	spin_unlock_irqrestore(&mcu_dat[id].reg_lock, flags);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(irq_stats);
+#endif
+
 #ifdef CONFIG_MCU_IPC_TEST
 static void test_without_dev(enum mcu_ipc_region id)
 {
@@ -470,8 +678,8 @@ static int mcu_ipc_probe(struct platform_device *pdev)
 
 	/* Request IRQ */
 	mcu_ipc_irq = platform_get_irq(pdev, 0);
-	err = devm_request_irq(&pdev->dev, mcu_ipc_irq, mcu_ipc_handler, 0,
-			pdev->name, &mcu_dat[id]);
+	err = devm_request_threaded_irq(&pdev->dev, mcu_ipc_irq, mcu_ipc_handler,
+			mcu_ipc_thread_handler, 0, pdev->name, &mcu_dat[id]);
 	if (err) {
 		dev_err(&pdev->dev, "Can't request MCU_IPC IRQ\n");
 		return err;
@@ -491,6 +699,11 @@ static int mcu_ipc_probe(struct platform_device *pdev)
 	spin_lock_init(&mcu_dat[id].lock);
 	spin_lock_init(&mcu_dat[id].reg_lock);
 
+#ifdef CONFIG_MCU_IPC_STATS
+	if (device_create_file(dev, &dev_attr_irq_stats))
+		dev_err(dev, "Can't create irq_stats\n");
+#endif
+
 	dev_err(&pdev->dev, "%s: mcu_ipc probe done.\n", __func__);
 
 	return 0;
@@ -28,6 +28,21 @@ struct mcu_ipc_ipc_handler {
 	void (*handler)(void *);
 };
 
+#ifdef CONFIG_MCU_IPC_STATS
+/* bucket n counts [2^(n-1), 2^n) usec, the last one counts the rest */
+#define MCU_IPC_HIST_BUCKETS	20
+
+struct mcu_ipc_irq_stats {
+	u64 count;
+	u64 coalesced;	/* raised together with other interrupts */
+	u64 total_ns;
+	u64 max_ns;
+	u64 last_ns;
+	u32 run_hist[MCU_IPC_HIST_BUCKETS];
+	u32 gap_hist[MCU_IPC_HIST_BUCKETS];
+};
+#endif
+
 struct mcu_ipc_drv_data {
 	char *name;
 	u32 id;
@@ -47,6 +62,15 @@ struct mcu_ipc_drv_data {
 	spinlock_t lock;
 	spinlock_t reg_lock;
 
+	/* interrupts dispatched from the irq thread instead of hard irq */
+	unsigned long threaded_irq;
+	unsigned long pending_irq;
+
+#ifdef CONFIG_MCU_IPC_STATS
+	u64 nr_irqs;
+	u64 nr_coalesced;	/* hard irqs that raised more than one interrupt */
+	struct mcu_ipc_irq_stats stats[16];
+#endif
 };
 
 static struct mcu_ipc_drv_data mcu_dat[MCU_MAX];
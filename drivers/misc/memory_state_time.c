@@ -13,6 +13,7 @@
  *
  */
 
+#include <linux/atomic.h>
 #include <linux/device.h>
 #include <linux/err.h>
 #include <linux/errno.h>
@@ -22,13 +23,12 @@
 #include <linux/kobject.h>
 #include <linux/memory-state-time.h>
 #include <linux/module.h>
-#include <linux/mutex.h>
 #include <linux/of_platform.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
 #include <linux/sysfs.h>
 #include <linux/time.h>
 #include <linux/timekeeping.h>
-#include <linux/workqueue.h>
 
 #define KERNEL_ATTR_RO(_name) \
 static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
@@ -40,8 +40,6 @@ static struct kobj_attribute _name##_attr = \
 #define FREQ_HASH_BITS 4
 DECLARE_HASHTABLE(freq_hash_table, FREQ_HASH_BITS);
 
-static DEFINE_MUTEX(mem_lock);
-
 #define TAG "memory_state_time"
 #define BW_NODE "/soc/memory-state-time"
 #define FREQ_TBL "freq-tbl"
@@ -50,196 +48,163 @@ static DEFINE_MUTEX(mem_lock);
 
 #define LOWEST_FREQ 2
 
-static int curr_bw;
-static int curr_freq;
+/* bw_lut[bw >> bw_lut_shift] is the lowest bucket bw can fall into */
+#define BW_LUT_BITS 8
+
+/*
+ * Current (frequency index, bandwidth bucket) packed in one word, next to
+ * the time it was entered. Both words are replaced together with
+ * cmpxchg_double(), so an update always charges the elapsed time to the
+ * state it was actually spent in, without a lock.
+ */
+#define MEM_STATE(freq_idx, bucket) (((unsigned long)(freq_idx) << 16) | (bucket))
+#define MEM_STATE_FREQ(state) ((int)((state) >> 16))
+#define MEM_STATE_BUCKET(state) ((int)((state) & 0xffff))
+
+static struct {
+	u64 last_update;
+	unsigned long state;
+} mem_state __aligned(2 * sizeof(unsigned long));
+static atomic_t total_bw;
 static u32 *bw_buckets;
 static u32 *freq_buckets;
 static int num_freqs;
 static int num_buckets;
 static int registered_bw_sources;
-static u64 last_update;
 static bool init_success;
-static struct workqueue_struct *memory_wq;
 static u32 num_sources = 10;
 static int *bandwidths;
+static u16 bw_lut[1 << BW_LUT_BITS];
+static int bw_lut_shift;
+
+/*
+ * Time spent in each state, as num_freqs * num_buckets counters per CPU.
+ * Updates are attributed to the CPU that reported the state change, and
+ * readers sum over all CPUs.
+ */
+static s64 __percpu *state_time;
 
 struct freq_entry {
 	int freq;
-	u64 *buckets; /* Bandwidth buckets. */
+	int index;
 	struct hlist_node hash;
 };
 
-struct queue_container {
-	struct work_struct update_state;
-	int value;
-	u64 time_now;
-	int id;
-	struct mutex *lock;
-};
-
 static int find_bucket(int bw)
 {
 	int i;
 
 	if (bw_buckets != NULL) {
-		for (i = 0; i < num_buckets; i++) {
-			if (bw_buckets[i] > bw) {
-				pr_debug("Found bucket %d for bandwidth %d\n",
-					i, bw);
-				return i;
-			}
-		}
-		return num_buckets - 1;
+		if (bw < 0)
+			bw = 0;
+		if ((bw >> bw_lut_shift) >= ARRAY_SIZE(bw_lut))
+			return num_buckets - 1;
+		i = bw_lut[bw >> bw_lut_shift];
+		while (i < num_buckets - 1 && bw_buckets[i] <= bw)
+			i++;
+		return i;
 	}
 	return 0;
 }
 
-static u64 get_time_diff(u64 time_now)
+static int find_freq_index(int freq)
 {
-	u64 ms;
+	struct freq_entry *freq_entry;
 
-	ms = time_now - last_update;
-	last_update = time_now;
-	return ms;
+	hash_for_each_possible(freq_hash_table, freq_entry, hash, freq) {
+		if (freq_entry->freq == freq)
+			return freq_entry->index;
+	}
+	return -1;
 }
 
 static ssize_t show_stat_show(struct kobject *kobj,
 		struct kobj_attribute *attr, char *buf)
 {
-	int i, j;
+	int i, j, cpu;
 	int len = 0;
-	struct freq_entry *freq_entry;
+	s64 sum;
 
 	for (i = 0; i < num_freqs; i++) {
-		hash_for_each_possible(freq_hash_table, freq_entry, hash,
-				freq_buckets[i]) {
-			if (freq_entry->freq == freq_buckets[i]) {
-				len += scnprintf(buf + len, PAGE_SIZE - len,
-						"%d ", freq_buckets[i]);
-				if (len >= PAGE_SIZE)
-					break;
-				for (j = 0; j < num_buckets; j++) {
-					len += scnprintf(buf + len,
-							PAGE_SIZE - len,
-							"%llu ",
-							freq_entry->buckets[j]);
-				}
-				len += scnprintf(buf + len, PAGE_SIZE - len,
-						"\n");
-			}
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				"%d ", freq_buckets[i]);
+		if (len >= PAGE_SIZE)
+			break;
+		for (j = 0; j < num_buckets; j++) {
+			sum = 0;
+			for_each_possible_cpu(cpu)
+				sum += READ_ONCE(per_cpu_ptr(state_time, cpu)
+						[i * num_buckets + j]);
+			len += scnprintf(buf + len, PAGE_SIZE - len,
+					"%llu ", (u64)max_t(s64, sum, 0));
 		}
+		len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
 	}
 	pr_debug("Current Time: %llu\n", ktime_get_boot_ns());
 	return len;
 }
 KERNEL_ATTR_RO(show_stat);
 
-static void update_table(u64 time_now)
-{
-	struct freq_entry *freq_entry;
-
-	pr_debug("Last known bw %d freq %d\n", curr_bw, curr_freq);
-	hash_for_each_possible(freq_hash_table, freq_entry, hash, curr_freq) {
-		if (curr_freq == freq_entry->freq) {
-			freq_entry->buckets[find_bucket(curr_bw)]
-					+= get_time_diff(time_now);
-			break;
-		}
-	}
-}
-
-static bool freq_exists(int freq)
+/*
+ * Charge the time since the last update to the state that was current,
+ * and switch to the new one. The pair is read without ordering; a torn
+ * read simply fails the cmpxchg_double() and is retried. The clock is read
+ * after last_update, so the delta is never negative.
+ */
+static void update_table(int freq_idx, int bucket)
 {
-	int i;
-
-	for (i = 0; i < num_freqs; i++) {
-		if (freq == freq_buckets[i])
-			return true;
-	}
-	return false;
+	unsigned long old, new;
+	u64 old_time, time_now;
+
+	do {
+		old_time = READ_ONCE(mem_state.last_update);
+		old = READ_ONCE(mem_state.state);
+		time_now = ktime_get_boot_ns();
+		new = MEM_STATE(freq_idx >= 0 ? freq_idx : MEM_STATE_FREQ(old),
+				bucket >= 0 ? bucket : MEM_STATE_BUCKET(old));
+	} while (!cmpxchg_double(&mem_state.last_update, &mem_state.state,
+				old_time, old, time_now, new));
+
+	pr_debug("Last known bucket %d freq %d\n", MEM_STATE_BUCKET(old),
+			freq_buckets[MEM_STATE_FREQ(old)]);
+	this_cpu_add(*(state_time + MEM_STATE_FREQ(old) * num_buckets +
+			MEM_STATE_BUCKET(old)), time_now - old_time);
 }
 
 static int calculate_total_bw(int bw, int index)
 {
-	int i;
-	int total_bw = 0;
-
 	pr_debug("memory_state_time New bw %d for id %d\n", bw, index);
-	bandwidths[index] = bw;
-	for (i = 0; i < registered_bw_sources; i++)
-		total_bw += bandwidths[i];
-	return total_bw;
-}
-
-static void freq_update_do_work(struct work_struct *work)
-{
-	struct queue_container *freq_state_update
-			= container_of(work, struct queue_container,
-			update_state);
-	if (freq_state_update) {
-		mutex_lock(&mem_lock);
-		update_table(freq_state_update->time_now);
-		curr_freq = freq_state_update->value;
-		mutex_unlock(&mem_lock);
-		kfree(freq_state_update);
-	}
-}
-
-static void bw_update_do_work(struct work_struct *work)
-{
-	struct queue_container *bw_state_update
-			= container_of(work, struct queue_container,
-			update_state);
-	if (bw_state_update) {
-		mutex_lock(&mem_lock);
-		update_table(bw_state_update->time_now);
-		curr_bw = calculate_total_bw(bw_state_update->value,
-				bw_state_update->id);
-		mutex_unlock(&mem_lock);
-		kfree(bw_state_update);
-	}
+	return atomic_add_return(bw - xchg(&bandwidths[index], bw),
+			&total_bw);
 }
 
 static void memory_state_freq_update(struct memory_state_update_block *ub,
 		int value)
 {
+	int freq_idx;
+
 	if (IS_ENABLED(CONFIG_MEMORY_STATE_TIME)) {
-		if (freq_exists(value) && init_success) {
-			struct queue_container *freq_container
-				= kmalloc(sizeof(struct queue_container),
-				GFP_KERNEL);
-			if (!freq_container)
-				return;
-			INIT_WORK(&freq_container->update_state,
-					freq_update_do_work);
-			freq_container->time_now = ktime_get_boot_ns();
-			freq_container->value = value;
-			pr_debug("Scheduling freq update in work queue\n");
-			queue_work(memory_wq, &freq_container->update_state);
-		} else {
+		if (!init_success)
+			return;
+		freq_idx = find_freq_index(value);
+		if (freq_idx < 0) {
 			pr_debug("Freq does not exist.\n");
+			return;
 		}
+		update_table(freq_idx, -1);
 	}
 }
 
 static void memory_state_bw_update(struct memory_state_update_block *ub,
 		int value)
 {
+	int bucket;
+
 	if (IS_ENABLED(CONFIG_MEMORY_STATE_TIME)) {
-		if (init_success) {
-			struct queue_container *bw_container
-				= kmalloc(sizeof(struct queue_container),
-				GFP_KERNEL);
-			if (!bw_container)
-				return;
-			INIT_WORK(&bw_container->update_state,
-					bw_update_do_work);
-			bw_container->time_now = ktime_get_boot_ns();
-			bw_container->value = value;
-			bw_container->id = ub->id;
-			pr_debug("Scheduling bandwidth update in work queue\n");
-			queue_work(memory_wq, &bw_container->update_state);
-		}
+		if (!init_success)
+			return;
+		bucket = find_bucket(calculate_total_bw(value, ub->id));
+		update_table(-1, bucket);
 	}
 }
 
@@ -287,6 +252,27 @@ struct memory_state_update_block *memory_state_register_bandwidth_source(void)
 }
 EXPORT_SYMBOL_GPL(memory_state_register_bandwidth_source);
 
+/* Precompute the lowest bucket for every 1 << bw_lut_shift wide slice of
+ * bandwidth, so find_bucket() only has to step over boundaries that fall
+ * inside the slice.
+ */
+static void bw_lut_init(void)
+{
+	u32 max_bw = bw_buckets[num_buckets - 1];
+	int i, bucket = 0;
+
+	bw_lut_shift = 0;
+	while ((max_bw >> bw_lut_shift) >= ARRAY_SIZE(bw_lut))
+		bw_lut_shift++;
+
+	for (i = 0; i < ARRAY_SIZE(bw_lut); i++) {
+		while (bucket < num_buckets - 1 &&
+		       bw_buckets[bucket] <= ((u32)i << bw_lut_shift))
+			bucket++;
+		bw_lut[i] = bucket;
+	}
+}
+
 /* Buckets are designated by their maximum.
  * Returns the buckets decided by the capability of the device.
  */
@@ -306,6 +292,12 @@ static int get_bw_buckets(struct device *dev)
 	if (!bandwidths)
 		return -ENOMEM;
 	lenb /= sizeof(*bw_buckets);
+	/* bucket indices are stored in bw_lut */
+	if (lenb > U16_MAX + 1) {
+		devm_kfree(dev, bandwidths);
+		pr_err("Too many entries in %s\n", BW_TBL);
+		return -EINVAL;
+	}
 	bw_buckets = devm_kzalloc(dev, lenb * sizeof(*bw_buckets),
 			GFP_KERNEL);
 	if (!bw_buckets) {
@@ -321,8 +313,8 @@ static int get_bw_buckets(struct device *dev)
 		return ret;
 	}
 
-	curr_bw = 0;
 	num_buckets = lenb;
+	bw_lut_init();
 	return 0;
 }
 
@@ -357,24 +349,24 @@ static int freq_buckets_init(struct device *dev)
 	pr_debug("ret freq %d\n", ret);
 
 	num_freqs = lenf;
-	curr_freq = freq_buckets[LOWEST_FREQ];
+	mem_state.state = MEM_STATE(LOWEST_FREQ, 0);
 
 	for (i = 0; i < num_freqs; i++) {
 		freq_entry = devm_kzalloc(dev, sizeof(struct freq_entry),
 				GFP_KERNEL);
 		if (!freq_entry)
 			return -ENOMEM;
-		freq_entry->buckets = devm_kzalloc(dev, sizeof(u64)*num_buckets,
-				GFP_KERNEL);
-		if (!freq_entry->buckets) {
-			devm_kfree(dev, freq_entry);
-			return -ENOMEM;
-		}
 		pr_debug("memory_state_time Adding freq to ht %d\n",
 				freq_buckets[i]);
 		freq_entry->freq = freq_buckets[i];
+		freq_entry->index = i;
 		hash_add(freq_hash_table, &freq_entry->hash, freq_buckets[i]);
 	}
+
+	state_time = __alloc_percpu(sizeof(s64) * num_freqs * num_buckets,
+			__alignof__(s64));
+	if (!state_time)
+		return -ENOMEM;
 	return 0;
 }
 
@@ -400,7 +392,7 @@ static int memory_state_time_probe(struct platform_device *pdev)
 	error = freq_buckets_init(&pdev->dev);
 	if (error)
 		return error;
-	last_update = ktime_get_boot_ns();
+	mem_state.last_update = ktime_get_boot_ns();
 	init_success = true;
 
 	pr_debug("memory_state_time initialized with num_freqs %d\n",
@@ -427,19 +419,13 @@ static int __init memory_state_time_init(void)
 	int error;
 
 	hash_init(freq_hash_table);
-	memory_wq = create_singlethread_workqueue("memory_wq");
-	if (!memory_wq) {
-		pr_err("Unable to create workqueue.\n");
-		return -EINVAL;
-	}
 	/*
 	 * Create sys/kernel directory for memory_state_time.
 	 */
 	memory_kobj = kobject_create_and_add(TAG, kernel_kobj);
 	if (!memory_kobj) {
 		pr_err("Unable to allocate memory_kobj for sysfs directory.\n");
-		error = -ENOMEM;
-		goto wq;
+		return -ENOMEM;
 	}
 	error = sysfs_create_group(memory_kobj, &memory_attr_group);
 	if (error) {
@@ -456,7 +442,6 @@ static int __init memory_state_time_init(void)
 
 group:	sysfs_remove_group(memory_kobj, &memory_attr_group);
 kobj:	kobject_put(memory_kobj);
-wq:	destroy_workqueue(memory_wq);
 	return error;
 }
 module_init(memory_state_time_init);
@@ -202,6 +202,11 @@ struct scsc_qos_service {
 	bool                           of_table_present;
 	u32                            number_of_outstanding_hci_events;
 	u32                            number_of_outstanding_acl_packets;
+	struct delayed_work            sample_work;             /* Measures the ACL throughput while there is traffic */
+	atomic_long_t                  acl_bytes;               /* ACL payload octets since the previous sample */
+	u32                            acl_kbps;
+	u32                            throughput_state;
+	u32                            throughput_down_samples; /* Consecutive samples below the current state */
 	struct pm_qos_request          pm_qos_int;
 	struct pm_qos_request          pm_qos_bus;
 	struct pm_qos_request          pm_qos_cluster0_freq_min;
@@ -404,6 +409,7 @@ extern struct scsc_ant_service ant_service;
 /* Can't use HCI_L2CAP_CID(data), since that assumes 4 bytes of HCI header, which has been stripped
  * for the calls to the avdtp detection functions */
 #define HCI_L2CAP_RX_CID(data)                  ((u16)(*(data + 2) | (*(data + 3)) << 8))
+#define HCI_L2CAP_RX_LENGTH(data)               ((u16)(*(data + 0) | (*(data + 1)) << 8))
 
 #define HCI_L2CAP_CODE(data)                    ((u8)(*(data + 4)))
 #define HCI_L2CAP_CON_REQ_PSM(data)             ((u16)(*(data + 8) | (*(data + 9)) << 8))
@@ -484,6 +490,7 @@ void scsc_avdtp_detect_exit(void);
 void scsc_bt_qos_init(void);
 void scsc_bt_qos_deinit(void);
 void scsc_bt_qos_service_stop(void);
+void scsc_bt_qos_acl_bytes(size_t bytes);
 void scsc_bt_qos_update(uint32_t number_of_outstanding_hci_events,
 			uint32_t number_of_outstanding_acl_packets);
 
@@ -24,6 +24,7 @@
 #include <linux/seq_file.h>
 #include <linux/platform_device.h>
 #include <linux/of.h>
+#include <linux/workqueue.h>
 
 #include <scsc/scsc_mx.h>
 #include <scsc/scsc_mifram.h>
@@ -34,6 +35,10 @@
 
 #define SCSC_QOS_OF_TABLE_LENGTH        (12)
 
+/* ACL throughput sampling period and the number of samples below a level before stepping down */
+#define SCSC_QOS_SAMPLE_PERIOD_MS       (500)
+#define SCSC_QOS_DOWN_SAMPLES           (4)
+
 struct scsc_qos_of_table {
 	u32 firmware_bus_high;
 	u32 default_rx_throttle_bus;
@@ -56,6 +61,15 @@ static ulong pm_qos_cluster1_freq_min_value = 0;
 static struct scsc_qos_service qos_service;
 static struct scsc_qos_of_table qos_of_table;
 
+/* ACL throughput (RX + TX payload) raising the QoS to the medium and high levels. The level is lowered
+ * again once the throughput stays below 3/4 of its threshold for SCSC_QOS_DOWN_SAMPLES samples */
+static uint qos_medium_kbps = 600;
+static uint qos_high_kbps = 1200;
+module_param(qos_medium_kbps, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(qos_medium_kbps, "ACL throughput in kbps selecting the medium QoS level");
+module_param(qos_high_kbps, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(qos_high_kbps, "ACL throughput in kbps selecting the high QoS level");
+
 static int pm_qos_set_param_cb(const char *buffer, const struct kernel_param *kp)
 {
 	int ret = param_set_ulong(buffer, kp);
@@ -120,11 +134,137 @@ void scsc_bt_qos_update(uint32_t number_of_outstanding_hci_events,
 	}
 }
 
+void scsc_bt_qos_acl_bytes(size_t bytes)
+{
+	if (!qos_service.of_table_present)
+		return;
+
+	atomic_long_add(bytes, &qos_service.acl_bytes);
+
+	/* Start sampling on the first traffic after an idle period */
+	if (!delayed_work_pending(&qos_service.sample_work))
+		schedule_delayed_work(&qos_service.sample_work,
+				      msecs_to_jiffies(SCSC_QOS_SAMPLE_PERIOD_MS));
+}
+
+static u32 scsc_bt_qos_throughput_threshold(u32 state)
+{
+	return state >= 2 ? qos_high_kbps : qos_medium_kbps;
+}
+
+/* Raises the throughput state at once and lowers it one level at a time with hysteresis.
+ * down_samples holds the number of consecutive samples below the current state */
+static u32 scsc_bt_qos_next_throughput_state(u32 state, u32 kbps, u32 *down_samples)
+{
+	u32 target = 0;
+
+	if (kbps >= qos_high_kbps)
+		target = 2;
+	else if (kbps >= qos_medium_kbps)
+		target = 1;
+
+	if (target >= state || kbps >= scsc_bt_qos_throughput_threshold(state) / 4 * 3) {
+		*down_samples = 0;
+		return max(target, state);
+	}
+
+	if (++(*down_samples) < SCSC_QOS_DOWN_SAMPLES)
+		return state;
+
+	*down_samples = 0;
+
+	return state - 1;
+}
+
+/* Sampling continues until the link is idle at the lowest level */
+static bool scsc_bt_qos_keep_sampling(unsigned long bytes, u32 state)
+{
+	return bytes || state;
+}
+
+/* Feeds a synthetic sequence of kbps samples, e.g. "1500,1500,0,0,0,0,0,0,0,0", through the
+ * throughput state machine and reports the state after each sample. "*" marks the sample
+ * after which sampling stops. The live state is not touched */
+static char qos_throughput_test_result[256];
+
+static int scsc_bt_qos_throughput_test_set(const char *val, const struct kernel_param *kp)
+{
+	char *buf, *cur, *tok;
+	size_t len = 0;
+	u32 state = 0;
+	u32 down_samples = 0;
+	u32 kbps;
+	int ret = 0;
+
+	buf = kstrdup(val, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	qos_throughput_test_result[0] = '\0';
+	cur = strim(buf);
+	while ((tok = strsep(&cur, ",")) != NULL) {
+		ret = kstrtou32(strim(tok), 0, &kbps);
+		if (ret)
+			break;
+
+		state = scsc_bt_qos_next_throughput_state(state, kbps, &down_samples);
+		len += scnprintf(qos_throughput_test_result + len,
+				 sizeof(qos_throughput_test_result) - len, "%s%u%s",
+				 len ? " " : "", state,
+				 scsc_bt_qos_keep_sampling(kbps, state) ? "" : "*");
+	}
+	kfree(buf);
+
+	SCSC_TAG_INFO(BT_COMMON, "Bluetooth QoS throughput test: %s\n", qos_throughput_test_result);
+
+	return ret;
+}
+
+static int scsc_bt_qos_throughput_test_get(char *buffer, const struct kernel_param *kp)
+{
+	return sprintf(buffer, "%s\n", qos_throughput_test_result);
+}
+
+static struct kernel_param_ops scsc_bt_qos_throughput_test_ops = {
+	.set = scsc_bt_qos_throughput_test_set,
+	.get = scsc_bt_qos_throughput_test_get,
+};
+
+module_param_cb(qos_throughput_test, &scsc_bt_qos_throughput_test_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(qos_throughput_test, "Comma separated kbps samples to run through the QoS throughput states");
+
+static void scsc_bt_qos_sample_work(struct work_struct *data)
+{
+	unsigned long bytes = atomic_long_xchg(&qos_service.acl_bytes, 0);
+	u32 state;
+
+	qos_service.acl_kbps = (u32)(bytes * 8 / SCSC_QOS_SAMPLE_PERIOD_MS);
+	state = scsc_bt_qos_next_throughput_state(qos_service.throughput_state, qos_service.acl_kbps,
+						  &qos_service.throughput_down_samples);
+
+	if (state != qos_service.throughput_state) {
+		SCSC_TAG_DEBUG(BT_COMMON, "Bluetooth QoS throughput state %u -> %u (%u kbps)\n",
+			       qos_service.throughput_state, state, qos_service.acl_kbps);
+		qos_service.throughput_state = state;
+		schedule_work(&qos_service.work_queue);
+	}
+
+	if (scsc_bt_qos_keep_sampling(bytes, state))
+		schedule_delayed_work(&qos_service.sample_work,
+				      msecs_to_jiffies(SCSC_QOS_SAMPLE_PERIOD_MS));
+}
+
 void scsc_bt_qos_service_stop(void)
 {
+	cancel_delayed_work_sync(&qos_service.sample_work);
+
 	/* Throttle down to minimum on Bluetooth service close */
 	qos_service.number_of_outstanding_hci_events = 0;
 	qos_service.number_of_outstanding_acl_packets = 0;
+	atomic_long_set(&qos_service.acl_bytes, 0);
+	qos_service.acl_kbps = 0;
+	qos_service.throughput_state = 0;
+	qos_service.throughput_down_samples = 0;
 	if (qos_service.of_table_present)
 		schedule_work(&qos_service.work_queue);
 }
@@ -137,20 +277,28 @@ static void scsc_bt_qos_work(struct work_struct *data)
 					   qos_of_table.default_rx_throttle_cluster1);
 	u32 level = max(qos_service.number_of_outstanding_acl_packets,
 			qos_service.number_of_outstanding_hci_events);
+	u32 state = qos_service.throughput_state;
+
+	/* The queue depth and the measured throughput each select a state, the higher one is applied */
+	if (level > qos_of_table.high_rx_throttle_level)
+		state = 2;
+	else if (level > qos_of_table.medium_rx_throttle_level)
+		state = max(state, 1U);
 
-	if (level > qos_of_table.high_rx_throttle_level) {
+	if (state == 2) {
 		pm_qos_int_max = max(pm_qos_int_max, qos_of_table.high_rx_throttle_int);
 		pm_qos_bus_max = max(pm_qos_bus_max, qos_of_table.high_rx_throttle_bus);
 		pm_qos_cluster1_freq_min = max(pm_qos_cluster1_freq_min,
 					       qos_of_table.high_rx_throttle_cluster1);
-	} else if (level > qos_of_table.medium_rx_throttle_level) {
+	} else if (state == 1) {
 		pm_qos_int_max = max(pm_qos_int_max, qos_of_table.medium_rx_throttle_int);
 		pm_qos_bus_max = max(pm_qos_bus_max, qos_of_table.medium_rx_throttle_bus);
 		pm_qos_cluster1_freq_min = max(pm_qos_cluster1_freq_min,
 					       qos_of_table.medium_rx_throttle_cluster1);
 	}
 
-	SCSC_TAG_DEBUG(BT_COMMON, "Bluetooth QoS update (Level: %u)\n", level);
+	SCSC_TAG_DEBUG(BT_COMMON, "Bluetooth QoS update (Level: %u, %u kbps, State: %u)\n",
+		       level, qos_service.acl_kbps, state);
 
 	pm_qos_update_request(&qos_service.pm_qos_int,
 			      pm_qos_int_max);
@@ -178,10 +326,14 @@ void scsc_bt_qos_init(void)
 			   pm_qos_cluster1_freq_min_value);
 
 	INIT_WORK(&qos_service.work_queue, scsc_bt_qos_work);
+	INIT_DELAYED_WORK(&qos_service.sample_work, scsc_bt_qos_sample_work);
 }
 
 void scsc_bt_qos_deinit(void)
 {
+	cancel_delayed_work_sync(&qos_service.sample_work);
+	cancel_work_sync(&qos_service.work_queue);
+
 	pm_qos_remove_request(&qos_service.pm_qos_int);
 	pm_qos_remove_request(&qos_service.pm_qos_bus);
 	pm_qos_remove_request(&qos_service.pm_qos_cluster0_freq_min);
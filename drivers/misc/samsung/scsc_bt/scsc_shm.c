@@ -54,6 +54,17 @@ static u8   h4_hci_event_hardware_error[4] = { HCI_EVENT_PKT, HCI_EVENT_HARDWARE
 static u8   h4_iq_report_evt[HCI_IQ_REPORT_MAX_LEN];
 static u32  h4_iq_report_evt_len;
 static u16  h4_irq_mask;
+static ktime_t h4_write_ktime;
+
+/* Time from the start of write() to the doorbell of each ACL data packet */
+#define ACL_TX_LATENCY_BUCKETS 16
+static struct {
+	u64 count;
+	u64 direct_count;
+	u64 total_ns;
+	u64 max_ns;
+	u32 hist[ACL_TX_LATENCY_BUCKETS]; /* bucket n counts [2^(n-1), 2^n) usec */
+} acl_tx_latency;
 
 static void scsc_bt_shm_irq_handler(int irqbit, void *data)
 {
@@ -279,25 +290,10 @@ static ssize_t scsc_bt_shm_h4_hci_cmd_write(const unsigned char *data, size_t co
 	return count;
 }
 
-static ssize_t scsc_bt_shm_h4_acl_write(const unsigned char *data, size_t count)
+static int scsc_bt_shm_h4_acl_alloc_slot(void)
 {
-	/* Store the read/write pointer on the stack since both are placed in unbuffered/uncached memory */
-	uint32_t                     tr_read = bt_service.bsmhcp_protocol->header.mailbox_acl_tx_read;
-	uint32_t                     tr_write = bt_service.bsmhcp_protocol->header.mailbox_acl_tx_write;
-
-	/* Temp vars */
-	struct BSMHCP_TD_ACL_TX_DATA *td = &bt_service.bsmhcp_protocol->acl_tx_data_transfer_ring[tr_write];
-	int                          acldata_buf_index = -1;
-	u16                          l2cap_length;
-	u32                          i;
-	size_t                       payload_len = count - ACLDATA_HEADER_SIZE;
-
-	/* Index out of bounds check */
-	if (tr_read >= BSMHCP_TRANSFER_RING_ACL_SIZE || tr_write >= BSMHCP_TRANSFER_RING_ACL_SIZE) {
-		SCSC_TAG_ERR(BT_H4, "ACL_DATA_PKT - Index out of bounds (tr_read=%u, tr_write=%u)\n", tr_read, tr_write);
-		atomic_inc(&bt_service.error_count);
-		return -EIO;
-	}
+	int acldata_buf_index = -1;
+	u32 i;
 
 	/* Allocate a data slot */
 	for (i = 0; i < BSMHCP_DATA_BUFFER_TX_ACL_SIZE; i++) {
@@ -317,6 +313,47 @@ static ssize_t scsc_bt_shm_h4_acl_write(const unsigned char *data, size_t count)
 	if (acldata_buf_index < 0) {
 		SCSC_TAG_ERR(BT_H4, "ACL_DATA_PKT - No buffers available\n");
 		atomic_inc(&bt_service.error_count);
+	}
+
+	return acldata_buf_index;
+}
+
+/* Releases a slot claimed by scsc_bt_shm_h4_acl_alloc_slot() that was never handed to the firmware */
+static void scsc_bt_shm_h4_acl_free_slot(int acldata_buf_index)
+{
+	bt_service.allocated[acldata_buf_index] = 0;
+	bt_service.allocated_count--;
+}
+
+static void scsc_bt_shm_h4_acl_tx_latency(void)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), h4_write_ktime));
+
+	acl_tx_latency.count++;
+	acl_tx_latency.total_ns += ns;
+	if (ns > acl_tx_latency.max_ns)
+		acl_tx_latency.max_ns = ns;
+	acl_tx_latency.hist[min_t(u32, fls64(div_u64(ns, NSEC_PER_USEC)), ACL_TX_LATENCY_BUCKETS - 1)]++;
+}
+
+/* Queues an ACL data packet whose payload has been written into the acldata_buf_index slot */
+static ssize_t scsc_bt_shm_h4_acl_submit(const unsigned char *data, int acldata_buf_index, size_t count)
+{
+	/* Store the read/write pointer on the stack since both are placed in unbuffered/uncached memory */
+	uint32_t                     tr_read = bt_service.bsmhcp_protocol->header.mailbox_acl_tx_read;
+	uint32_t                     tr_write = bt_service.bsmhcp_protocol->header.mailbox_acl_tx_write;
+
+	/* Temp vars */
+	struct BSMHCP_TD_ACL_TX_DATA *td = &bt_service.bsmhcp_protocol->acl_tx_data_transfer_ring[tr_write];
+	const unsigned char          *payload = &bt_service.bsmhcp_protocol->acl_tx_buffer[acldata_buf_index][0];
+	u16                          l2cap_length;
+	size_t                       payload_len = count - ACLDATA_HEADER_SIZE;
+
+	/* Index out of bounds check */
+	if (tr_read >= BSMHCP_TRANSFER_RING_ACL_SIZE || tr_write >= BSMHCP_TRANSFER_RING_ACL_SIZE) {
+		SCSC_TAG_ERR(BT_H4, "ACL_DATA_PKT - Index out of bounds (tr_read=%u, tr_write=%u)\n", tr_read, tr_write);
+		atomic_inc(&bt_service.error_count);
+		scsc_bt_shm_h4_acl_free_slot(acldata_buf_index);
 		return -EIO;
 	}
 
@@ -341,18 +378,18 @@ static ssize_t scsc_bt_shm_h4_acl_write(const unsigned char *data, size_t count)
 		    (td->flags & BSMHCP_ACL_PB_FLAG_MASK) == BSMHCP_ACL_PB_FLAG_START_FLUSH) {
 
 			/* Extract the L2CAP payload length and connection identifier */
-			td->l2cap_cid = HCI_L2CAP_CID(data);
+			td->l2cap_cid = HCI_L2CAP_RX_CID(payload);
 
-			/* data+4 to skip the HCI header, to align offsets with the rx detection. The "true" argument is to tell
+			/* The payload starts after the HCI header, as the rx detection expects. The "true" argument is to tell
 			 * the detection that this is TX */
-			scsc_avdtp_detect_rxtx(td->hci_connection_handle, data+4, td->length, true);
+			scsc_avdtp_detect_rxtx(td->hci_connection_handle, payload, td->length, true);
 
-			l2cap_length = HCI_L2CAP_LENGTH(data);
+			l2cap_length = HCI_L2CAP_RX_LENGTH(payload);
 
 			SCSC_TAG_DEBUG(BT_TX, "ACL[START] (len=%u, buffer=%u, credits=%u, l2cap_cid=0x%04x, l2cap_length=%u)\n",
 				td->length, acldata_buf_index,
 				BSMHCP_DATA_BUFFER_TX_ACL_SIZE - (bt_service.allocated_count - bt_service.freed_count),
-				HCI_L2CAP_CID(data), l2cap_length);
+				HCI_L2CAP_RX_CID(payload), l2cap_length);
 
 			if (l2cap_length == payload_len - L2CAP_HEADER_SIZE)
 				/* Mark it with the END flag if packet length matches the L2CAP payload length */
@@ -368,7 +405,7 @@ static ssize_t scsc_bt_shm_h4_acl_write(const unsigned char *data, size_t count)
 				/* This is only a fragment of the packet. Save the remaining number of octets required
 				 * to complete the packet */
 				bt_service.connection_handle_list[td->hci_connection_handle].length = (u16)(l2cap_length - payload_len + L2CAP_HEADER_SIZE);
-				bt_service.connection_handle_list[td->hci_connection_handle].l2cap_cid = HCI_L2CAP_CID(data);
+				bt_service.connection_handle_list[td->hci_connection_handle].l2cap_cid = HCI_L2CAP_RX_CID(payload);
 			} else {
 				/* The packet is larger than the L2CAP payload length - protocol error */
 				SCSC_TAG_ERR(BT_H4, "ACL_DATA_PKT - L2CAP Length Error (l2cap_length=%u, payload_len=%zu)\n",
@@ -430,8 +467,6 @@ static ssize_t scsc_bt_shm_h4_acl_write(const unsigned char *data, size_t count)
 			wake_lock(&bt_service.write_wake_lock);
 		}
 
-		/* Copy the ACL packet into the targer buffer */
-		memcpy(&bt_service.bsmhcp_protocol->acl_tx_buffer[acldata_buf_index][0], &data[ACLDATA_HEADER_SIZE], payload_len);
 		/* Increate the write pointer */
 		BSMHCP_INCREASE_INDEX(tr_write, BSMHCP_TRANSFER_RING_ACL_SIZE);
 		bt_service.bsmhcp_protocol->header.mailbox_acl_tx_write = tr_write;
@@ -447,6 +482,9 @@ static ssize_t scsc_bt_shm_h4_acl_write(const unsigned char *data, size_t count)
 			/* Trigger the interrupt in the mailbox */
 			scsc_service_mifintrbit_bit_set(bt_service.service,
 							bt_service.bsmhcp_protocol->header.ap_to_fg_int_src, SCSC_MIFINTR_TARGET_R4);
+
+		scsc_bt_shm_h4_acl_tx_latency();
+		scsc_bt_qos_acl_bytes(payload_len);
 	} else {
 		/* Transfer ring full. Only happens if the user attempt to send more ACL data packets than
 		 * available credits */
@@ -459,6 +497,55 @@ static ssize_t scsc_bt_shm_h4_acl_write(const unsigned char *data, size_t count)
 	return count;
 }
 
+static ssize_t scsc_bt_shm_h4_acl_write(const unsigned char *data, size_t count)
+{
+	int acldata_buf_index = scsc_bt_shm_h4_acl_alloc_slot();
+
+	if (acldata_buf_index < 0)
+		return -EIO;
+
+	/* Copy the ACL packet into the targer buffer */
+	memcpy(&bt_service.bsmhcp_protocol->acl_tx_buffer[acldata_buf_index][0], &data[ACLDATA_HEADER_SIZE],
+	       count - ACLDATA_HEADER_SIZE);
+
+	return scsc_bt_shm_h4_acl_submit(data, acldata_buf_index, count);
+}
+
+/* Sends a complete H4 ACL data packet at buf by copying its payload from user memory straight into the
+ * shared memory slot. Returns 0 if buf does not start with a complete ACL data packet */
+static ssize_t scsc_bt_shm_h4_acl_write_direct(const char __user *buf, size_t count)
+{
+	size_t  hci_pkt_len;
+	ssize_t ret;
+	int     acldata_buf_index;
+
+	if (copy_from_user(h4_write_buffer, buf, H4DMUX_HEADER_ACL) || HCI_ACLDATA_PKT != h4_write_buffer[0])
+		return 0;
+
+	/* Extract the ACL data packet length */
+	hci_pkt_len = (h4_write_buffer[3] | (h4_write_buffer[4] << 8));
+	if (hci_pkt_len > BSMHCP_ACL_PACKET_SIZE || (hci_pkt_len + H4DMUX_HEADER_ACL) > count)
+		return 0;
+
+	acldata_buf_index = scsc_bt_shm_h4_acl_alloc_slot();
+	if (acldata_buf_index < 0)
+		return -EIO;
+
+	if (copy_from_user(&bt_service.bsmhcp_protocol->acl_tx_buffer[acldata_buf_index][0],
+			   &buf[H4DMUX_HEADER_ACL], hci_pkt_len)) {
+		scsc_bt_shm_h4_acl_free_slot(acldata_buf_index);
+		return -EACCES;
+	}
+
+	ret = scsc_bt_shm_h4_acl_submit(&h4_write_buffer[1], acldata_buf_index, hci_pkt_len + ACLDATA_HEADER_SIZE);
+	if (ret < 0)
+		return ret;
+
+	acl_tx_latency.direct_count++;
+
+	return hci_pkt_len + H4DMUX_HEADER_ACL;
+}
+
 #ifdef CONFIG_SCSC_PRINTK
 static const char *scsc_hci_evt_decode_event_code(u8 hci_event_code, u8 hci_ulp_sub_code)
 {
@@ -743,6 +830,8 @@ static ssize_t scsc_acl_read(char __user *buf, size_t len)
 				bt_service.read_offset = 0;
 				bt_service.read_operation = BT_READ_OP_NONE;
 
+				scsc_bt_qos_acl_bytes(td->length);
+
 				/* Only supported on start packet*/
 				if (td->packet_boundary == HCI_ACL_PACKET_BOUNDARY_START_FLUSH)
 					/* The "false" argument is to tell the detection that this is RX */
@@ -1499,7 +1588,20 @@ ssize_t scsc_bt_shm_h4_write(struct file *file, const char __user *buf, size_t c
 		return -EIO;
 	}
 
+	h4_write_ktime = ktime_get();
+
 	while (written != count && 0 == ret) {
+		/* Complete ACL data packets skip the intermediate buffer */
+		if (0 == bt_service.h4_write_offset && (count - written) >= H4DMUX_HEADER_ACL) {
+			ret = scsc_bt_shm_h4_acl_write_direct(&buf[written], count - written);
+			if (ret > 0) {
+				written += ret;
+				ret = 0;
+				continue;
+			} else if (ret < 0)
+				break;
+		}
+
 		length = min(count - written, sizeof(h4_write_buffer) - bt_service.h4_write_offset);
 		SCSC_TAG_DEBUG(BT_H4, "count: %zu, length: %zu, h4_write_offset: %zu, written:%zu, size:%zu\n",
 			       count, length, bt_service.h4_write_offset, written, sizeof(h4_write_buffer));
@@ -1620,6 +1722,38 @@ unsigned scsc_bt_shm_h4_poll(struct file *file, poll_table *wait)
 	return POLLOUT; /* writeable */
 }
 
+static int scsc_bt_acl_tx_latency_get_param_cb(char *buffer, const struct kernel_param *kp)
+{
+	int len, i;
+
+	len = sprintf(buffer, "count=%llu direct=%llu avg_ns=%llu max_ns=%llu\nhist_us:",
+		      acl_tx_latency.count, acl_tx_latency.direct_count,
+		      acl_tx_latency.count ? div64_u64(acl_tx_latency.total_ns, acl_tx_latency.count) : 0,
+		      acl_tx_latency.max_ns);
+	for (i = 0; i < ACL_TX_LATENCY_BUCKETS; i++)
+		len += sprintf(buffer + len, " %u", acl_tx_latency.hist[i]);
+	len += sprintf(buffer + len, "\n");
+
+	return len;
+}
+
+/* Writing anything clears the statistics */
+static int scsc_bt_acl_tx_latency_set_param_cb(const char *buffer, const struct kernel_param *kp)
+{
+	memset(&acl_tx_latency, 0, sizeof(acl_tx_latency));
+
+	return 0;
+}
+
+static struct kernel_param_ops scsc_bt_acl_tx_latency_ops = {
+	.set = scsc_bt_acl_tx_latency_set_param_cb,
+	.get = scsc_bt_acl_tx_latency_get_param_cb,
+};
+
+module_param_cb(acl_tx_latency, &scsc_bt_acl_tx_latency_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(acl_tx_latency,
+		 "ACL data packets sent, of which without the H4 buffer, and their latency from write() to doorbell");
+
 /* Initialise the shared memory interface */
 int scsc_bt_shm_init(void)
 {
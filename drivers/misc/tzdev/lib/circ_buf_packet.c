@@ -7,6 +7,7 @@
  */
 
 #include <linux/err.h>
+#include <linux/kernel.h>
 #include "circ_buf.h"
 #include "circ_buf_packet.h"
 
@@ -52,6 +53,41 @@ ssize_t circ_buf_write_packet_local(struct circ_buf_desc *circ_buf_desc, const c
 	return ret;
 }
 
+ssize_t circ_buf_write_packet_vec_local(struct circ_buf_desc *circ_buf_desc,
+		const struct kvec *vec, unsigned long nr_segs,
+		enum circ_buf_user_mode mode)
+{
+	struct circ_buf_packet_header header;
+	ssize_t ret;
+	size_t length = 0;
+	unsigned long i;
+	unsigned int write_count_orig = circ_buf_desc->write_count;
+
+	for (i = 0; i < nr_segs; i++)
+		length += vec[i].iov_len;
+
+	header.packet_size = (unsigned int)length;
+
+	ret = circ_buf_write_local(circ_buf_desc, (void *) &header,
+			sizeof(struct circ_buf_packet_header), CIRC_BUF_MODE_KERNEL);
+	if (IS_ERR_VALUE(ret))
+		return ret;
+
+	for (i = 0; i < nr_segs; i++) {
+		if (!vec[i].iov_len)
+			continue;
+
+		ret = circ_buf_write_local(circ_buf_desc, vec[i].iov_base,
+				vec[i].iov_len, mode);
+		if (IS_ERR_VALUE(ret)) {
+			circ_buf_desc->write_count = write_count_orig;
+			return ret;
+		}
+	}
+
+	return length;
+}
+
 ssize_t circ_buf_read_packet(struct circ_buf_desc *circ_buf_desc, char *buf,
 		size_t length, enum circ_buf_user_mode mode)
 {
@@ -90,6 +126,47 @@ ssize_t circ_buf_read_packet_local(struct circ_buf_desc *circ_buf_desc, char *bu
 	return ret;
 }
 
+ssize_t circ_buf_read_packet_vec_local(struct circ_buf_desc *circ_buf_desc,
+		const struct kvec *vec, unsigned long nr_segs,
+		enum circ_buf_user_mode mode)
+{
+	struct circ_buf_packet_header header;
+	ssize_t ret;
+	size_t packet_size, length = 0, cur;
+	unsigned long i;
+	unsigned int read_count_orig = circ_buf_desc->read_count;
+
+	for (i = 0; i < nr_segs; i++)
+		length += vec[i].iov_len;
+
+	ret = circ_buf_read_local(circ_buf_desc, (void *) &header,
+			sizeof(struct circ_buf_packet_header), CIRC_BUF_MODE_KERNEL);
+	if (IS_ERR_VALUE(ret))
+		return ret;
+
+	packet_size = header.packet_size;
+	if (packet_size > length) {
+		circ_buf_desc->read_count = read_count_orig;
+		return -EMSGSIZE;
+	}
+
+	for (i = 0, length = packet_size; i < nr_segs && length; i++) {
+		cur = min(length, vec[i].iov_len);
+		if (!cur)
+			continue;
+
+		ret = circ_buf_read_local(circ_buf_desc, vec[i].iov_base, cur, mode);
+		if (IS_ERR_VALUE(ret)) {
+			circ_buf_desc->read_count = read_count_orig;
+			return ret;
+		}
+
+		length -= cur;
+	}
+
+	return packet_size;
+}
+
 ssize_t circ_buf_drop_packet(struct circ_buf_desc *circ_buf_desc)
 {
 	ssize_t ret;
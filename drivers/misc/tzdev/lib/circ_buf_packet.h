@@ -9,6 +9,8 @@
 #ifndef __LIB_CIRC_BUF_PACKET_H__
 #define __LIB_CIRC_BUF_PACKET_H__
 
+#include <linux/uio.h>
+
 /**
  * Function returns required size of buffer to fit packet's payload of specified size.
  * @param[in]	size	packet's payload size
@@ -42,6 +44,20 @@ ssize_t circ_buf_write_packet(struct circ_buf_desc *circ_buf_desc, const char *b
 ssize_t circ_buf_write_packet_local(struct circ_buf_desc *circ_buf_desc, const char *buf,
 		size_t length, enum circ_buf_user_mode mode);
 
+/**
+ * Function gathers specified segments into one packet written to circ_buf.
+ * Function does not update circ_buf write counter.
+ * @param[in]	circ_buf_desc	descriptor of buffer to write segments to
+ * @param[in]	vec		array of input segments
+ * @param[in]	nr_segs		number of segments in vec
+ * @param[in]	mode		enum indicating whether segments
+ *				belong to userspace or kernel memory
+ * @return	number of payload bytes written on success or error code
+ */
+ssize_t circ_buf_write_packet_vec_local(struct circ_buf_desc *circ_buf_desc,
+		const struct kvec *vec, unsigned long nr_segs,
+		enum circ_buf_user_mode mode);
+
 /**
  * Function reads packet from circ_buf to output buf.
  * Function updates circ_buf read counter.
@@ -70,6 +86,20 @@ ssize_t circ_buf_read_packet(struct circ_buf_desc *circ_buf_desc, char *buf,
 ssize_t circ_buf_read_packet_local(struct circ_buf_desc *circ_buf_desc, char *buf,
 		size_t length, enum circ_buf_user_mode mode);
 
+/**
+ * Function scatters one packet from circ_buf into specified segments.
+ * Function does not update circ_buf read counter.
+ * @param[in]	circ_buf_desc	descriptor of buffer to read from
+ * @param[in]	vec		array of output segments
+ * @param[in]	nr_segs		number of segments in vec
+ * @param[in]	mode		enum indicating whether segments
+ *				belong to userspace or kernel memory
+ * @return	number of payload bytes read on success or error code
+ */
+ssize_t circ_buf_read_packet_vec_local(struct circ_buf_desc *circ_buf_desc,
+		const struct kvec *vec, unsigned long nr_segs,
+		enum circ_buf_user_mode mode);
+
 /**
  * Function drops one packet from the circ_buf.
  * Function updates circ_buf read counter.
@@ -27,6 +27,11 @@ void tz_boost_set_boost_mask(unsigned int big_cpus_mask)
 	cpu_boost_mask = big_cpus_mask;
 }
 
+unsigned int tz_boost_get_boost_mask(void)
+{
+	return cpu_boost_mask;
+}
+
 void tz_boost_enable(void)
 {
 	mutex_lock(&tz_boost_lock);
@@ -21,6 +21,7 @@
 void tz_boost_enable(void);
 void tz_boost_disable(void);
 void tz_boost_set_boost_mask(unsigned int big_cpus_mask);
+unsigned int tz_boost_get_boost_mask(void);
 #else
 static inline void tz_boost_enable(void)
 {
@@ -34,6 +35,11 @@ static inline void tz_boost_set_boost_mask(unsigned int big_cpus_mask)
 {
 	(void) big_cpus_mask;
 }
+
+static inline unsigned int tz_boost_get_boost_mask(void)
+{
+	return 0;
+}
 #endif /* CONFIG_TZDEV_BOOST */
 
 #if defined(TZDEV_BOOST_CLUSTER_1)
@@ -13,6 +13,7 @@
 
 #include <linux/crypto.h>
 #include <linux/errno.h>
+#include <linux/ktime.h>
 #include <linux/kthread.h>
 #include <linux/mutex.h>
 #include <linux/socket.h>
@@ -104,6 +105,12 @@
 
 #define INTERNAL_EVENTS_BUF_SIZE	512
 
+/* Upper limit for SO_IWD_NOTIFY_BATCH coalescing window */
+#define NOTIFY_BATCH_MAX_USECS		10000
+
+/* Batched notification is sent at once when write buffer gets this full */
+#define NOTIFY_BATCH_THRESHOLD(size)	((size) / 2)
+
 /* Macros used for connection of circ buffers inside of shared socket's buffer */
 #define GET_SOCKET_SEND_BUF(iwd_buf)						\
 	(struct circ_buf *)((char *)iwd_buf + sizeof(struct iwd_sock_buf_head))
@@ -432,6 +439,88 @@ static void tz_iwsock_notify_internally(int32_t sid)
 	wake_up(&tz_iwsock_wq);
 }
 
+static void tz_iwsock_notify_swd_sd(struct sock_desc *sd)
+{
+	atomic64_inc(&sd->stats.swd_notifications);
+	tz_iwsock_notify_swd(sd->id);
+}
+
+static void tz_iwsock_notify_work(struct work_struct *work)
+{
+	struct sock_desc *sd = container_of(to_delayed_work(work),
+			struct sock_desc, notify_work);
+
+	if (atomic_xchg(&sd->notify_pending, 0))
+		tz_iwsock_notify_swd_sd(sd);
+
+	tz_iwsock_put_sd(sd);
+}
+
+/* Coalesce data notifications for sockets with SO_IWD_NOTIFY_BATCH set.
+ * Notification is postponed for the batch window unless write buffer is
+ * filled up to the threshold, so that SWd is entered once per burst. */
+static void tz_iwsock_notify_swd_batched(struct sock_desc *sd,
+		struct circ_buf_desc *write_buf)
+{
+	if (circ_buf_bytes_used(write_buf) >= NOTIFY_BATCH_THRESHOLD(write_buf->size)) {
+		if (atomic_xchg(&sd->notify_pending, 0))
+			atomic64_inc(&sd->stats.coalesced_notifications);
+
+		tz_iwsock_notify_swd_sd(sd);
+		return;
+	}
+
+	if (atomic_xchg(&sd->notify_pending, 1)) {
+		atomic64_inc(&sd->stats.coalesced_notifications);
+		return;
+	}
+
+	/* Reference is dropped by work handler */
+	tz_iwsock_get_sd(sd);
+	if (!schedule_delayed_work(&sd->notify_work,
+			usecs_to_jiffies(sd->notify_batch_usecs)))
+		tz_iwsock_put_sd(sd);
+}
+
+static void tz_iwsock_cancel_batched_notify(struct sock_desc *sd)
+{
+	atomic_set(&sd->notify_pending, 0);
+
+	if (cancel_delayed_work(&sd->notify_work))
+		tz_iwsock_put_sd(sd);
+}
+
+static void tz_iwsock_stats_add_latency(atomic64_t *total, atomic64_t *max,
+		ktime_t start)
+{
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	s64 old = atomic64_read(max);
+
+	atomic64_add(ns, total);
+
+	while (ns > old) {
+		s64 prev = atomic64_cmpxchg(max, old, ns);
+
+		if (prev == old)
+			break;
+		old = prev;
+	}
+}
+
+static void tz_iwsock_get_stats(struct sock_desc *sd, struct tz_iwsock_stats *stats)
+{
+	stats->tx_packets = atomic64_read(&sd->stats.tx_packets);
+	stats->tx_bytes = atomic64_read(&sd->stats.tx_bytes);
+	stats->rx_packets = atomic64_read(&sd->stats.rx_packets);
+	stats->rx_bytes = atomic64_read(&sd->stats.rx_bytes);
+	stats->swd_notifications = atomic64_read(&sd->stats.swd_notifications);
+	stats->coalesced_notifications = atomic64_read(&sd->stats.coalesced_notifications);
+	stats->tx_latency_ns = atomic64_read(&sd->stats.tx_latency_ns);
+	stats->tx_latency_max_ns = atomic64_read(&sd->stats.tx_latency_max_ns);
+	stats->rx_latency_ns = atomic64_read(&sd->stats.rx_latency_ns);
+	stats->rx_latency_max_ns = atomic64_read(&sd->stats.rx_latency_max_ns);
+}
+
 struct sock_desc *tz_iwsock_socket(unsigned int is_kern)
 {
 	struct sock_desc *sd;
@@ -445,8 +534,10 @@ struct sock_desc *tz_iwsock_socket(unsigned int is_kern)
 	memset(sd, 0, sizeof(struct sock_desc));
 
 	atomic_set(&sd->ref_count, 1);
+	atomic_set(&sd->notify_pending, 0);
 	init_waitqueue_head(&sd->wq);
 	mutex_init(&sd->lock);
+	INIT_DELAYED_WORK(&sd->notify_work, tz_iwsock_notify_work);
 
 	sd->mm = ERR_PTR(-EINVAL);
 
@@ -525,6 +616,7 @@ static int tz_iwsock_getsockopt_socket(struct sock_desc *sd,
 static int tz_iwsock_getsockopt_iwd(struct sock_desc *sd,
 		int optname, void *optval, socklen_t *optlen)
 {
+	struct tz_iwsock_stats stats;
 	unsigned int size = sizeof(uint32_t);
 
 	switch (optname) {
@@ -536,6 +628,26 @@ static int tz_iwsock_getsockopt_iwd(struct sock_desc *sd,
 				sizeof(sd->max_msg_size), sd->is_kern))
 			return -EFAULT;
 
+		return 0;
+	case SO_IWD_NOTIFY_BATCH:
+		if (tz_iwsock_copy_to(optlen, &size, sizeof(size), sd->is_kern))
+			return -EFAULT;
+
+		if (tz_iwsock_copy_to(optval, &sd->notify_batch_usecs,
+				sizeof(sd->notify_batch_usecs), sd->is_kern))
+			return -EFAULT;
+
+		return 0;
+	case SO_IWD_STATS:
+		size = sizeof(stats);
+		tz_iwsock_get_stats(sd, &stats);
+
+		if (tz_iwsock_copy_to(optlen, &size, sizeof(size), sd->is_kern))
+			return -EFAULT;
+
+		if (tz_iwsock_copy_to(optval, &stats, sizeof(stats), sd->is_kern))
+			return -EFAULT;
+
 		return 0;
 	default:
 		return -ENOPROTOOPT;
@@ -610,6 +722,17 @@ static int tz_iwsock_setsockopt_iwd(struct sock_desc *sd,
 		else
 			sd->max_msg_size = 0;
 
+		return 0;
+	case SO_IWD_NOTIFY_BATCH:
+		if (optlen != sizeof(unsigned int))
+			return -EINVAL;
+		if (tz_iwsock_copy_from(&size, optval, optlen, sd->is_kern))
+			return -EFAULT;
+		if (size > NOTIFY_BATCH_MAX_USECS)
+			return -EINVAL;
+
+		sd->notify_batch_usecs = size;
+
 		return 0;
 	default:
 		return -ENOPROTOOPT;
@@ -623,7 +746,9 @@ int tz_iwsock_setsockopt(struct sock_desc *sd, int level,
 
 	mutex_lock(&sd->lock);
 
-	if (sd->state != TZ_SK_NEW) {
+	/* Notification batching may be changed on connected socket as well */
+	if (sd->state != TZ_SK_NEW &&
+			!(level == SOL_IWD && optname == SO_IWD_NOTIFY_BATCH)) {
 		ret = -EBUSY;
 		goto unlock;
 	}
@@ -976,6 +1101,9 @@ void tz_iwsock_release(struct sock_desc *sd)
 
 	mutex_unlock(&sd->lock);
 
+	/* Release notification below covers any postponed one */
+	tz_iwsock_cancel_batched_notify(sd);
+
 	if (notify_swd)
 		tz_iwsock_notify_swd(sd->id);
 	else if (notify_nwd)
@@ -987,8 +1115,8 @@ void tz_iwsock_release(struct sock_desc *sd)
 }
 
 static int __tz_iwsock_read(struct sock_desc *sd, struct circ_buf_desc *read_buf,
-			void *buf1, size_t len1, void *buf2, size_t len2, int flags,
-			unsigned int *need_notify)
+			void *buf1, size_t len1, const struct kvec *vec,
+			unsigned long nr_segs, int flags, unsigned int *need_notify)
 {
 	int mode = (sd->is_kern) ? CIRC_BUF_MODE_KERNEL : CIRC_BUF_MODE_USER;
 	int swd_state;
@@ -1021,10 +1149,15 @@ static int __tz_iwsock_read(struct sock_desc *sd, struct circ_buf_desc *read_buf
 	if (IS_ERR_VALUE(ret))
 		goto recheck;
 
-	ret = circ_buf_read_packet(read_buf,
-			buf2, len2, mode);
-	if (IS_ERR_VALUE(ret))
+	ret = circ_buf_read_packet_vec_local(read_buf, vec, nr_segs, mode);
+	if (IS_ERR_VALUE(ret)) {
 		circ_buf_rollback_read(&sd->read_buf);
+	} else {
+		circ_buf_flush_read(read_buf);
+
+		atomic64_inc(&sd->stats.rx_packets);
+		atomic64_add(ret, &sd->stats.rx_bytes);
+	}
 
 	if (sd->max_msg_size) {
 		nbytes = circ_buf_size_for_packet(sd->max_msg_size) * 2;
@@ -1045,32 +1178,56 @@ unlock:
 	return ret;
 }
 
-ssize_t tz_iwsock_read(struct sock_desc *sd, void *buf, size_t count, int flags)
+static ssize_t tz_iwsock_do_read(struct sock_desc *sd, const struct kvec *vec,
+		unsigned long nr_segs, int flags)
 {
 	struct tz_cmsghdr_cred cred;
 	int res = 0, ret = 0;
 	unsigned int need_notify = 0;
+	ktime_t start = ktime_get();
 
 	if (sd->is_kern)
 		tz_iwsock_wait_event(sd->wq,
 				(ret = __tz_iwsock_read(sd, &sd->read_buf, &cred,
-					sizeof(cred), buf, count, flags,
+					sizeof(cred), vec, nr_segs, flags,
 					&need_notify)) != -EAGAIN);
 	else
 		res = tz_iwsock_wait_event_interruptible(sd->wq,
 				(ret = __tz_iwsock_read(sd, &sd->read_buf, &cred,
-				sizeof(cred), buf, count, flags,
+				sizeof(cred), vec, nr_segs, flags,
 				&need_notify)) != -EAGAIN);
 
 	if (res)
 		ret = res;
 
-	if (ret > 0 && need_notify)
-		tz_iwsock_notify_swd(sd->id);
+	if (ret > 0) {
+		tz_iwsock_stats_add_latency(&sd->stats.rx_latency_ns,
+				&sd->stats.rx_latency_max_ns, start);
+
+		if (need_notify)
+			tz_iwsock_notify_swd_sd(sd);
+	}
 
 	return ret;
 }
 
+ssize_t tz_iwsock_read(struct sock_desc *sd, void *buf, size_t count, int flags)
+{
+	struct kvec vec = {.iov_base = buf, .iov_len = count};
+
+	return tz_iwsock_do_read(sd, &vec, 1, flags);
+}
+
+/* Reads one message directly into the caller's segments. Kernel sockets only. */
+ssize_t tz_iwsock_readv(struct sock_desc *sd, const struct kvec *vec,
+		unsigned long nr_segs, int flags)
+{
+	if (!sd->is_kern)
+		return -EINVAL;
+
+	return tz_iwsock_do_read(sd, vec, nr_segs, flags);
+}
+
 static int tz_iwsock_format_cred_scm(struct sock_desc *sd)
 {
 	int ret;
@@ -1090,7 +1247,8 @@ static int tz_iwsock_format_cred_scm(struct sock_desc *sd)
 }
 
 static int __tz_iwsock_write(struct sock_desc *sd, struct circ_buf_desc *write_buf,
-			void *scm_buf, size_t scm_len, void *data_buf, size_t data_len, int flags)
+			void *scm_buf, size_t scm_len, const struct kvec *vec,
+			unsigned long nr_segs, size_t data_len, int flags)
 {
 	unsigned long ret;
 	int mode = (sd->is_kern) ? CIRC_BUF_MODE_KERNEL : CIRC_BUF_MODE_USER;
@@ -1129,10 +1287,15 @@ static int __tz_iwsock_write(struct sock_desc *sd, struct circ_buf_desc *write_b
 	if (IS_ERR_VALUE(ret))
 		goto unlock;
 
-	ret = circ_buf_write_packet(write_buf,
-			(char *)data_buf, data_len, mode);
-	if (IS_ERR_VALUE(ret))
+	ret = circ_buf_write_packet_vec_local(write_buf, vec, nr_segs, mode);
+	if (IS_ERR_VALUE(ret)) {
 		circ_buf_rollback_write(write_buf);
+	} else {
+		circ_buf_flush_write(write_buf);
+
+		atomic64_inc(&sd->stats.tx_packets);
+		atomic64_add(ret, &sd->stats.tx_bytes);
+	}
 
 unlock:
 	mutex_unlock(&sd->lock);
@@ -1140,34 +1303,69 @@ unlock:
 	return ret;
 }
 
-ssize_t tz_iwsock_write(struct sock_desc *sd, void *buf, size_t count, int flags)
+static ssize_t tz_iwsock_do_write(struct sock_desc *sd, const struct kvec *vec,
+		unsigned long nr_segs, int flags)
 {
 	struct circ_buf_desc *write_buf;
+	size_t count = 0;
+	unsigned long i;
 	int ret, res = 0;
+	ktime_t start = ktime_get();
 
 	write_buf = (flags & MSG_OOB) ? &sd->oob_buf : &sd->write_buf;
 
+	for (i = 0; i < nr_segs; i++)
+		count += vec[i].iov_len;
+
 	if ((ret = tz_iwsock_format_cred_scm(sd)))
 		return ret;
 
 	if (sd->is_kern)
 		tz_iwsock_wait_event(sd->wq,
 				(ret = __tz_iwsock_write(sd, write_buf, &sd->cred,
-					sizeof(sd->cred), buf, count, flags)) != -EAGAIN);
+					sizeof(sd->cred), vec, nr_segs, count,
+					flags)) != -EAGAIN);
 	else
 		res = tz_iwsock_wait_event_interruptible(sd->wq,
 			(ret = __tz_iwsock_write(sd, write_buf, &sd->cred,
-				sizeof(sd->cred), buf, count, flags)) != -EAGAIN);
+				sizeof(sd->cred), vec, nr_segs, count,
+				flags)) != -EAGAIN);
 
 	if (res)
 		ret = res;
 
-	if (ret > 0)
-		tz_iwsock_notify_swd(sd->id);
+	if (ret > 0) {
+		tz_iwsock_stats_add_latency(&sd->stats.tx_latency_ns,
+				&sd->stats.tx_latency_max_ns, start);
+
+		/* OOB data is never delayed */
+		if (sd->notify_batch_usecs && !(flags & MSG_OOB))
+			tz_iwsock_notify_swd_batched(sd, write_buf);
+		else
+			tz_iwsock_notify_swd_sd(sd);
+	}
 
 	return ret;
 }
 
+ssize_t tz_iwsock_write(struct sock_desc *sd, void *buf, size_t count, int flags)
+{
+	struct kvec vec = {.iov_base = buf, .iov_len = count};
+
+	return tz_iwsock_do_write(sd, &vec, 1, flags);
+}
+
+/* Gathers caller's segments into one message without an intermediate
+ * buffer. Kernel sockets only. */
+ssize_t tz_iwsock_writev(struct sock_desc *sd, const struct kvec *vec,
+		unsigned long nr_segs, int flags)
+{
+	if (!sd->is_kern)
+		return -EINVAL;
+
+	return tz_iwsock_do_write(sd, vec, nr_segs, flags);
+}
+
 void tz_iwsock_wake_up_all(void)
 {
 	struct sock_desc *sd;
@@ -14,6 +14,9 @@
 #ifndef __TZ_IWSOCK_H__
 #define __TZ_IWSOCK_H__
 
+#include <linux/uio.h>
+#include <linux/workqueue.h>
+
 #include "lib/circ_buf.h"
 #include "tz_cred.h"
 
@@ -23,6 +26,8 @@
 #define SOL_IWD			0xFFFD
 
 #define SO_IWD_MAX_MSG_SIZE	1
+#define SO_IWD_NOTIFY_BATCH	2
+#define SO_IWD_STATS		3
 
 #define TZ_CMSG_ALIGN(len)	(((len) + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1))
 #define TZ_CMSG_LEN(len)	(TZ_CMSG_ALIGN(sizeof(struct tz_cmsghdr)) + (len))
@@ -58,6 +63,33 @@ enum tz_endpoint_state {
 	TZ_SK_RELEASED,
 };
 
+/* Per-socket counters returned by SO_IWD_STATS */
+struct tz_iwsock_stats {
+	uint64_t tx_packets;
+	uint64_t tx_bytes;
+	uint64_t rx_packets;
+	uint64_t rx_bytes;
+	uint64_t swd_notifications;	/* notifications actually sent to SWd */
+	uint64_t coalesced_notifications;	/* notifications saved by batching */
+	uint64_t tx_latency_ns;		/* total time spent in write calls */
+	uint64_t tx_latency_max_ns;
+	uint64_t rx_latency_ns;		/* total time spent in read calls */
+	uint64_t rx_latency_max_ns;
+} __packed;
+
+struct sock_stats {
+	atomic64_t tx_packets;
+	atomic64_t tx_bytes;
+	atomic64_t rx_packets;
+	atomic64_t rx_bytes;
+	atomic64_t swd_notifications;
+	atomic64_t coalesced_notifications;
+	atomic64_t tx_latency_ns;
+	atomic64_t tx_latency_max_ns;
+	atomic64_t rx_latency_ns;
+	atomic64_t rx_latency_max_ns;
+};
+
 struct iwd_sock_buf;
 
 struct iwd_sock_buf_head {
@@ -83,6 +115,10 @@ struct sock_desc {
 	unsigned int rcv_buf_size;
 	unsigned int oob_buf_size;
 	unsigned int max_msg_size;
+	unsigned int notify_batch_usecs;
+	atomic_t notify_pending;
+	struct delayed_work notify_work;
+	struct sock_stats stats;
 };
 
 int tz_iwsock_init(void);
@@ -103,6 +139,10 @@ struct sock_desc *tz_iwsock_accept(struct sock_desc *sd);
 void tz_iwsock_release(struct sock_desc *sd);
 ssize_t tz_iwsock_read(struct sock_desc *sd, void *buf, size_t count, int flags);
 ssize_t tz_iwsock_write(struct sock_desc *sd, void *buf, size_t count, int flags);
+ssize_t tz_iwsock_readv(struct sock_desc *sd, const struct kvec *vec,
+		unsigned long nr_segs, int flags);
+ssize_t tz_iwsock_writev(struct sock_desc *sd, const struct kvec *vec,
+		unsigned long nr_segs, int flags);
 
 void tz_iwsock_put_sd(struct sock_desc *sd);
 
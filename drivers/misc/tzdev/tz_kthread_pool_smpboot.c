@@ -15,12 +15,16 @@
 #include <linux/completion.h>
 #include <linux/cpu.h>
 #include <linux/cpumask.h>
+#include <linux/debugfs.h>
 #include <linux/err.h>
+#include <linux/ktime.h>
 #include <linux/kthread.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/percpu.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/smp.h>
 #include <linux/smpboot.h>
@@ -29,6 +33,7 @@
 #include "sysdep.h"
 #include "tzdev.h"
 #include "tzlog.h"
+#include "tz_boost.h"
 #include "tz_iwservice.h"
 #include "tz_kthread_pool.h"
 #include "tz_mem.h"
@@ -40,15 +45,62 @@ enum {
 	KTHREAD_SHOULD_PARK,
 };
 
+/* Number of pending commands starting from which they are routed to
+ * big cores (see tz_boost) instead of the issuing CPU. */
+#define TZ_KTHREAD_POOL_DEEP_QUEUE	4
+
 static atomic_t tz_kthread_pool_fini_done = ATOMIC_INIT(0);
 
 static DEFINE_PER_CPU(struct task_struct *, worker);
 static DECLARE_WAIT_QUEUE_HEAD(tz_cmd_waitqueue);
 static atomic_t tz_nr_cmds = ATOMIC_INIT(0);
 
+/* Time the oldest pending command has been queued at, 0 if none */
+static atomic64_t tz_cmd_queued_ns = ATOMIC64_INIT(0);
+
+static struct {
+	atomic64_t cmds;
+	atomic64_t targeted_wakeups;
+	atomic64_t wakeups;
+	atomic64_t swd_entries;
+	atomic64_t entry_latency_samples;
+	atomic64_t entry_latency_ns;
+	atomic64_t entry_latency_max_ns;
+} tz_kthread_pool_stats;
+
+static void tz_kthread_pool_account_entry(void)
+{
+	s64 queued = atomic64_xchg(&tz_cmd_queued_ns, 0);
+	s64 latency, max;
+
+	atomic64_inc(&tz_kthread_pool_stats.swd_entries);
+
+	if (!queued)
+		return;
+
+	latency = ktime_get_ns() - queued;
+	atomic64_inc(&tz_kthread_pool_stats.entry_latency_samples);
+	atomic64_add(latency, &tz_kthread_pool_stats.entry_latency_ns);
+
+	max = atomic64_read(&tz_kthread_pool_stats.entry_latency_max_ns);
+	while (latency > max) {
+		s64 prev = atomic64_cmpxchg(&tz_kthread_pool_stats.entry_latency_max_ns,
+				max, latency);
+
+		if (prev == max)
+			break;
+		max = prev;
+	}
+}
+
 static int tz_kthread_pool_cmd_get(void)
 {
-	return atomic_dec_if_positive(&tz_nr_cmds) >= 0;
+	if (atomic_dec_if_positive(&tz_nr_cmds) < 0)
+		return 0;
+
+	tz_kthread_pool_account_entry();
+
+	return 1;
 }
 
 static int tz_kthread_pool_should_wake(unsigned long cpu)
@@ -108,6 +160,7 @@ static int tz_kthread_pool_wake_function(wait_queue_t *wait, unsigned int mode,
 				void *key)
 {
 	unsigned long cpu = (unsigned long)key;
+	int ret;
 
 	/*
 	 * Avoid a wakeup if enter to SWd should be done from
@@ -115,7 +168,12 @@ static int tz_kthread_pool_wake_function(wait_queue_t *wait, unsigned int mode,
 	 */
 	if (cpu == raw_smp_processor_id())
 		return 0;
-	return autoremove_wake_function(wait, mode, sync, key);
+
+	ret = autoremove_wake_function(wait, mode, sync, key);
+	if (ret)
+		atomic64_inc(&tz_kthread_pool_stats.wakeups);
+
+	return ret;
 }
 
 static int tz_kthread_pool_wait_for_event(unsigned long cpu)
@@ -189,9 +247,77 @@ static struct smp_hotplug_thread tz_kthread_pool_smp_hotplug = {
 	.thread_comm = "tz_worker_thread/%u",
 };
 
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *tz_kthread_pool_dentry;
+
+static int tz_kthread_pool_stats_show(struct seq_file *m, void *v)
+{
+	s64 cmds = atomic64_read(&tz_kthread_pool_stats.cmds);
+	s64 wakeups = atomic64_read(&tz_kthread_pool_stats.wakeups);
+	s64 entries = atomic64_read(&tz_kthread_pool_stats.swd_entries);
+	s64 samples = atomic64_read(&tz_kthread_pool_stats.entry_latency_samples);
+	s64 latency = atomic64_read(&tz_kthread_pool_stats.entry_latency_ns);
+	s64 ratio = cmds ? div64_s64(wakeups * 100, cmds) : 0;
+
+	seq_printf(m, "cmds:                %lld\n", cmds);
+	seq_printf(m, "pending:             %d\n", atomic_read(&tz_nr_cmds));
+	seq_printf(m, "wakeups:             %lld\n", wakeups);
+	seq_printf(m, "targeted wakeups:    %lld\n",
+			(s64)atomic64_read(&tz_kthread_pool_stats.targeted_wakeups));
+	seq_printf(m, "wakeups per 100 cmds: %lld\n", ratio);
+	seq_printf(m, "swd entries:         %lld\n", entries);
+	seq_printf(m, "entry latency avg:   %lld ns\n",
+			samples ? div64_s64(latency, samples) : 0);
+	seq_printf(m, "entry latency max:   %lld ns\n",
+			(s64)atomic64_read(&tz_kthread_pool_stats.entry_latency_max_ns));
+
+	return 0;
+}
+
+static int tz_kthread_pool_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tz_kthread_pool_stats_show, NULL);
+}
+
+static const struct file_operations tz_kthread_pool_stats_fops = {
+	.open = tz_kthread_pool_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void tz_kthread_pool_debugfs_init(void)
+{
+	tz_kthread_pool_dentry = debugfs_create_file("tz_kthread_pool", 0444,
+			NULL, NULL, &tz_kthread_pool_stats_fops);
+}
+
+static void tz_kthread_pool_debugfs_fini(void)
+{
+	debugfs_remove(tz_kthread_pool_dentry);
+	tz_kthread_pool_dentry = NULL;
+}
+#else
+static void tz_kthread_pool_debugfs_init(void)
+{
+}
+
+static void tz_kthread_pool_debugfs_fini(void)
+{
+}
+#endif /* CONFIG_DEBUG_FS */
+
 static __init int tz_kthread_pool_init(void)
 {
-	return smpboot_register_percpu_thread(&tz_kthread_pool_smp_hotplug);
+	int ret;
+
+	ret = smpboot_register_percpu_thread(&tz_kthread_pool_smp_hotplug);
+	if (ret)
+		return ret;
+
+	tz_kthread_pool_debugfs_init();
+
+	return 0;
 }
 
 early_initcall(tz_kthread_pool_init);
@@ -201,12 +327,70 @@ void tz_kthread_pool_fini(void)
 	if (atomic_cmpxchg(&tz_kthread_pool_fini_done, 0, 1))
 		return;
 
+	tz_kthread_pool_debugfs_fini();
 	smpboot_unregister_percpu_thread(&tz_kthread_pool_smp_hotplug);
 }
 
+/*
+ * Select worker to handle a new command: the issuing CPU is preferred, then
+ * idle CPUs. Once the queue gets deep commands are routed to big cores only.
+ * A worker handing its command over while parking never selects itself.
+ */
+static unsigned int tz_kthread_pool_select_cpu(int nr_cmds)
+{
+	unsigned long sk_cpu_mask;
+	unsigned long boost_mask;
+	unsigned int cpu, this_cpu;
+	cpumask_t allowed_cpu_mask;
+	cpumask_t big_cpu_mask;
+
+	sk_cpu_mask = tz_iwservice_get_cpu_mask();
+	if (sk_cpu_mask)
+		cpumask_and(&allowed_cpu_mask, to_cpumask(&sk_cpu_mask), cpu_online_mask);
+	if (!sk_cpu_mask || cpumask_empty(&allowed_cpu_mask))
+		cpumask_copy(&allowed_cpu_mask, cpu_online_mask);
+
+	if (nr_cmds >= TZ_KTHREAD_POOL_DEEP_QUEUE) {
+		boost_mask = tz_boost_get_boost_mask();
+		cpumask_and(&big_cpu_mask, &allowed_cpu_mask, to_cpumask(&boost_mask));
+		if (!cpumask_empty(&big_cpu_mask))
+			cpumask_copy(&allowed_cpu_mask, &big_cpu_mask);
+	}
+
+	this_cpu = raw_smp_processor_id();
+	if (per_cpu(worker, this_cpu) == current)
+		cpumask_clear_cpu(this_cpu, &allowed_cpu_mask);
+	else if (cpumask_test_cpu(this_cpu, &allowed_cpu_mask))
+		return this_cpu;
+
+	for_each_cpu(cpu, &allowed_cpu_mask)
+		if (idle_cpu(cpu))
+			return cpu;
+
+	return cpumask_any(&allowed_cpu_mask);
+}
+
 void tz_kthread_pool_cmd_send(void)
 {
-	atomic_inc(&tz_nr_cmds);
+	struct task_struct *tsk;
+	unsigned int cpu;
+	int nr_cmds;
+
+	atomic64_inc(&tz_kthread_pool_stats.cmds);
+	atomic64_cmpxchg(&tz_cmd_queued_ns, 0, ktime_get_ns());
+
+	nr_cmds = atomic_inc_return(&tz_nr_cmds);
+
+	cpu = tz_kthread_pool_select_cpu(nr_cmds);
+	tsk = cpu < nr_cpu_ids ? per_cpu(worker, cpu) : NULL;
+
+	if (tsk && wake_up_process(tsk)) {
+		atomic64_inc(&tz_kthread_pool_stats.targeted_wakeups);
+		atomic64_inc(&tz_kthread_pool_stats.wakeups);
+		return;
+	}
+
+	/* Selected worker is busy, parked, not created yet or none is left */
 	tz_kthread_pool_wake_up_all();
 }
 
@@ -230,6 +414,7 @@ void tz_kthread_pool_enter_swd(void)
 			cpu_isset(cpu, requested_cpu_mask)) {
 		tz_kthread_pool_wake_up_all_but(cpu);
 
+		atomic64_inc(&tz_kthread_pool_stats.swd_entries);
 		tzdev_kthread_debug("Enter SWd directly on cpu = %lu\n", cpu);
 		tzdev_smc_schedule();
 		tzdev_kthread_debug("Exit SWd directly on cpu = %lu\n", cpu);
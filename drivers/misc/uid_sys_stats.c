@@ -20,14 +20,17 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/mm.h>
 #include <linux/proc_fs.h>
 #include <linux/profile.h>
 #include <linux/rtmutex.h>
 #include <linux/sched/cputime.h>
+#include <linux/sched/task.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/uid_sys_stats.h>
 
 
 #include <linux/kobject.h>
@@ -38,6 +41,12 @@
 #define UID_HASH_BITS	10
 DECLARE_HASHTABLE(hash_table, UID_HASH_BITS);
 
+/* live tasks by pid, and tasks not yet filed under a uid_entry */
+static DEFINE_HASHTABLE(task_hash_table, UID_HASH_BITS);
+static LIST_HEAD(uid_orphan_tasks);
+/* tasks forked since uid_lock was last taken, queued without a lock */
+static LLIST_HEAD(uid_new_tasks);
+
 static DEFINE_RT_MUTEX(uid_lock);
 static struct proc_dir_entry *cpu_parent;
 static struct proc_dir_entry *io_parent;
@@ -69,6 +78,23 @@ struct task_entry {
 	struct hlist_node hash;
 };
 
+/*
+ * A live task and the cputime it last contributed to its uid_entry.
+ * Tasks are resampled only when they have run since the last sample,
+ * so a read costs a couple of loads for every sleeping task instead
+ * of a full task_cputime_adjusted() under the tasklist walk.
+ */
+struct uid_task {
+	struct task_struct *task;
+	struct uid_entry *uid_entry;
+	u64 runtime;
+	u64 utime;
+	u64 stime;
+	struct list_head node;
+	struct hlist_node hash;
+	struct llist_node new_node;
+};
+
 struct uid_entry {
 	uid_t uid;
 	u64 utime;
@@ -78,6 +104,7 @@ struct uid_entry {
 	int state;
 	struct io_stats io[UID_STATE_SIZE];
 	struct hlist_node hash;
+	struct list_head tasks;
 #ifdef CONFIG_UID_SYS_STATS_DEBUG
 	DECLARE_HASHTABLE(task_entries, UID_HASH_BITS);
 #endif
@@ -393,6 +420,7 @@ static struct uid_entry *find_or_register_uid(uid_t uid)
 		return NULL;
 
 	uid_entry->uid = uid;
+	INIT_LIST_HEAD(&uid_entry->tasks);
 #ifdef CONFIG_UID_SYS_STATS_DEBUG
 	hash_init(uid_entry->task_entries);
 #endif
@@ -401,40 +429,159 @@ static struct uid_entry *find_or_register_uid(uid_t uid)
 	return uid_entry;
 }
 
-static int uid_cputime_show(struct seq_file *m, void *v)
+/* move tasks queued by fork into the tables, called with uid_lock held */
+static void uid_task_add_new_locked(void)
 {
-	struct uid_entry *uid_entry = NULL;
-	struct task_struct *task, *temp;
-	struct user_namespace *user_ns = current_user_ns();
-	u64 utime;
-	u64 stime;
-	unsigned long bkt;
-	uid_t uid;
+	struct llist_node *first = llist_del_all(&uid_new_tasks);
+	struct uid_task *uid_task, *tmp;
 
-	rt_mutex_lock(&uid_lock);
+	llist_for_each_entry_safe(uid_task, tmp, first, new_node) {
+		list_add_tail(&uid_task->node, &uid_orphan_tasks);
+		hash_add(task_hash_table, &uid_task->hash, uid_task->task->pid);
+	}
+}
 
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		uid_entry->active_stime = 0;
-		uid_entry->active_utime = 0;
+static struct uid_task *find_uid_task(struct task_struct *task)
+{
+	struct uid_task *uid_task;
+
+	hash_for_each_possible(task_hash_table, uid_task, hash, task->pid) {
+		if (uid_task->task == task)
+			return uid_task;
+	}
+	return NULL;
+}
+
+static void uid_task_detach(struct uid_task *uid_task)
+{
+	struct uid_entry *uid_entry = uid_task->uid_entry;
+
+	if (!uid_entry)
+		return;
+
+	uid_entry->active_utime -= uid_task->utime;
+	uid_entry->active_stime -= uid_task->stime;
+	uid_task->uid_entry = NULL;
+	list_move_tail(&uid_task->node, &uid_orphan_tasks);
+}
+
+static void uid_task_free(struct uid_task *uid_task)
+{
+	uid_task_detach(uid_task);
+	list_del(&uid_task->node);
+	hash_del(&uid_task->hash);
+	put_task_struct(uid_task->task);
+	kfree(uid_task);
+}
+
+static int uid_task_sample(struct uid_task *uid_task,
+			struct user_namespace *user_ns)
+{
+	struct task_struct *task = uid_task->task;
+	struct uid_entry *uid_entry = uid_task->uid_entry;
+	u64 runtime, utime, stime;
+	uid_t uid;
+
+	/*
+	 * Exiting tasks are dropped by process_notifier() before they get
+	 * an exit_state, so this one exited before the notifier was ready.
+	 */
+	if (unlikely(task->exit_state)) {
+		uid_task_free(uid_task);
+		return 0;
 	}
 
 	rcu_read_lock();
-	do_each_thread(temp, task) {
-		uid = from_kuid_munged(user_ns, task_uid(task));
-		if (!uid_entry || uid_entry->uid != uid)
-			uid_entry = find_or_register_uid(uid);
+	uid = from_kuid_munged(user_ns, task_uid(task));
+	rcu_read_unlock();
+
+	if (!uid_entry || uid_entry->uid != uid) {
+		uid_entry = find_or_register_uid(uid);
 		if (!uid_entry) {
-			rcu_read_unlock();
-			rt_mutex_unlock(&uid_lock);
 			pr_err("%s: failed to find the uid_entry for uid %d\n",
 				__func__, uid);
 			return -ENOMEM;
 		}
-		task_cputime_adjusted(task, &utime, &stime);
-		uid_entry->active_utime += utime;
-		uid_entry->active_stime += stime;
-	} while_each_thread(temp, task);
-	rcu_read_unlock();
+		uid_task_detach(uid_task);
+		uid_task->uid_entry = uid_entry;
+		uid_entry->active_utime += uid_task->utime;
+		uid_entry->active_stime += uid_task->stime;
+		list_move_tail(&uid_task->node, &uid_entry->tasks);
+	}
+
+	runtime = READ_ONCE(task->se.sum_exec_runtime);
+	if (runtime == uid_task->runtime)
+		return 0;
+	uid_task->runtime = runtime;
+
+	/* adjusted cputime never goes backwards for a given task */
+	task_cputime_adjusted(task, &utime, &stime);
+	uid_entry->active_utime += utime - uid_task->utime;
+	uid_entry->active_stime += stime - uid_task->stime;
+	uid_task->utime = utime;
+	uid_task->stime = stime;
+	return 0;
+}
+
+static int update_cputime_all_locked(void)
+{
+	struct user_namespace *user_ns = current_user_ns();
+	struct uid_task *uid_task, *tmp;
+	struct uid_entry *uid_entry;
+	unsigned long bkt;
+	int ret;
+
+	uid_task_add_new_locked();
+
+	list_for_each_entry_safe(uid_task, tmp, &uid_orphan_tasks, node) {
+		ret = uid_task_sample(uid_task, user_ns);
+		if (ret)
+			return ret;
+	}
+
+	hash_for_each(hash_table, bkt, uid_entry, hash) {
+		list_for_each_entry_safe(uid_task, tmp, &uid_entry->tasks,
+					node) {
+			ret = uid_task_sample(uid_task, user_ns);
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+void uid_sys_stats_task_fork(struct task_struct *task)
+{
+	struct uid_task *uid_task;
+
+	uid_task = kzalloc(sizeof(*uid_task), GFP_KERNEL);
+	if (!uid_task)
+		return;
+
+	get_task_struct(task);
+	uid_task->task = task;
+
+	/*
+	 * Readers hold uid_lock across the whole update, so fork must not
+	 * wait for it. The task is picked up and filed under its uid_entry
+	 * by whoever takes uid_lock next.
+	 */
+	llist_add(&uid_task->new_node, &uid_new_tasks);
+}
+
+static int uid_cputime_show(struct seq_file *m, void *v)
+{
+	struct uid_entry *uid_entry;
+	unsigned long bkt;
+	int ret;
+
+	rt_mutex_lock(&uid_lock);
+
+	ret = update_cputime_all_locked();
+	if (ret) {
+		rt_mutex_unlock(&uid_lock);
+		return ret;
+	}
 
 	hash_for_each(hash_table, bkt, uid_entry, hash) {
 		u64 total_utime = uid_entry->utime +
@@ -461,6 +608,73 @@ static const struct file_operations uid_cputime_fops = {
 	.release	= single_release,
 };
 
+#ifdef CONFIG_UID_SYS_STATS_DEBUG
+/*
+ * Compare the incremental update against the old full thread walk.
+ * Both run under uid_lock, so their totals should agree up to the
+ * cputime the system accumulates while the walk itself runs.
+ */
+static int uid_cputime_bench_show(struct seq_file *m, void *v)
+{
+	struct task_struct *task, *temp;
+	struct uid_entry *uid_entry;
+	u64 walk_utime = 0, walk_stime = 0;
+	u64 inc_utime = 0, inc_stime = 0;
+	u64 utime, stime, start, walk_ns, inc_ns;
+	unsigned long bkt;
+	int nr_threads = 0, nr_uids = 0;
+	int ret;
+
+	rt_mutex_lock(&uid_lock);
+
+	start = ktime_get_ns();
+	rcu_read_lock();
+	do_each_thread(temp, task) {
+		task_cputime_adjusted(task, &utime, &stime);
+		walk_utime += utime;
+		walk_stime += stime;
+		nr_threads++;
+	} while_each_thread(temp, task);
+	rcu_read_unlock();
+	walk_ns = ktime_get_ns() - start;
+
+	start = ktime_get_ns();
+	ret = update_cputime_all_locked();
+	inc_ns = ktime_get_ns() - start;
+	if (ret) {
+		rt_mutex_unlock(&uid_lock);
+		return ret;
+	}
+
+	hash_for_each(hash_table, bkt, uid_entry, hash) {
+		inc_utime += uid_entry->active_utime;
+		inc_stime += uid_entry->active_stime;
+		nr_uids++;
+	}
+
+	rt_mutex_unlock(&uid_lock);
+
+	seq_printf(m, "threads %d uids %d\n", nr_threads, nr_uids);
+	seq_printf(m, "walk: %llu ns, active %llu %llu ms\n", walk_ns,
+		ktime_to_ms(walk_utime), ktime_to_ms(walk_stime));
+	seq_printf(m, "incremental: %llu ns, active %llu %llu ms\n", inc_ns,
+		ktime_to_ms(inc_utime), ktime_to_ms(inc_stime));
+	return 0;
+}
+
+static int uid_cputime_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, uid_cputime_bench_show, PDE_DATA(inode));
+}
+
+static const struct file_operations uid_cputime_bench_fops = {
+	.open		= uid_cputime_bench_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
 static int uid_remove_open(struct inode *inode, struct file *file)
 {
 	return single_open(file, NULL, NULL);
@@ -502,6 +716,11 @@ static ssize_t uid_remove_write(struct file *file,
 		hash_for_each_possible_safe(hash_table, uid_entry, tmp,
 							hash, (uid_t)uid_start) {
 			if (uid_start == uid_entry->uid) {
+				struct uid_task *uid_task, *tmp_task;
+
+				list_for_each_entry_safe(uid_task, tmp_task,
+						&uid_entry->tasks, node)
+					uid_task_detach(uid_task);
 				remove_uid_tasks(uid_entry);
 				hash_del(&uid_entry->hash);
 				kfree(uid_entry);
@@ -858,6 +1077,7 @@ static int process_notifier(struct notifier_block *self,
 {
 	struct task_struct *task = v;
 	struct uid_entry *uid_entry;
+	struct uid_task *uid_task;
 	u64 utime, stime;
 	uid_t uid;
 
@@ -865,6 +1085,11 @@ static int process_notifier(struct notifier_block *self,
 		return NOTIFY_OK;
 
 	rt_mutex_lock(&uid_lock);
+	uid_task_add_new_locked();
+	uid_task = find_uid_task(task);
+	if (uid_task)
+		uid_task_free(uid_task);
+
 	uid = from_kuid_munged(current_user_ns(), task_uid(task));
 	uid_entry = find_or_register_uid(uid);
 	if (!uid_entry) {
@@ -902,6 +1127,10 @@ static int __init proc_uid_sys_stats_init(void)
 		&uid_remove_fops, NULL);
 	proc_create_data("show_uid_stat", 0444, cpu_parent,
 		&uid_cputime_fops, NULL);
+#ifdef CONFIG_UID_SYS_STATS_DEBUG
+	proc_create_data("bench", 0400, cpu_parent,
+		&uid_cputime_bench_fops, NULL);
+#endif
 
 	io_parent = proc_mkdir("uid_io", NULL);
 	if (!io_parent) {
@@ -271,9 +271,14 @@ struct ssp_data {
 	/* comm */
 	struct mutex comm_mutex;
 	struct mutex pending_mutex;
+	/* serialises parse_dataframe() callers, guards the iio_batch state */
+	struct mutex parse_mutex;
 	struct list_head pending_list;
+	spinlock_t tx_lock;
+	struct list_head tx_queue;
 	unsigned int cnt_timeout;
 	unsigned int cnt_com_fail;
+	unsigned int cnt_tx_coalesced;
 
 	/* debug */
 	char sensor_state[BIG_DATA_SENSOR_TYPE_MAX + 1];
@@ -314,6 +319,13 @@ struct ssp_data {
 	struct miscdevice batch_io_device;
 	struct iio_dev *indio_devs[SENSOR_TYPE_MAX];
 	struct iio_chan_spec indio_channels[SENSOR_TYPE_MAX];
+	/* samples of one batched report, pushed under a single mlock */
+	char *iio_batch_buf;
+	int iio_batch_datum_max;
+	int iio_batch_type;
+	int iio_batch_count;
+	struct task_struct *iio_batch_task;
+	bool iio_batch_disable;
 	struct device *devices[SENSOR_TYPE_MAX];
 	struct miscdevice scontext_device;
 	struct miscdevice injection_device;
@@ -1,6 +1,9 @@
 
 #include <linux/kernel.h>
+#include <linux/delay.h>
+#include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 
 #include "ssp.h"
 #include "ssp_comm.h"
@@ -85,7 +88,9 @@ exit:
 
 	    buffer = kzalloc(msg_length, GFP_KERNEL);
 		memcpy(buffer, &packet[SSP_MSG_HEADER_SIZE], msg_length);
+		mutex_lock(&data->parse_mutex);
 		parse_dataframe(data, buffer, msg_length);
+		mutex_unlock(&data->parse_mutex);
 		kfree(buffer);
 	} else {
 		ssp_infof("msg_cmd does not define. cmd is %d", msg_cmd);
@@ -93,51 +98,186 @@ exit:
 	return;
 }
 
-static char ssp_cmd_data[SSP_CMD_SIZE];
+/*
+ * Commands are prepared by their callers and queued on tx_queue. Whoever
+ * holds comm_mutex writes out everything queued, so new commands can be
+ * prepared while a transfer is in flight and each caller only waits for
+ * its own packet to go out.
+ */
+struct ssp_tx {
+	struct ssp_msg *msg;
+	char packet[SSP_CMD_SIZE];
+	int timeout;
+	int status;
+	bool sent;
+	struct list_head list;
+};
+
+#ifdef CONFIG_SSP_ENG_DEBUG
+/* when set, a software MCU accepts every packet after this delay */
+static unsigned int ssp_comm_stub_latency_us;
+module_param_named(comm_stub_latency_us, ssp_comm_stub_latency_us, uint, 0644);
+
+static int ssp_comm_stub_write(struct ssp_data *data, struct ssp_msg *msg)
+{
+	struct ssp_msg *pending, *n;
+
+	usleep_range(ssp_comm_stub_latency_us, ssp_comm_stub_latency_us + 1);
+
+	if (msg->done == NULL) {
+		return SSP_CMD_SIZE;
+	}
+
+	mutex_lock(&data->pending_mutex);
+	list_for_each_entry_safe(pending, n, &data->pending_list, list) {
+		if (pending == msg) {
+			list_del(&msg->list);
+			msg->length = 0;
+			complete(msg->done);
+			break;
+		}
+	}
+	mutex_unlock(&data->pending_mutex);
+	return SSP_CMD_SIZE;
+}
+#endif
+
+static int ssp_comm_write(struct ssp_data *data, struct ssp_tx *tx)
+{
+#ifdef CONFIG_SSP_ENG_DEBUG
+	if (ssp_comm_stub_latency_us) {
+		return ssp_comm_stub_write(data, tx->msg);
+	}
+#endif
+	return sensorhub_comms_write(data, tx->packet, SSP_CMD_SIZE, tx->timeout);
+}
+
+/*
+ * A rate change only describes the latest wanted rate of a sensor, so a
+ * queued one can be replaced by a newer one for the same sensor, as long
+ * as nothing else for that sensor was queued in between. Add and remove
+ * carry their own payload (e.g. scontext requests) and are never merged.
+ */
+static bool ssp_tx_coalesce(struct ssp_data *data, struct ssp_tx *tx)
+{
+	struct ssp_msg *msg = tx->msg;
+	struct ssp_tx *prev;
+
+	if (msg->done != NULL || msg->cmd != CMD_CHANGERATE) {
+		return false;
+	}
+
+	list_for_each_entry_reverse(prev, &data->tx_queue, list) {
+		if (prev->msg->type != msg->type) {
+			continue;
+		}
+
+		if (prev->msg->done != NULL || prev->msg->cmd != msg->cmd ||
+		    prev->msg->subcmd != msg->subcmd) {
+			return false;
+		}
+
+		list_replace(&prev->list, &tx->list);
+		prev->status = 0;
+		prev->sent = true;
+		data->cnt_tx_coalesced++;
+		return true;
+	}
+
+	return false;
+}
+
+static void ssp_tx_flush(struct ssp_data *data)
+{
+	struct ssp_tx *tx;
+
+	for (;;) {
+		spin_lock(&data->tx_lock);
+		tx = list_first_entry_or_null(&data->tx_queue, struct ssp_tx, list);
+		if (tx) {
+			list_del(&tx->list);
+		}
+		spin_unlock(&data->tx_lock);
+
+		if (!tx) {
+			break;
+		}
+
+		if (!is_sensorhub_working(data)) {
+			ssp_errf("sensorhub is not working");
+			tx->status = -EIO;
+			goto done;
+		}
+
+		if (tx->msg->done != NULL) {
+			mutex_lock(&data->pending_mutex);
+			list_add_tail(&tx->msg->list, &data->pending_list);
+			mutex_unlock(&data->pending_mutex);
+		}
+
+		tx->status = ssp_comm_write(data, tx);
+
+		if (tx->status < 0 && tx->msg->done != NULL) {
+			ssp_errf("comm write fail!!");
+			mutex_lock(&data->pending_mutex);
+			list_del(&tx->msg->list);
+			mutex_unlock(&data->pending_mutex);
+		}
+done:
+		spin_lock(&data->tx_lock);
+		tx->sent = true;
+		spin_unlock(&data->tx_lock);
+	}
+}
 
 static int do_transfer(struct ssp_data *data, struct ssp_msg *msg, int timeout)
 {
+	struct ssp_tx tx;
 	int status = 0;
 	int ret = 0;
 	bool is_ssp_shutdown;
-
-	mutex_lock(&data->comm_mutex);
+	bool sent;
 
 	if (!is_sensorhub_working(data)) {
 		ssp_errf("sensorhub is not working");
-		mutex_unlock(&data->comm_mutex);
 		return -EIO;
 	}
 
-	msg->timestamp = get_current_timestamp();
-	memcpy(ssp_cmd_data, msg, SSP_MSG_HEADER_SIZE);
-	if (msg->length > 0) {
-		memcpy(&ssp_cmd_data[SSP_MSG_HEADER_SIZE], msg->buffer, msg->length);
-	} else if (msg->length > (SSP_CMD_SIZE - SSP_MSG_HEADER_SIZE)) {
+	if (msg->length > (SSP_CMD_SIZE - SSP_MSG_HEADER_SIZE)) {
 		ssp_errf("command size over !");
-		mutex_unlock(&data->comm_mutex);
 		return -EINVAL;
 	}
 
-	if (msg->done != NULL) {
-		mutex_lock(&data->pending_mutex);
-		list_add_tail(&msg->list, &data->pending_list);
-		mutex_unlock(&data->pending_mutex);
-	}
-
-	status = sensorhub_comms_write(data, ssp_cmd_data, SSP_CMD_SIZE, timeout);
+	tx.msg = msg;
+	tx.timeout = timeout;
+	tx.status = 0;
+	tx.sent = false;
 
-	if (status < 0 && msg->done != NULL) {
-		ssp_errf("comm write fail!!");
-		mutex_lock(&data->pending_mutex);
-		list_del(&msg->list);
-		mutex_unlock(&data->pending_mutex);
+	msg->timestamp = get_current_timestamp();
+	memcpy(tx.packet, msg, SSP_MSG_HEADER_SIZE);
+	if (msg->length > 0) {
+		memcpy(&tx.packet[SSP_MSG_HEADER_SIZE], msg->buffer, msg->length);
+	}
+	memset(&tx.packet[SSP_MSG_HEADER_SIZE + msg->length], 0,
+	       SSP_CMD_SIZE - SSP_MSG_HEADER_SIZE - msg->length);
 
-		goto exit;
+	spin_lock(&data->tx_lock);
+	if (!ssp_tx_coalesce(data, &tx)) {
+		list_add_tail(&tx.list, &data->tx_queue);
 	}
+	spin_unlock(&data->tx_lock);
 
-exit:
+	/* the holder of comm_mutex may already have sent us */
+	mutex_lock(&data->comm_mutex);
+	spin_lock(&data->tx_lock);
+	sent = tx.sent;
+	spin_unlock(&data->tx_lock);
+	if (!sent) {
+		ssp_tx_flush(data);
+	}
 	mutex_unlock(&data->comm_mutex);
+
+	status = tx.status;
 	if (status < 0) {
 		is_ssp_shutdown = !is_sensorhub_working(data);
 		data->cnt_com_fail += (is_ssp_shutdown)? 0 : 1;
@@ -240,6 +240,7 @@ int parse_dataframe(struct ssp_data *data, char *dataframe, int frame_len)
 			index += 2;
 			batch_event_count = length;
 
+			ssp_iio_batch_begin(data, type);
 			do {
 				get_sensordata(data, dataframe, &index, type, &event);
 				get_timestamp(data, dataframe, &index, &event, type);
@@ -247,6 +248,7 @@ int parse_dataframe(struct ssp_data *data, char *dataframe, int frame_len)
 
 				batch_event_count--;
 			} while ((batch_event_count > 0) && (index < frame_len));
+			ssp_iio_batch_end(data);
 
 			if (batch_event_count > 0)
 				ssp_errf("batch count error (%d)", batch_event_count);
@@ -263,12 +263,13 @@ static void debug_work_func(struct work_struct *work)
 	struct ssp_data *data = container_of(work, struct ssp_data, work_debug);
 	unsigned int type;
 
-	ssp_infof("FW(%d):%u, Sensor state: 0x%llx, En: 0x%llx, Reset cnt: %d[%d : C %u(%u, %u), N %u, %u]",
+	ssp_infof("FW(%d):%u, Sensor state: 0x%llx, En: 0x%llx, Reset cnt: %d[%d : C %u(%u, %u), N %u, %u], coalesced %u",
 		  data->fw_type, data->curr_fw_rev,
 		  data->sensor_probe_state, data->sensor_en_state,
 		  data->cnt_reset, data->cnt_ssp_reset[RESET_TYPE_MAX],
 		  data->cnt_ssp_reset[RESET_TYPE_KERNEL_COM_FAIL], data->cnt_com_fail, data->cnt_timeout,
-		  data->cnt_ssp_reset[RESET_TYPE_KERNEL_NO_EVENT], data->cnt_ssp_reset[RESET_TYPE_HUB_NO_EVENT]);
+		  data->cnt_ssp_reset[RESET_TYPE_KERNEL_NO_EVENT], data->cnt_ssp_reset[RESET_TYPE_HUB_NO_EVENT],
+		  data->cnt_tx_coalesced);
 
 	for (type = 0; type < SS_SENSOR_TYPE_MAX; type++)
 		if(data->en_info[type].enabled) {
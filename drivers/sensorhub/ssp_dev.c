@@ -121,6 +121,8 @@ static void initialize_variable(struct ssp_data *data)
 	data->last_resume_status = SCONTEXT_AP_STATUS_RESUME;
 
 	INIT_LIST_HEAD(&data->pending_list);
+	INIT_LIST_HEAD(&data->tx_queue);
+	spin_lock_init(&data->tx_lock);
 
 #ifdef CONFIG_SENSORS_SSP_LIGHT
 	memcpy(data->light_coef, light_coef, sizeof(light_coef));
@@ -520,6 +522,7 @@ struct ssp_data *ssp_probe(struct device *dev)
 
 	mutex_init(&data->comm_mutex);
 	mutex_init(&data->pending_mutex);
+	mutex_init(&data->parse_mutex);
 	mutex_init(&data->enable_mutex);
 
 	pr_info("\n#####################################################\n");
@@ -584,6 +587,7 @@ err_create_workqueue:
 	wake_lock_destroy(&data->ssp_wake_lock);
 	mutex_destroy(&data->comm_mutex);
 	mutex_destroy(&data->pending_mutex);
+	mutex_destroy(&data->parse_mutex);
 	mutex_destroy(&data->enable_mutex);
 err_setup:
 	kfree(data);
@@ -625,6 +629,7 @@ void ssp_remove(struct ssp_data *data)
 	wake_lock_destroy(&data->ssp_wake_lock);
 	mutex_destroy(&data->comm_mutex);
 	mutex_destroy(&data->pending_mutex);
+	mutex_destroy(&data->parse_mutex);
 	mutex_destroy(&data->enable_mutex);
 #if 0		   /* Yum : Not yet */
 	toggle_mcu_reset(data);
@@ -46,6 +46,8 @@ enum
 	PROX_RAW_DATA_SIZE,
 };
 
+#define SSP_IIO_BATCH_MAX       32
+
 #define SCONTEXT_DATA_LEN       56
 #define SCONTEXT_HEADER_LEN     8
 
@@ -87,20 +89,97 @@ static int ssp_iio_configure_ring(struct iio_dev *indio_dev)
 	return 0;
 }
 
-static void ssp_iio_push_buffers(struct iio_dev *indio_dev, u64 timestamp,
-                                 char *data, int data_len)
+void ssp_iio_batch_flush(struct ssp_data *data)
 {
-	char buf[data_len + sizeof(timestamp)];
+	struct iio_dev *indio_dev;
 
-	if (!indio_dev || !data) {
+	if (data->iio_batch_type < 0 || !data->iio_batch_count) {
 		return;
 	}
 
-	memcpy(buf, data, data_len);
-	memcpy(buf + data_len, &timestamp, sizeof(timestamp));
+	indio_dev = data->indio_devs[data->iio_batch_type];
 	mutex_lock(&indio_dev->mlock);
-	iio_push_to_buffers(indio_dev, buf);
+	if (iio_buffer_enabled(indio_dev)) {
+		iio_kfifo_push_batch(indio_dev->buffer, data->iio_batch_buf,
+		                     data->iio_batch_count);
+	}
 	mutex_unlock(&indio_dev->mlock);
+	data->iio_batch_count = 0;
+}
+
+/*
+ * Samples of @type reported until ssp_iio_batch_end() are written
+ * straight into the staging buffer and pushed together.
+ */
+void ssp_iio_batch_begin(struct ssp_data *data, int type)
+{
+	ssp_iio_batch_flush(data);
+	data->iio_batch_type = -1;
+
+	if (data->iio_batch_disable || !data->iio_batch_buf || !data->indio_devs[type]) {
+		return;
+	}
+
+	if (data->indio_devs[type]->buffer->bytes_per_datum > data->iio_batch_datum_max) {
+		return;
+	}
+
+	data->iio_batch_type = type;
+	data->iio_batch_task = current;
+}
+
+void ssp_iio_batch_end(struct ssp_data *data)
+{
+	ssp_iio_batch_flush(data);
+	data->iio_batch_type = -1;
+}
+
+static void ssp_iio_batch_add(struct ssp_data *data, u64 timestamp,
+                              char *buf, int data_len)
+{
+	int stride = data->indio_devs[data->iio_batch_type]->buffer->bytes_per_datum;
+	char *slot = data->iio_batch_buf + data->iio_batch_count * stride;
+
+	memcpy(slot, buf, data_len);
+	memcpy(slot + data_len, &timestamp, sizeof(timestamp));
+
+	if (++data->iio_batch_count == SSP_IIO_BATCH_MAX) {
+		ssp_iio_batch_flush(data);
+	}
+}
+
+static void ssp_iio_push_buffers(struct ssp_data *data, int type, u64 timestamp,
+                                 char *buf, int data_len)
+{
+	struct iio_dev *indio_dev = data->indio_devs[type];
+	char stack_scan[sizeof(struct sensor_value) + sizeof(timestamp)];
+	char *scan = stack_scan;
+
+	if (!indio_dev || !buf) {
+		return;
+	}
+
+	if (type == data->iio_batch_type && current == data->iio_batch_task) {
+		ssp_iio_batch_add(data, timestamp, buf, data_len);
+		return;
+	}
+
+	if (data_len > sizeof(struct sensor_value)) {
+		scan = kmalloc(data_len + sizeof(timestamp), GFP_KERNEL);
+		if (!scan) {
+			return;
+		}
+	}
+
+	memcpy(scan, buf, data_len);
+	memcpy(scan + data_len, &timestamp, sizeof(timestamp));
+	mutex_lock(&indio_dev->mlock);
+	iio_push_to_buffers(indio_dev, scan);
+	mutex_unlock(&indio_dev->mlock);
+
+	if (scan != stack_scan) {
+		kfree(scan);
+	}
 }
 
 #ifdef CONFIG_SENSORS_SSP_PROXIMITY
@@ -268,7 +347,7 @@ void report_sensor_data(struct ssp_data *data, int type,
 		return;
 	}
 
-	ssp_iio_push_buffers(data->indio_devs[type], event->timestamp,
+	ssp_iio_push_buffers(data, type, event->timestamp,
 	                     (char *)&data->buf[type], data->info[type].report_data_len);
 
 	/* wake-up sensor */
@@ -286,7 +365,7 @@ void report_camera_lux_data(struct ssp_data *data, int lux)
 	ssp_infof("%d", lux);
 
 	data->buf[type].ab_lux = lux;
-	ssp_iio_push_buffers(data->indio_devs[type], get_current_timestamp(),
+	ssp_iio_push_buffers(data, type, get_current_timestamp(),
 	                     (char *)&data->buf[type], data->info[type].report_data_len);
 
 }
@@ -299,7 +378,7 @@ void report_meta_data(struct ssp_data *data, struct sensor_value *s)
 
 	memset(meta_event, META_EVENT,
 	       data->info[s->meta_data.sensor].report_data_len);
-	ssp_iio_push_buffers(data->indio_devs[s->meta_data.sensor],
+	ssp_iio_push_buffers(data, s->meta_data.sensor,
 	                     META_TIMESTAMP, meta_event,
 	                     data->info[s->meta_data.sensor].report_data_len);
 	kfree(meta_event);
@@ -342,7 +421,7 @@ void report_scontext_data(struct ssp_data *data, char *data_buf, u32 length)
         ssp_infof("0x%x 0x%x 0x%x 0x%x 0x%x 0x%x 0x%x 0x%x, //0x%llx",
                 buf[16], buf[17], buf[18], buf[19], buf[20], buf[21], buf[22], buf[23], timestamp);
 */
-		ssp_iio_push_buffers(data->indio_devs[SENSOR_TYPE_SCONTEXT], timestamp,
+		ssp_iio_push_buffers(data, SENSOR_TYPE_SCONTEXT, timestamp,
 		                     buf, data->info[SENSOR_TYPE_SCONTEXT].report_data_len);
 
 		start = end + 1;
@@ -386,7 +465,7 @@ void report_scontext_notice_data(struct ssp_data *data, char notice)
 void report_sensorhub_data(struct ssp_data *data, char* buf)
 {
 	ssp_infof();
-	ssp_iio_push_buffers(data->indio_devs[SENSOR_TYPE_SENSORHUB], get_current_timestamp(),
+	ssp_iio_push_buffers(data, SENSOR_TYPE_SENSORHUB, get_current_timestamp(),
 							buf, data->info[SENSOR_TYPE_SENSORHUB].report_data_len);
 }
 
@@ -445,12 +524,17 @@ int initialize_indio_dev(struct device *dev, struct ssp_data *data)
 	int realbits_size = 0;
 	int repeat_size = 0;
 
+	data->iio_batch_type = -1;
+	data->iio_batch_count = 0;
+
 	for (type = 0; type < SENSOR_TYPE_MAX; type++) {
 		if (!data->info[type].enable || (data->info[type].report_data_len == 0)) {
 			continue;
 		}
 
 		timestamp_len = sizeof(data->buf[type].timestamp);
+		data->iio_batch_datum_max = max(data->iio_batch_datum_max,
+		                                data->info[type].report_data_len + timestamp_len);
 
 		realbits_size = (data->info[type].report_data_len+timestamp_len) * BITS_PER_BYTE;
 		repeat_size = 1;
@@ -481,6 +565,9 @@ int initialize_indio_dev(struct device *dev, struct ssp_data *data)
 		}
 	}
 
+	/* without it every sample is pushed on its own */
+	data->iio_batch_buf = kcalloc(SSP_IIO_BATCH_MAX, data->iio_batch_datum_max, GFP_KERNEL);
+
 	return SUCCESS;
 }
 
@@ -493,5 +580,8 @@ void remove_indio_dev(struct ssp_data *data)
 			iio_device_unregister(data->indio_devs[type]);
 		}
 	}
+
+	kfree(data->iio_batch_buf);
+	data->iio_batch_buf = NULL;
 }
 
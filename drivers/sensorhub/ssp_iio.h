@@ -31,4 +31,7 @@ void report_scontext_notice_data(struct ssp_data *data, char notice);
 void report_scontext_data(struct ssp_data *data, char *data_buf, u32 length);
 void report_camera_lux_data(struct ssp_data *data, int lux);
 void report_sensorhub_data(struct ssp_data *data, char* buf);
+void ssp_iio_batch_begin(struct ssp_data *data, int type);
+void ssp_iio_batch_flush(struct ssp_data *data);
+void ssp_iio_batch_end(struct ssp_data *data);
 #endif
@@ -23,6 +23,7 @@
 
 #define INJECTION_MODE_SENSOR_DATA				0
 #define INJECTION_MODE_ADDITIONAL_INFO	 		1
+#define INJECTION_MODE_REPLAY_DATAFRAME			2
 
 enum {
 	BRIGHTNESS_LEVEL1 = 1,
@@ -39,6 +40,52 @@ static int ssp_inject_sensor_data(struct ssp_data *data,
 	return 0;
 }
 
+#ifdef CONFIG_SSP_ENG_DEBUG
+/*
+ * Replay a captured CMD_REPORT payload through parse_dataframe() without
+ * the SPI transport, once with batched IIO pushes and once without.
+ * buf: u16 repeat count followed by the dataframe.
+ */
+static int ssp_replay_dataframe(struct ssp_data *data,
+                                const char *buf, int count)
+{
+	u16 repeat, i;
+	u64 start, batched_ns, single_ns;
+	int ret = 0;
+
+	if (count <= sizeof(repeat)) {
+		ssp_errf("replay length error %d", count);
+		return -EINVAL;
+	}
+
+	memcpy(&repeat, buf, sizeof(repeat));
+	buf += sizeof(repeat);
+	count -= sizeof(repeat);
+
+	/* reports from the hub wait until the replay is done */
+	mutex_lock(&data->parse_mutex);
+	start = ktime_get_ns();
+	for (i = 0; i < repeat && ret >= 0; i++)
+		ret = parse_dataframe(data, (char *)buf, count);
+	batched_ns = ktime_get_ns() - start;
+
+	data->iio_batch_disable = true;
+	start = ktime_get_ns();
+	for (i = 0; i < repeat && ret >= 0; i++)
+		ret = parse_dataframe(data, (char *)buf, count);
+	single_ns = ktime_get_ns() - start;
+	data->iio_batch_disable = false;
+	mutex_unlock(&data->parse_mutex);
+
+	if (ret < 0)
+		return ret;
+
+	ssp_infof("replay %u x %d bytes: batched %llu ns, single %llu ns",
+	          repeat, count, batched_ns, single_ns);
+	return 0;
+}
+#endif
+
 static int ssp_inject_additional_info(struct ssp_data *data,
                                           const char *buf, int count)
 {
@@ -174,6 +221,10 @@ static ssize_t ssp_injection_write(struct file *file, const char __user *buf,
 
 	if (buffer[0] == INJECTION_MODE_ADDITIONAL_INFO) {
 		ret = ssp_inject_additional_info(data, &buffer[1], count-1);
+#ifdef CONFIG_SSP_ENG_DEBUG
+	} else if (buffer[0] == INJECTION_MODE_REPLAY_DATAFRAME) {
+		ret = ssp_replay_dataframe(data, &buffer[1], count-1);
+#endif
 	} else {
 		ret = ssp_inject_sensor_data(data, &buffer[1], count-1);
 	}
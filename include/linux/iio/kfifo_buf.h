@@ -7,6 +7,8 @@ struct device;
 
 struct iio_buffer *iio_kfifo_allocate(void);
 void iio_kfifo_free(struct iio_buffer *r);
+unsigned int iio_kfifo_push_batch(struct iio_buffer *r, const void *data,
+				  unsigned int n);
 
 struct iio_buffer *devm_iio_kfifo_allocate(struct device *dev);
 void devm_iio_kfifo_free(struct device *dev, struct iio_buffer *r);
@@ -41,6 +41,7 @@ enum mcu_ipc_region {
 
 int mbox_request_irq(enum mcu_ipc_region id, u32 int_num,
 		void (*handler)(void *), void *data);
+int mbox_set_irq_threaded(enum mcu_ipc_region id, u32 int_num, bool threaded);
 int mbox_enable_irq(enum mcu_ipc_region id, u32 int_num);
 int mbox_check_irq(enum mcu_ipc_region id, u32 int_num);
 int mbox_disable_irq(enum mcu_ipc_region id, u32 int_num);
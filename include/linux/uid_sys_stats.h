@@ -0,0 +1,24 @@
+/* include/linux/uid_sys_stats.h
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_UID_SYS_STATS_H
+#define _LINUX_UID_SYS_STATS_H
+
+struct task_struct;
+
+#ifdef CONFIG_UID_SYS_STATS
+void uid_sys_stats_task_fork(struct task_struct *p);
+#else
+static inline void uid_sys_stats_task_fork(struct task_struct *p) {}
+#endif /* CONFIG_UID_SYS_STATS */
+#endif /* _LINUX_UID_SYS_STATS_H */
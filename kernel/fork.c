@@ -91,6 +91,7 @@
 #include <linux/livepatch.h>
 #include <linux/thread_info.h>
 #include <linux/cpufreq_times.h>
+#include <linux/uid_sys_stats.h>
 
 #include <asm/pgtable.h>
 #include <asm/pgalloc.h>
@@ -2156,6 +2157,7 @@ long _do_fork(unsigned long clone_flags,
 		struct pid *pid;
 
 		cpufreq_task_times_alloc(p);
+		uid_sys_stats_task_fork(p);
 
 		trace_sched_process_fork(current, p);
 
@@ -471,16 +471,24 @@ static void abox_set_sif_channels(struct abox_data *data,
 	data->sif_channels[abox_sif_idx(configmsg)] = val;
 }
 
+/*
+ * IPC queue is a ring with a single consumer (ordered ipc_workqueue).
+ * Producers are serialized by ipc_queue_lock against each other only,
+ * the consumer never takes the lock. Slot contents are published with
+ * release/acquire on the ring indices.
+ */
 static bool __abox_ipc_queue_empty(struct abox_data *data)
 {
-	return (data->ipc_queue_end == data->ipc_queue_start);
+	return (smp_load_acquire(&data->ipc_queue_end) ==
+			data->ipc_queue_start);
 }
 
 static bool __abox_ipc_queue_full(struct abox_data *data)
 {
 	size_t length = ARRAY_SIZE(data->ipc_queue);
 
-	return (((data->ipc_queue_end + 1) % length) == data->ipc_queue_start);
+	return (((data->ipc_queue_end + 1) % length) ==
+			smp_load_acquire(&data->ipc_queue_start));
 }
 
 static int abox_ipc_queue_put(struct abox_data *data, struct device *dev,
@@ -501,7 +509,8 @@ static int abox_ipc_queue_put(struct abox_data *data, struct device *dev,
 		ipc->put_time = sched_clock();
 		ipc->get_time = 0;
 		memcpy(&ipc->msg, supplement, size);
-		data->ipc_queue_end = (data->ipc_queue_end + 1) % length;
+		smp_store_release(&data->ipc_queue_end,
+				(data->ipc_queue_end + 1) % length);
 
 		ret = 0;
 	} else {
@@ -514,27 +523,19 @@ static int abox_ipc_queue_put(struct abox_data *data, struct device *dev,
 
 static int abox_ipc_queue_get(struct abox_data *data, struct abox_ipc *ipc)
 {
-	spinlock_t *lock = &data->ipc_queue_lock;
 	size_t length = ARRAY_SIZE(data->ipc_queue);
-	unsigned long flags;
-	int ret;
+	struct abox_ipc *tmp;
 
-	spin_lock_irqsave(lock, flags);
-	if (!__abox_ipc_queue_empty(data)) {
-		struct abox_ipc *tmp;
+	if (__abox_ipc_queue_empty(data))
+		return -ENODATA;
 
-		tmp = &data->ipc_queue[data->ipc_queue_start];
-		tmp->get_time = sched_clock();
-		*ipc = *tmp;
-		data->ipc_queue_start = (data->ipc_queue_start + 1) % length;
+	tmp = &data->ipc_queue[data->ipc_queue_start];
+	tmp->get_time = sched_clock();
+	*ipc = *tmp;
+	smp_store_release(&data->ipc_queue_start,
+			(data->ipc_queue_start + 1) % length);
 
-		ret = 0;
-	} else {
-		ret = -ENODATA;
-	}
-	spin_unlock_irqrestore(lock, flags);
-
-	return ret;
+	return 0;
 }
 
 static bool abox_can_calliope_ipc(struct device *dev,
@@ -624,6 +625,10 @@ static void abox_process_ipc(struct work_struct *work)
 	pm_runtime_get_sync(dev);
 
 	if (abox_can_calliope_ipc(dev, data)) {
+		struct abox_ipc_stats *stats = &data->ipc_stats;
+		unsigned long long latency;
+		int burst = 0;
+
 		while (abox_ipc_queue_get(data, &ipc) == 0) {
 			struct device *dev = ipc.dev;
 			int hw_irq = ipc.hw_irq;
@@ -631,8 +636,23 @@ static void abox_process_ipc(struct work_struct *work)
 
 			__abox_process_ipc(dev, data, hw_irq, msg);
 
-			/* giving time to ABOX for processing */
-			usleep_range(10, 100);
+			latency = sched_clock() - ipc.put_time;
+			stats->count++;
+			stats->latency_total += latency;
+			if (stats->latency_max < latency)
+				stats->latency_max = latency;
+
+			/*
+			 * Each message is already acked by ABOX. Send a burst
+			 * back-to-back and give time to ABOX for processing
+			 * once per burst, not once per message.
+			 */
+			if (++burst >= ABOX_IPC_BURST_SIZE ||
+					__abox_ipc_queue_empty(data)) {
+				stats->bursts++;
+				burst = 0;
+				usleep_range(10, 100);
+			}
 		}
 	}
 
@@ -4703,6 +4723,398 @@ static void abox_boot_done(struct device *dev, unsigned int version)
 	wake_up(&data->ipc_wait_queue);
 }
 
+int abox_dma_open_constraints(struct abox_platform_data *data,
+		struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+
+	/* DMA pointer can be polled only if the status register is valid */
+	if (data->type != PLATFORM_NORMAL && data->type != PLATFORM_SYNC)
+		runtime->hw.info &= ~SNDRV_PCM_INFO_NO_PERIOD_WAKEUP;
+
+	if (!data->low_latency)
+		return 0;
+
+	return snd_pcm_hw_constraint_minmax(runtime,
+			SNDRV_PCM_HW_PARAM_PERIOD_TIME, 0,
+			LOW_LATENCY_PERIOD_US_MAX);
+}
+EXPORT_SYMBOL(abox_dma_open_constraints);
+
+void abox_dma_latency_start(struct abox_platform_data *data)
+{
+	struct abox_dma_latency *latency = &data->latency;
+
+	memset(latency, 0, sizeof(*latency));
+	latency->start = sched_clock();
+}
+EXPORT_SYMBOL(abox_dma_latency_start);
+
+/*
+ * Loopback round trip measurement. A marker is written into the rdma
+ * buffer a period ahead of the DMA, between the hardware and application
+ * pointers, and the wdma capture is scanned for it. The time the marker
+ * was read by rdma and the time it was written by wdma are both derived
+ * from the period interrupt and the distance of the marker to the
+ * hardware pointer, so the result doesn't depend on the period size.
+ * Both streams are expected to carry silence and to be routed into each
+ * other, e.g. through a loopback mixer path.
+ */
+#define ABOX_LOOPBACK_MARKER_FRAMES	(4)
+#define ABOX_LOOPBACK_TIMEOUT_PERIODS	(256)
+
+enum abox_loopback_state {
+	ABOX_LOOPBACK_IDLE,
+	ABOX_LOOPBACK_ARMED,
+	ABOX_LOOPBACK_MARKED,
+};
+
+static struct abox_loopback {
+	spinlock_t lock;
+	enum abox_loopback_state state;
+	struct abox_platform_data *rdma;
+	struct abox_platform_data *wdma;
+	snd_pcm_uframes_t marker;
+	unsigned long long played;
+	unsigned long long captured;
+	unsigned int periods;
+	unsigned long long last;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long total;
+	unsigned int count;
+	unsigned int timeouts;
+} abox_loopback = {
+	.lock = __SPIN_LOCK_UNLOCKED(abox_loopback.lock),
+};
+
+static bool abox_loopback_format_valid(struct snd_pcm_runtime *runtime)
+{
+	switch (runtime->format) {
+	case SNDRV_PCM_FORMAT_S16_LE:
+	case SNDRV_PCM_FORMAT_S24_LE:
+	case SNDRV_PCM_FORMAT_S32_LE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void abox_loopback_put_marker(struct snd_pcm_runtime *runtime,
+		char *frame)
+{
+	unsigned int i;
+
+	/* three quarters of full scale on every channel */
+	for (i = 0; i < runtime->channels; i++) {
+		switch (runtime->format) {
+		case SNDRV_PCM_FORMAT_S16_LE:
+			((s16 *)frame)[i] = S16_MAX / 4 * 3;
+			break;
+		case SNDRV_PCM_FORMAT_S24_LE:
+			((s32 *)frame)[i] = 0x7fffff / 4 * 3;
+			break;
+		default:
+			((s32 *)frame)[i] = S32_MAX / 4 * 3;
+			break;
+		}
+	}
+}
+
+static bool abox_loopback_is_marker(struct snd_pcm_runtime *runtime,
+		const char *frame)
+{
+	s64 val;
+
+	switch (runtime->format) {
+	case SNDRV_PCM_FORMAT_S16_LE:
+		return abs(*(const s16 *)frame) > S16_MAX / 2;
+	case SNDRV_PCM_FORMAT_S24_LE:
+		val = (s32)(*(const u32 *)frame << 8) >> 8;
+		return abs(val) > 0x7fffff / 2;
+	default:
+		val = *(const s32 *)frame;
+		return abs(val) > S32_MAX / 2;
+	}
+}
+
+static unsigned long long abox_loopback_frames_to_ns(
+		struct snd_pcm_runtime *runtime, snd_pcm_uframes_t frames)
+{
+	return div_u64((u64)frames * NSEC_PER_SEC, runtime->rate);
+}
+
+static void abox_loopback_done(struct abox_loopback *lb)
+{
+	unsigned long long latency;
+
+	if (!lb->played || !lb->captured)
+		return;
+
+	latency = lb->captured > lb->played ? lb->captured - lb->played : 0;
+	lb->last = latency;
+	if (!lb->count || lb->min > latency)
+		lb->min = latency;
+	if (lb->max < latency)
+		lb->max = latency;
+	lb->total += latency;
+	lb->count++;
+	lb->state = ABOX_LOOPBACK_IDLE;
+}
+
+static void abox_loopback_rdma_elapsed(struct abox_loopback *lb,
+		struct snd_pcm_runtime *runtime, unsigned long long now)
+{
+	snd_pcm_uframes_t hw = runtime->status->hw_ptr;
+	snd_pcm_uframes_t appl = runtime->control->appl_ptr;
+	snd_pcm_uframes_t marker, offset, frames, i;
+
+	if (lb->state == ABOX_LOOPBACK_ARMED) {
+		marker = roundup(hw, runtime->period_size) + runtime->period_size;
+		/* only frames the application already wrote stay untouched */
+		if (appl < marker + ABOX_LOOPBACK_MARKER_FRAMES)
+			return;
+
+		offset = marker % runtime->buffer_size;
+		frames = min_t(snd_pcm_uframes_t, ABOX_LOOPBACK_MARKER_FRAMES,
+				runtime->buffer_size - offset);
+		for (i = 0; i < frames; i++)
+			abox_loopback_put_marker(runtime, runtime->dma_area +
+					frames_to_bytes(runtime, offset + i));
+
+		lb->marker = marker;
+		lb->played = 0;
+		lb->captured = 0;
+		lb->periods = 0;
+		lb->state = ABOX_LOOPBACK_MARKED;
+	} else if (lb->state == ABOX_LOOPBACK_MARKED && !lb->played &&
+			hw > lb->marker) {
+		lb->played = now - abox_loopback_frames_to_ns(runtime,
+				hw - lb->marker);
+		abox_loopback_done(lb);
+	}
+}
+
+static void abox_loopback_wdma_elapsed(struct abox_loopback *lb,
+		struct snd_pcm_runtime *runtime, unsigned long long now)
+{
+	snd_pcm_uframes_t hw = runtime->status->hw_ptr;
+	snd_pcm_uframes_t start, i;
+	const char *frame;
+
+	if (lb->state != ABOX_LOOPBACK_MARKED || lb->captured)
+		return;
+
+	if (++lb->periods > ABOX_LOOPBACK_TIMEOUT_PERIODS) {
+		lb->timeouts++;
+		lb->state = ABOX_LOOPBACK_IDLE;
+		return;
+	}
+
+	/* the period that was just captured */
+	start = hw > runtime->period_size ? hw - runtime->period_size : 0;
+	for (i = start; i < hw; i++) {
+		frame = runtime->dma_area + frames_to_bytes(runtime,
+				i % runtime->buffer_size);
+		if (abox_loopback_is_marker(runtime, frame)) {
+			lb->captured = now -
+				abox_loopback_frames_to_ns(runtime, hw - i);
+			abox_loopback_done(lb);
+			break;
+		}
+	}
+}
+
+static void abox_loopback_period_elapsed(struct abox_platform_data *data,
+		unsigned long long now)
+{
+	struct abox_loopback *lb = &abox_loopback;
+	struct snd_pcm_runtime *runtime;
+	unsigned long flags;
+
+	if (READ_ONCE(lb->state) == ABOX_LOOPBACK_IDLE)
+		return;
+
+	spin_lock_irqsave(&lb->lock, flags);
+	if (!data->substream || !data->substream->runtime)
+		goto out;
+	runtime = data->substream->runtime;
+
+	if (data == lb->rdma)
+		abox_loopback_rdma_elapsed(lb, runtime, now);
+	else if (data == lb->wdma)
+		abox_loopback_wdma_elapsed(lb, runtime, now);
+out:
+	spin_unlock_irqrestore(&lb->lock, flags);
+}
+
+void abox_dma_period_elapsed(struct abox_platform_data *data)
+{
+	struct abox_dma_latency *latency = &data->latency;
+	struct snd_pcm_substream *substream = data->substream;
+	unsigned long long now = sched_clock();
+	unsigned long long period;
+
+	if (latency->start) {
+		latency->first_period = now - latency->start;
+		latency->start = 0;
+	} else if (latency->last) {
+		period = now - latency->last;
+		if (!latency->periods || latency->period_min > period)
+			latency->period_min = period;
+		if (latency->period_max < period)
+			latency->period_max = period;
+		latency->period_total += period;
+		latency->periods++;
+	}
+	latency->last = now;
+
+	/* userspace polls DMA pointer in no period wakeup mode */
+	if (substream && substream->runtime &&
+			substream->runtime->no_period_wakeup)
+		return;
+
+	snd_pcm_period_elapsed(substream);
+	abox_loopback_period_elapsed(data, now);
+}
+EXPORT_SYMBOL(abox_dma_period_elapsed);
+
+static ssize_t low_latency_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct abox_platform_data *data = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", data->low_latency);
+}
+
+static ssize_t low_latency_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct abox_platform_data *data = dev_get_drvdata(dev);
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret < 0)
+		return ret;
+
+	data->low_latency = val;
+
+	return count;
+}
+
+static ssize_t latency_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct abox_platform_data *data = dev_get_drvdata(dev);
+	struct abox_dma_latency latency = data->latency;
+	unsigned long long avg = latency.periods ?
+			div64_u64(latency.period_total, latency.periods) : 0;
+
+	return scnprintf(buf, PAGE_SIZE,
+			"first_period_ns=%llu period_min_ns=%llu period_avg_ns=%llu period_max_ns=%llu periods=%llu\n",
+			latency.first_period, latency.period_min, avg,
+			latency.period_max, latency.periods);
+}
+
+static bool abox_loopback_stream_valid(struct abox_platform_data *data)
+{
+	struct snd_pcm_runtime *runtime;
+
+	if (!data->substream || !data->substream->runtime)
+		return false;
+
+	runtime = data->substream->runtime;
+	return runtime->status->state == SNDRV_PCM_STATE_RUNNING &&
+			!runtime->no_period_wakeup && runtime->dma_area &&
+			abox_loopback_format_valid(runtime);
+}
+
+static ssize_t loopback_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct abox_loopback lb;
+	unsigned long flags;
+
+	spin_lock_irqsave(&abox_loopback.lock, flags);
+	lb = abox_loopback;
+	spin_unlock_irqrestore(&abox_loopback.lock, flags);
+
+	return scnprintf(buf, PAGE_SIZE,
+			"state=%d last_ns=%llu min_ns=%llu avg_ns=%llu max_ns=%llu count=%u timeouts=%u\n",
+			lb.state, lb.last, lb.min,
+			lb.count ? div_u64(lb.total, lb.count) : 0,
+			lb.max, lb.count, lb.timeouts);
+}
+
+/*
+ * Written on a wdma device with the id of the rdma to loop back from.
+ * Each write measures one round trip; "reset" clears the results.
+ */
+static ssize_t loopback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct abox_platform_data *data = dev_get_drvdata(dev);
+	struct abox_data *abox_data = data->abox_data;
+	struct abox_platform_data *rdma;
+	unsigned long flags;
+	unsigned int id;
+	int ret;
+
+	if (sysfs_streq(buf, "reset")) {
+		spin_lock_irqsave(&abox_loopback.lock, flags);
+		abox_loopback.state = ABOX_LOOPBACK_IDLE;
+		abox_loopback.last = abox_loopback.min = abox_loopback.max = 0;
+		abox_loopback.total = 0;
+		abox_loopback.count = abox_loopback.timeouts = 0;
+		spin_unlock_irqrestore(&abox_loopback.lock, flags);
+		return count;
+	}
+
+	ret = kstrtouint(buf, 0, &id);
+	if (ret < 0)
+		return ret;
+
+	if (data->id >= ARRAY_SIZE(abox_data->pdev_wdma) ||
+			abox_data->pdev_wdma[data->id] != data->pdev)
+		return -EINVAL;
+	if (id >= ARRAY_SIZE(abox_data->pdev_rdma) ||
+			!abox_data->pdev_rdma[id])
+		return -EINVAL;
+	rdma = platform_get_drvdata(abox_data->pdev_rdma[id]);
+
+	if (!abox_loopback_stream_valid(rdma) ||
+			!abox_loopback_stream_valid(data)) {
+		dev_err(dev, "loopback needs running rdma%u and wdma%u\n",
+				id, data->id);
+		return -EBUSY;
+	}
+
+	spin_lock_irqsave(&abox_loopback.lock, flags);
+	abox_loopback.rdma = rdma;
+	abox_loopback.wdma = data;
+	abox_loopback.state = ABOX_LOOPBACK_ARMED;
+	spin_unlock_irqrestore(&abox_loopback.lock, flags);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(low_latency);
+static DEVICE_ATTR_RO(latency);
+static DEVICE_ATTR_RW(loopback);
+
+static struct attribute *abox_dma_attrs[] = {
+	&dev_attr_low_latency.attr,
+	&dev_attr_latency.attr,
+	&dev_attr_loopback.attr,
+	NULL,
+};
+
+const struct attribute_group abox_dma_attr_group = {
+	.attrs = abox_dma_attrs,
+};
+EXPORT_SYMBOL(abox_dma_attr_group);
+
 static irqreturn_t abox_dma_irq_handler(int irq, struct abox_data *data)
 {
 	struct device *dev = &data->pdev->dev;
@@ -4753,7 +5165,7 @@ static irqreturn_t abox_dma_irq_handler(int irq, struct abox_data *data)
 	}
 
 	platform_data->pointer = 0;
-	snd_pcm_period_elapsed(platform_data->substream);
+	abox_dma_period_elapsed(platform_data);
 
 	return IRQ_HANDLED;
 }
@@ -4960,7 +5372,7 @@ static void abox_playback_ipc_handler(struct device *dev,
 	switch (pcmtask_msg->msgtype) {
 	case PCM_PLTDAI_POINTER:
 		platform_data->pointer = pcmtask_msg->param.pointer;
-		snd_pcm_period_elapsed(platform_data->substream);
+		abox_dma_period_elapsed(platform_data);
 		break;
 	case PCM_PLTDAI_ACK:
 		platform_data->ack_enabled = !!pcmtask_msg->param.trigger;
@@ -4996,7 +5408,7 @@ static void abox_capture_ipc_handler(struct device *dev,
 	switch (pcmtask_msg->msgtype) {
 	case PCM_PLTDAI_POINTER:
 		platform_data->pointer = pcmtask_msg->param.pointer;
-		snd_pcm_period_elapsed(platform_data->substream);
+		abox_dma_period_elapsed(platform_data);
 		break;
 	case PCM_PLTDAI_ACK:
 		platform_data->ack_enabled = !!pcmtask_msg->param.trigger;
@@ -6050,9 +6462,23 @@ static ssize_t calliope_cmd_store(struct device *dev,
 	return count;
 }
 
+static ssize_t calliope_ipc_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct abox_data *data = dev_get_drvdata(dev);
+	struct abox_ipc_stats *stats = &data->ipc_stats;
+	unsigned long long count = stats->count;
+	unsigned long long avg = count ? div64_u64(stats->latency_total, count) : 0;
+
+	return scnprintf(buf, PAGE_SIZE,
+			"count=%llu bursts=%llu latency_avg_ns=%llu latency_max_ns=%llu\n",
+			count, stats->bursts, avg, stats->latency_max);
+}
+
 static DEVICE_ATTR_RO(calliope_version);
 static DEVICE_ATTR_WO(calliope_debug);
 static DEVICE_ATTR_WO(calliope_cmd);
+static DEVICE_ATTR_RO(calliope_ipc_stats);
 
 static int samsung_abox_probe(struct platform_device *pdev)
 {
@@ -6373,6 +6799,10 @@ static int samsung_abox_probe(struct platform_device *pdev)
 	if (ret < 0)
 		dev_warn(dev, "Failed to create file: %s\n", "cmd");
 
+	ret = device_create_file(dev, &dev_attr_calliope_ipc_stats);
+	if (ret < 0)
+		dev_warn(dev, "Failed to create file: %s\n", "ipc_stats");
+
 	atomic_notifier_chain_register(&panic_notifier_list,
 			&abox_panic_notifier);
 
@@ -386,6 +386,7 @@
 #define BUFFER_BYTES_MAX		(SZ_128K)
 #define PERIOD_BYTES_MIN		(SZ_128)
 #define PERIOD_BYTES_MAX		(BUFFER_BYTES_MAX / 2)
+#define LOW_LATENCY_PERIOD_US_MAX	(4000)
 
 #define DRAM_FIRMWARE_SIZE		(SZ_16M + SZ_2M)
 #define IOVA_DRAM_FIRMWARE		(0x80000000)
@@ -438,6 +439,7 @@
 
 #define ABOX_SUPPLEMENT_SIZE (SZ_128)
 #define ABOX_IPC_QUEUE_SIZE (SZ_64)
+#define ABOX_IPC_BURST_SIZE (8)
 
 #define CALLIOPE_VERSION(class, year, month, minor) \
 		((class << 24) | \
@@ -529,6 +531,13 @@ struct abox_ipc {
 	ABOX_IPC_MSG msg;
 };
 
+struct abox_ipc_stats {
+	unsigned long long count;
+	unsigned long long bursts;
+	unsigned long long latency_total;
+	unsigned long long latency_max;
+};
+
 struct abox_irq_action {
 	struct list_head list;
 	int irq;
@@ -621,6 +630,7 @@ struct abox_data {
 	int ipc_queue_start;
 	int ipc_queue_end;
 	spinlock_t ipc_queue_lock;
+	struct abox_ipc_stats ipc_stats;
 	wait_queue_head_t ipc_wait_queue;
 	struct clk *clk_pll;
 	struct clk *clk_audif;
@@ -854,6 +864,16 @@ struct abox_ion_buf {
 	void *priv;
 };
 
+struct abox_dma_latency {
+	unsigned long long start;
+	unsigned long long last;
+	unsigned long long first_period;
+	unsigned long long period_min;
+	unsigned long long period_max;
+	unsigned long long period_total;
+	unsigned long long periods;
+};
+
 struct abox_platform_data {
 	struct platform_device *pdev;
 	void __iomem *sfr_base;
@@ -876,6 +896,8 @@ struct abox_platform_data {
 	struct snd_hwdep *hwdep;
 	bool mmap_fd_state;
 	enum abox_buffer_type buf_type;
+	bool low_latency;
+	struct abox_dma_latency latency;
 };
 
 /**
@@ -1158,4 +1180,30 @@ extern void abox_request_dram_on(struct platform_device *pdev_abox, void *id,
  */
 extern int abox_disable_qchannel(struct device *dev, struct abox_data *data,
 		enum qchannel clk, int disable);
+
+/**
+ * Apply low latency constraints to the opened rdma or wdma substream
+ * @param[in]	data		pointer to abox_platform_data structure
+ * @param[in]	substream	opened substream
+ * @return	error code if any
+ */
+extern int abox_dma_open_constraints(struct abox_platform_data *data,
+		struct snd_pcm_substream *substream);
+
+/**
+ * Start latency measurement of rdma or wdma
+ * @param[in]	data		pointer to abox_platform_data structure
+ */
+extern void abox_dma_latency_start(struct abox_platform_data *data);
+
+/**
+ * Report period elapsed of rdma or wdma to ALSA
+ * @param[in]	data		pointer to abox_platform_data structure
+ */
+extern void abox_dma_period_elapsed(struct abox_platform_data *data);
+
+/**
+ * sysfs attributes for low latency mode and latency measurement
+ */
+extern const struct attribute_group abox_dma_attr_group;
 #endif /* __SND_SOC_ABOX_H */
@@ -11,6 +11,7 @@
 /* #define DEBUG */
 #include <linux/module.h>
 #include <linux/debugfs.h>
+#include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
 #include <linux/pm_runtime.h>
@@ -33,6 +34,9 @@ struct abox_dump_buffer_info {
 	struct snd_dma_buffer buffer;
 	struct snd_pcm_substream *substream;
 	size_t pointer;
+	u64 produced;
+	u64 auto_produced;
+	u64 overruns;
 	bool started;
 	bool auto_started;
 	bool file_created;
@@ -195,6 +199,41 @@ static const struct file_operations abox_dump_auto_stop_fops = {
 	.write = abox_dump_auto_stop_write,
 };
 
+static ssize_t abox_dump_status_read(struct file *file,
+		char __user *data, size_t count, loff_t *ppos)
+{
+	struct abox_dump_buffer_info *info;
+	char *buffer, *buffer_p;
+	size_t size = PAGE_SIZE;
+	ssize_t ret;
+
+	buffer = kmalloc(size, GFP_KERNEL);
+	if (!buffer)
+		return -ENOMEM;
+
+	buffer_p = buffer;
+	buffer_p += scnprintf(buffer_p, size - (buffer_p - buffer),
+			"id name addr bytes pointer produced overruns\n");
+	list_for_each_entry(info, &abox_dump_list_head, list) {
+		buffer_p += scnprintf(buffer_p, size - (buffer_p - buffer),
+				"%d %s %pa %#zx %#zx %llu %llu\n",
+				info->id, info->name, &info->buffer.addr,
+				info->buffer.bytes, READ_ONCE(info->pointer),
+				READ_ONCE(info->produced),
+				READ_ONCE(info->overruns));
+	}
+
+	ret = simple_read_from_buffer(data, count, ppos, buffer,
+			buffer_p - buffer);
+	kfree(buffer);
+
+	return ret;
+}
+
+static const struct file_operations abox_dump_status_fops = {
+	.read = abox_dump_status_read,
+};
+
 static int __init samsung_abox_dump_late_initcall(void)
 {
 	pr_info("%s\n", __func__);
@@ -203,6 +242,8 @@ static int __init samsung_abox_dump_late_initcall(void)
 			NULL, &abox_dump_auto_start_fops);
 	debugfs_create_file("dump_auto_stop", 0660, abox_dbg_get_root_dir(),
 			NULL, &abox_dump_auto_stop_fops);
+	debugfs_create_file("dump_status", 0440, abox_dbg_get_root_dir(),
+			NULL, &abox_dump_status_fops);
 
 	return 0;
 }
@@ -247,12 +288,19 @@ static void abox_dump_auto_dump_work_func(struct work_struct *work)
 			void *area = info->buffer.area;
 			size_t bytes = info->buffer.bytes;
 			size_t pointer = info->pointer;
+			u64 produced = READ_ONCE(info->produced);
 			bool first = false;
 
 			if (unlikely(info->auto_pointer < 0)) {
 				info->auto_pointer = pointer;
 				first = true;
+			} else if (produced - info->auto_produced > bytes) {
+				/* DSP lapped the dump before it was saved */
+				info->overruns++;
+				dev_warn_ratelimited(dev, "%s overrun: %llu\n",
+						name, info->overruns);
 			}
+			info->auto_produced = produced;
 			dev_dbg(dev, "%pad, %pK, %zx, %zx)\n",
 					&info->buffer.addr, area, bytes,
 					info->auto_pointer);
@@ -477,6 +525,10 @@ void abox_dump_period_elapsed(int id, size_t pointer)
 
 	dev_dbg(dev, "%s[%d](%zx)\n", __func__, id, pointer);
 
+	if (pointer >= info->pointer)
+		info->produced += pointer - info->pointer;
+	else
+		info->produced += info->buffer.bytes - info->pointer + pointer;
 	info->pointer = pointer;
 	schedule_work(&info->auto_work);
 	snd_pcm_period_elapsed(info->substream);
@@ -10,6 +10,7 @@
  */
 /* #define DEBUG */
 #include <linux/debugfs.h>
+#include <linux/mm.h>
 #include <linux/mutex.h>
 #include <linux/vmalloc.h>
 #include <sound/samsung/abox.h>
@@ -31,10 +32,9 @@
 #define S_IRWUG (0660)
 
 struct abox_log_kernel_buffer {
+	struct abox_log_mmap_header *header;
 	char *buffer;
 	unsigned int index;
-	bool wrap;
-	bool updated;
 	wait_queue_head_t wq;
 };
 
@@ -44,7 +44,7 @@ struct abox_log_buffer_info {
 	int id;
 	bool file_created;
 	atomic_t opened;
-	ssize_t file_index;
+	u64 file_pos;
 	struct mutex lock;
 	struct ABOX_LOG_BUFFER *log_buffer;
 	struct abox_log_kernel_buffer kernel_buffer;
@@ -70,7 +70,6 @@ static void abox_log_memcpy(struct device *dev,
 		src += left_size;
 		size -= left_size;
 		kernel_buffer->index = 0;
-		kernel_buffer->wrap = true;
 	}
 #ifdef VERBOSE_LOG
 	dev_dbg(dev, "1: %s\n", src);
@@ -79,6 +78,14 @@ static void abox_log_memcpy(struct device *dev,
 	kernel_buffer->index += (unsigned int)size;
 }
 
+static void abox_log_update_written(struct abox_log_kernel_buffer *kbuf,
+		size_t size)
+{
+	/* mmap readers must see log data before the written count */
+	smp_wmb();
+	WRITE_ONCE(kbuf->header->written, kbuf->header->written + size);
+}
+
 static void abox_log_file_name(struct device *dev,
 		struct abox_log_buffer_info *info, char *name, size_t size)
 {
@@ -137,6 +144,7 @@ static void abox_log_flush(struct device *dev,
 	struct ABOX_LOG_BUFFER *log_buffer = info->log_buffer;
 	unsigned int index_writer = log_buffer->index_writer;
 	struct abox_log_kernel_buffer *kernel_buffer = &info->kernel_buffer;
+	size_t size, written = 0;
 
 	if (log_buffer->index_reader == index_writer)
 		return;
@@ -151,18 +159,22 @@ static void abox_log_flush(struct device *dev,
 		abox_log_file_save(dev, info);
 
 	if (log_buffer->index_reader > index_writer) {
+		size = log_buffer->size - log_buffer->index_reader;
 		abox_log_memcpy(info->dev, kernel_buffer,
 				log_buffer->buffer + log_buffer->index_reader,
-				log_buffer->size - log_buffer->index_reader);
+				size);
+		written += size;
 		log_buffer->index_reader = 0;
 	}
+	size = index_writer - log_buffer->index_reader;
 	abox_log_memcpy(info->dev, kernel_buffer,
 			log_buffer->buffer + log_buffer->index_reader,
-			index_writer - log_buffer->index_reader);
+			size);
+	written += size;
 	log_buffer->index_reader = index_writer;
+	abox_log_update_written(kernel_buffer, written);
 	mutex_unlock(&info->lock);
 
-	kernel_buffer->updated = true;
 	wake_up_interruptible(&kernel_buffer->wq);
 
 #ifdef TEST
@@ -213,13 +225,18 @@ EXPORT_SYMBOL(abox_log_drain_all);
 static int abox_log_file_open(struct inode *inode, struct  file *file)
 {
 	struct abox_log_buffer_info *info = inode->i_private;
+	u64 written;
 
 	dev_dbg(info->dev, "%s\n", __func__);
 
 	if (atomic_cmpxchg(&info->opened, 0, 1))
 		return -EBUSY;
 
-	info->file_index = -1;
+	mutex_lock(&info->lock);
+	written = info->kernel_buffer.header->written;
+	info->file_pos = (written > SIZE_OF_BUFFER) ?
+			written - SIZE_OF_BUFFER : 0;
+	mutex_unlock(&info->lock);
 	file->private_data = info;
 
 	return 0;
@@ -241,59 +258,51 @@ static ssize_t abox_log_file_read(struct file *file, char __user *buf,
 {
 	struct abox_log_buffer_info *info = file->private_data;
 	struct abox_log_kernel_buffer *kernel_buffer = &info->kernel_buffer;
+	struct abox_log_mmap_header *header = kernel_buffer->header;
 	unsigned int index;
-	size_t end, size;
-	bool first = (info->file_index < 0);
+	u64 written;
+	size_t size;
 	int ret;
 
 	dev_dbg(info->dev, "%s(%zu, %lld)\n", __func__, count, *ppos);
 
 	mutex_lock(&info->lock);
 
-	if (first) {
-		info->file_index = likely(kernel_buffer->wrap) ?
-				kernel_buffer->index : 0;
-	}
+	while ((written = header->written) == info->file_pos) {
+		mutex_unlock(&info->lock);
+		if (file->f_flags & O_NONBLOCK) {
+			dev_dbg(info->dev, "non block\n");
+			return -EAGAIN;
+		}
 
-	do {
-		index = kernel_buffer->index;
-		end = ((info->file_index < index) ||
-				((info->file_index == index) && !first)) ?
-				index : SIZE_OF_BUFFER;
-		size = min(end - info->file_index, count);
-		if (size == 0) {
-			mutex_unlock(&info->lock);
-			if (file->f_flags & O_NONBLOCK) {
-				dev_dbg(info->dev, "non block\n");
-				return -EAGAIN;
-			}
-			kernel_buffer->updated = false;
-
-			ret = wait_event_interruptible(kernel_buffer->wq,
-					kernel_buffer->updated);
-			if (ret != 0) {
-				dev_dbg(info->dev, "interrupted\n");
-				return ret;
-			}
-			mutex_lock(&info->lock);
+		ret = wait_event_interruptible(kernel_buffer->wq,
+				READ_ONCE(header->written) != info->file_pos);
+		if (ret != 0) {
+			dev_dbg(info->dev, "interrupted\n");
+			return ret;
 		}
-#ifdef VERBOSE_LOG
-		dev_dbg(info->dev, "loop %zu, %zu, %zd, %zu\n", size, end,
-				info->file_index, count);
-#endif
-	} while (size == 0);
+		mutex_lock(&info->lock);
+	}
+
+	if (written - info->file_pos > SIZE_OF_BUFFER) {
+		dev_dbg(info->dev, "overrun: %llu bytes lost\n",
+				written - info->file_pos - SIZE_OF_BUFFER);
+		header->overruns++;
+		info->file_pos = written - SIZE_OF_BUFFER;
+	}
+
+	index = info->file_pos & (SIZE_OF_BUFFER - 1);
+	size = min_t(u64, written - info->file_pos, SIZE_OF_BUFFER - index);
+	size = min(size, count);
 
-	dev_dbg(info->dev, "start=%zd, end=%zd size=%zd\n", info->file_index,
-			end, size);
-	if (copy_to_user(buf, kernel_buffer->buffer + info->file_index,
-			size)) {
+	dev_dbg(info->dev, "pos=%llu, written=%llu, size=%zu\n",
+			info->file_pos, written, size);
+	if (copy_to_user(buf, kernel_buffer->buffer + index, size)) {
 		mutex_unlock(&info->lock);
 		return -EFAULT;
 	}
 
-	info->file_index += size;
-	if (info->file_index >= SIZE_OF_BUFFER)
-		info->file_index = 0;
+	info->file_pos += size;
 
 	mutex_unlock(&info->lock);
 
@@ -310,7 +319,25 @@ static unsigned int abox_log_file_poll(struct file *file, poll_table *wait)
 	dev_dbg(info->dev, "%s\n", __func__);
 
 	poll_wait(file, &kernel_buffer->wq, wait);
-	return POLLIN | POLLRDNORM;
+	if (READ_ONCE(kernel_buffer->header->written) != info->file_pos)
+		return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+
+static int abox_log_file_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct abox_log_buffer_info *info = file->private_data;
+
+	dev_dbg(info->dev, "%s\n", __func__);
+
+	/* collectors read the ring in place, only kernel writes it */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return remap_vmalloc_range(vma, info->kernel_buffer.header,
+			vma->vm_pgoff);
 }
 
 static const struct file_operations abox_log_fops = {
@@ -318,6 +345,7 @@ static const struct file_operations abox_log_fops = {
 	.release = abox_log_file_release,
 	.read = abox_log_file_read,
 	.poll = abox_log_file_poll,
+	.mmap = abox_log_file_mmap,
 	.llseek = generic_file_llseek,
 	.owner = THIS_MODULE,
 };
@@ -342,13 +370,26 @@ void abox_log_register_buffer_work_func(struct work_struct *work)
 	dev_info(dev, "%s(%d)\n", __func__, id);
 
 	info = vmalloc(sizeof(*info));
+	if (!info) {
+		dev_err(dev, "failed to register log buffer %d\n", id);
+		return;
+	}
 	mutex_init(&info->lock);
 	info->id = id;
 	info->file_created = false;
 	atomic_set(&info->opened, 0);
-	info->kernel_buffer.buffer = vzalloc(SIZE_OF_BUFFER);
+	/* header page followed by log ring, mapped to userspace as a whole */
+	info->kernel_buffer.header = vmalloc_user(PAGE_SIZE + SIZE_OF_BUFFER);
+	if (!info->kernel_buffer.header) {
+		dev_err(dev, "failed to allocate log buffer %d\n", id);
+		vfree(info);
+		return;
+	}
+	info->kernel_buffer.header->size = SIZE_OF_BUFFER;
+	info->kernel_buffer.header->offset = PAGE_SIZE;
+	info->kernel_buffer.buffer = (char *)info->kernel_buffer.header +
+			PAGE_SIZE;
 	info->kernel_buffer.index = 0;
-	info->kernel_buffer.wrap = false;
 	init_waitqueue_head(&info->kernel_buffer.wq);
 	info->dev = dev;
 	info->log_buffer = buffer;
@@ -15,6 +15,19 @@
 #include <linux/device.h>
 #include <sound/samsung/abox.h>
 
+/**
+ * Header at the beginning of mmap()ed log-XX debugfs file.
+ * Log is a ring of @size bytes starting at @offset from the header.
+ * Reader keeps its own absolute position and reads up to @written.
+ * If @written runs ahead of the position more than @size, reader is overrun.
+ */
+struct abox_log_mmap_header {
+	__u64 written;
+	__u32 size;
+	__u32 offset;
+	__u64 overruns;
+};
+
 /**
  * Flush log from all shared memories to kernel memory
  * @param[in]	dev		pointer to abox device
@@ -1240,7 +1240,8 @@ static const struct snd_pcm_hardware abox_rdma_hardware = {
 	.info			= SNDRV_PCM_INFO_INTERLEAVED
 				| SNDRV_PCM_INFO_BLOCK_TRANSFER
 				| SNDRV_PCM_INFO_MMAP
-				| SNDRV_PCM_INFO_MMAP_VALID,
+				| SNDRV_PCM_INFO_MMAP_VALID
+				| SNDRV_PCM_INFO_NO_PERIOD_WAKEUP,
 	.formats		= ABOX_SAMPLE_FORMATS,
 	.channels_min		= 1,
 	.channels_max		= 8,
@@ -1268,7 +1269,7 @@ static irqreturn_t abox_rdma_irq_handler(int irq, void *dev_id,
 
 	switch (pcmtask_msg->msgtype) {
 	case PCM_PLTDAI_POINTER:
-		snd_pcm_period_elapsed(data->substream);
+		abox_dma_period_elapsed(data);
 		break;
 	default:
 		dev_warn(dev, "Unknown pcmtask message: %d\n",
@@ -1391,7 +1392,7 @@ static int abox_rdma_hw_params(struct snd_pcm_substream *substream,
 	if (ret < 0)
 		return ret;
 
-	if (params_rate(params) > 48000)
+	if (params_rate(params) > 48000 || data->low_latency)
 		abox_request_cpu_gear_dai(dev, abox_data, rtd->cpu_dai,
 				abox_data->cpu_gear_min - 1);
 
@@ -1501,6 +1502,7 @@ static int abox_rdma_trigger(struct snd_pcm_substream *substream, int cmd)
 	case SNDRV_PCM_TRIGGER_RESUME:
 	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
 		pcmtask_msg->param.trigger = 1;
+		abox_dma_latency_start(data);
 		ret = abox_rdma_request_ipc(data, &msg, 1, 0);
 		break;
 	case SNDRV_PCM_TRIGGER_STOP:
@@ -1597,6 +1599,9 @@ static int abox_rdma_open(struct snd_pcm_substream *substream)
 			abox_data->cpu_gear_min);
 
 	snd_soc_set_runtime_hwparams(substream, &abox_rdma_hardware);
+	ret = abox_dma_open_constraints(data, substream);
+	if (ret < 0)
+		goto err_constraints;
 
 	data->substream = substream;
 
@@ -1606,6 +1611,16 @@ static int abox_rdma_open(struct snd_pcm_substream *substream)
 	ret = abox_rdma_request_ipc(data, &msg, 0, 0);
 
 	return ret;
+
+err_constraints:
+	abox_request_cpu_gear_dai(dev, abox_data, rtd->cpu_dai,
+			ABOX_CPU_GEAR_MIN);
+	if (data->type == PLATFORM_CALL) {
+		abox_request_cpu_gear(dev, abox_data, ABOX_CPU_GEAR_CALL_KERNEL,
+				ABOX_CPU_GEAR_MIN);
+		abox_request_l2c(dev, abox_data, dev, false);
+	}
+	return ret;
 }
 
 static int abox_rdma_close(struct snd_pcm_substream *substream)
@@ -2079,6 +2094,10 @@ static int samsung_abox_rdma_probe(struct platform_device *pdev)
 	if (ret < 0)
 		return ret;
 
+	ret = sysfs_create_group(&dev->kobj, &abox_dma_attr_group);
+	if (ret < 0)
+		dev_warn(dev, "Failed to create sysfs group: %d\n", ret);
+
 	data->hwdep = NULL;
 
 	return 0;
@@ -2086,6 +2105,7 @@ static int samsung_abox_rdma_probe(struct platform_device *pdev)
 
 static int samsung_abox_rdma_remove(struct platform_device *pdev)
 {
+	sysfs_remove_group(&pdev->dev.kobj, &abox_dma_attr_group);
 	snd_soc_unregister_platform(&pdev->dev);
 	return 0;
 }
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _TEST_SMFC_LINUX_DEVICE_H
+#define _TEST_SMFC_LINUX_DEVICE_H
+
+#include <stdio.h>
+
+struct device {
+	const char *name;
+};
+
+#define dev_err(dev, fmt, ...) \
+	fprintf(stderr, "%s: " fmt, (dev)->name, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _TEST_SMFC_LINUX_ERRNO_H
+#define _TEST_SMFC_LINUX_ERRNO_H
+
+#include <asm/errno.h>
+
+#endif
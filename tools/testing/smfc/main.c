@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measures the DHT/DQT parser and the table cache of the SMFC driver over
+ * the headers of a corpus of JPEG files. The tables of every file are staged
+ * the way smfc_parse_jpeg_header() stages them and then given to:
+ * - parse: smfc_parse_table_segments() on every header
+ * - cached: the cache lookup, parsing only on a miss, in the corpus order
+ *   like a series of streams decompressed by a context
+ * - lookup: the cache lookup of a header that always hits
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/kernel.h>
+#include <linux/device.h>
+
+#include "smfc-tables.h"
+
+struct jpeg_header {
+	const char *name;
+	unsigned int len;
+	u8 segments[SMFC_MAX_TABLE_SEGMENTS_LEN];
+};
+
+static struct device dev = { .name = "smfc-tables" };
+static struct smfc_table_cache cache;
+static struct smfc_decomp_qtable qtbl;
+static struct smfc_decomp_htable htbl;
+
+/* keeps the DHT and DQT segments led by their marker bytes until SOS */
+static int stage_header(struct jpeg_header *hdr, const u8 *stream, size_t size)
+{
+	const u8 *pos = stream + 2;
+	const u8 *end = stream + size;
+
+	if (size < 4 || stream[0] != 0xFF || stream[1] != 0xD8)
+		return -EINVAL;
+
+	hdr->len = 0;
+	while (pos + 4 <= end) {
+		u8 marker;
+		u16 len;
+
+		if (pos[0] != 0xFF)
+			return -EINVAL;
+
+		marker = pos[1];
+		if (marker == 0xDA)
+			return 0;
+		if (marker == 0xD9)
+			return -EINVAL;
+
+		pos += 2;
+		len = (pos[0] << 8) | pos[1];
+		if (len < 2 || pos + len > end)
+			return -EINVAL;
+
+		if (marker == 0xC4 || marker == 0xDB) {
+			if (hdr->len + len + 1 > sizeof(hdr->segments))
+				return -E2BIG;
+			hdr->segments[hdr->len++] = marker;
+			memcpy(hdr->segments + hdr->len, pos, len);
+			hdr->len += len;
+		}
+
+		pos += len;
+	}
+
+	return -EINVAL;
+}
+
+static int load_header(struct jpeg_header *hdr, const char *name)
+{
+	FILE *fp = fopen(name, "rb");
+	u8 *stream;
+	long size;
+	int ret = -EIO;
+
+	if (!fp) {
+		perror(name);
+		return -ENOENT;
+	}
+
+	if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) <= 0 ||
+			fseek(fp, 0, SEEK_SET))
+		goto out;
+
+	stream = malloc(size);
+	if (!stream)
+		goto out;
+
+	if (fread(stream, 1, size, fp) == (size_t)size)
+		ret = stage_header(hdr, stream, size);
+	free(stream);
+out:
+	fclose(fp);
+	if (ret)
+		fprintf(stderr, "%s: no JPEG header found (%d)\n", name, ret);
+	hdr->name = name;
+	return ret;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stage(const struct jpeg_header *hdr)
+{
+	memcpy(cache.stage, hdr->segments, hdr->len);
+	cache.stage_len = hdr->len;
+}
+
+static void report(const char *name, unsigned long long ns, unsigned long count)
+{
+	printf("%-7s %10lu headers %10.1f ns/header\n", name, count,
+	       (double)ns / count);
+}
+
+int main(int argc, char *argv[])
+{
+	struct jpeg_header *hdrs;
+	unsigned long iterations = 10000;
+	unsigned long i, hits = 0, misses = 0;
+	unsigned long long start;
+	int num = 0, n, opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		if (opt != 'n') {
+			fprintf(stderr, "usage: %s [-n iterations] file.jpg...\n",
+				argv[0]);
+			return 1;
+		}
+		iterations = strtoul(optarg, NULL, 0);
+	}
+
+	if (optind == argc || !iterations) {
+		fprintf(stderr, "usage: %s [-n iterations] file.jpg...\n",
+			argv[0]);
+		return 1;
+	}
+
+	hdrs = calloc(argc - optind, sizeof(*hdrs));
+	if (!hdrs)
+		return 1;
+
+	for (n = optind; n < argc; n++) {
+		if (load_header(&hdrs[num], argv[n]))
+			continue;
+		stage(&hdrs[num]);
+		if (smfc_parse_table_segments(&dev, cache.stage, cache.stage_len,
+					      &qtbl, &htbl)) {
+			fprintf(stderr, "%s: invalid tables\n", argv[n]);
+			continue;
+		}
+		num++;
+	}
+
+	if (!num)
+		return 1;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		for (n = 0; n < num; n++) {
+			stage(&hdrs[n]);
+			smfc_parse_table_segments(&dev, cache.stage,
+						  cache.stage_len, &qtbl, &htbl);
+		}
+	}
+	report("parse", now_ns() - start, iterations * num);
+
+	cache.valid = false;
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		for (n = 0; n < num; n++) {
+			stage(&hdrs[n]);
+			if (smfc_table_cache_hit(&cache)) {
+				hits++;
+				continue;
+			}
+			misses++;
+			cache.valid = false;
+			if (!smfc_parse_table_segments(&dev, cache.stage,
+						       cache.stage_len,
+						       &qtbl, &htbl))
+				smfc_table_cache_update(&cache);
+		}
+	}
+	report("cached", now_ns() - start, iterations * num);
+	printf("%-7s %10lu hits %10lu misses\n", "", hits, misses);
+
+	stage(&hdrs[0]);
+	smfc_table_cache_hit(&cache);
+	smfc_parse_table_segments(&dev, cache.stage, cache.stage_len,
+				  &qtbl, &htbl);
+	smfc_table_cache_update(&cache);
+	start = now_ns();
+	for (i = 0; i < iterations; i++)
+		smfc_table_cache_hit(&cache);
+	report("lookup", now_ns() - start, iterations);
+
+	free(hdrs);
+
+	return 0;
+}